@@ -0,0 +1,361 @@
+//
+// file AtomTyper.cc
+// agent
+// 17th October 2026
+//
+// Implementation of AtomTyper
+
+#include "AtomTyper.H"
+#include "SMARTSSignature.H"
+#include "SmgProfile.H"
+#include "smarts_atom_expr.H"
+
+using namespace std;
+using namespace OEChem;
+
+// ***********************************************************************
+AtomTyper::AtomTyper( const vector<pair<string,string> > &input_smarts ,
+		      const vector<pair<string,string> > &smarts_sub_defn ) :
+  smarts_sub_defn_( smarts_sub_defn ) , mol_( 0 ) ,
+  num_words_( 0 ) {
+
+  for( int i = 0 , is = smarts_sub_defn_.size() ; i < is ; ++i ) {
+    TYPER_DEF def;
+    def.name_ = smarts_sub_defn_[i].first;
+    def.smarts_ = smarts_sub_defn_[i].second;
+    def.single_atom_ = is_single_atom_smarts( def.smarts_ );
+    def.full_ = false;
+    def.root_ = -1;
+    def.full_search_ = -1;
+    def_nums_.insert( make_pair( def.name_ , int( defs_.size() ) ) );
+    defs_.push_back( def );
+  }
+
+  vector<char> in_progress( defs_.size() , 0 );
+  for( int i = 0 , is = input_smarts.size() ; i < is ; ++i ) {
+    map<string,int>::iterator p = def_nums_.find( input_smarts[i].first );
+    if( p == def_nums_.end() ) {
+      // a full definition that isn't a binding as well
+      TYPER_DEF def;
+      def.name_ = input_smarts[i].first;
+      def.smarts_ = input_smarts[i].second;
+      def.single_atom_ = is_single_atom_smarts( def.smarts_ );
+      def.full_ = false;
+      def.root_ = -1;
+      def.full_search_ = -1;
+      p = def_nums_.insert( make_pair( def.name_ , int( defs_.size() ) ) ).first;
+      defs_.push_back( def );
+      in_progress.push_back( 0 );
+    }
+    TYPER_DEF &def = defs_[p->second];
+    def.full_ = true;
+    if( def.single_atom_ ) {
+      compile_def( p->second , in_progress );
+    } else if( -1 == def.full_search_ ) {
+      // allow OESubSearch to rearrange for efficiency
+      string exp_smarts = expand_smarts( p->second );
+      full_searches_.push_back( new OESubSearch( exp_smarts.c_str() , true ) );
+      full_search_sigs_.push_back( SMARTSSignature( exp_smarts ) );
+      def.full_search_ = full_searches_.size() - 1;
+    }
+  }
+
+  node_atoms_.resize( nodes_.size() );
+  node_done_.resize( nodes_.size() , 0 );
+
+}
+
+// ***********************************************************************
+AtomTyper::~AtomTyper() {
+
+  for( int i = 0 , is = atom_searches_.size() ; i < is ; ++i ) {
+    delete atom_searches_[i];
+  }
+  for( int i = 0 , is = full_searches_.size() ; i < is ; ++i ) {
+    delete full_searches_[i];
+  }
+
+}
+
+// ***********************************************************************
+bool AtomTyper::has_definition( const string &smarts_name ) const {
+
+  map<string,int>::const_iterator p = def_nums_.find( smarts_name );
+  return p != def_nums_.end() && defs_[p->second].full_;
+
+}
+
+// ***********************************************************************
+void AtomTyper::set_molecule( OEMolBase &mol ) {
+
+  mol_ = &mol;
+  // atom indices can have gaps, e.g. after hydrogens have been removed, so
+  // NOT needs to know which atoms are really there.
+  num_words_ = mol.GetMaxAtomIdx() / 64 + 1;
+  all_atoms_.assign( num_words_ , 0 );
+  for( OEIter<OEAtomBase> atom = mol.GetAtoms() ; atom ; ++atom ) {
+    unsigned int idx = atom->GetIdx();
+    all_atoms_[idx / 64] |= boost::uint64_t( 1 ) << ( idx % 64 );
+  }
+  fill( node_done_.begin() , node_done_.end() , 0 );
+  SMARTSSignature::make_mol_signature( mol , mol_sig_ );
+
+}
+
+// ***********************************************************************
+void AtomTyper::match( const string &smarts_name ,
+		       vector<vector<unsigned int> > &matches ) {
+
+  matches.clear();
+  map<string,int>::iterator p = def_nums_.find( smarts_name );
+  if( p == def_nums_.end() || !defs_[p->second].full_ ) {
+    throw( string( "No SMARTS definition for " ) + smarts_name );
+  }
+
+  if( match_stats_.empty() ) {
+    match_def( defs_[p->second] , matches );
+    return;
+  }
+  boost::uint64_t start = profile_nsecs();
+  match_def( defs_[p->second] , matches );
+  SMARTS_MATCH_STATS &stats = match_stats_[p->second];
+  stats.nsecs_ += profile_nsecs() - start;
+  ++stats.num_calls_;
+  if( !matches.empty() ) {
+    ++stats.num_hits_;
+    stats.num_matches_ += matches.size();
+  }
+
+}
+
+// ***********************************************************************
+void AtomTyper::set_profiling( bool profiling ) {
+
+  match_stats_.clear();
+  if( profiling ) {
+    SMARTS_MATCH_STATS zero_stats = { "" , 0 , 0 , 0 , 0 };
+    match_stats_.resize( defs_.size() , zero_stats );
+    for( int i = 0 , is = defs_.size() ; i < is ; ++i ) {
+      match_stats_[i].name_ = defs_[i].name_;
+    }
+  }
+
+}
+
+// ***********************************************************************
+void AtomTyper::match_def( TYPER_DEF &def ,
+			   vector<vector<unsigned int> > &matches ) {
+
+  if( -1 != def.full_search_ ) {
+    if( !full_search_sigs_[def.full_search_].could_match( mol_sig_ ) ) {
+      return;
+    }
+    OEIter<OEMatchBase> match;
+    for( match = full_searches_[def.full_search_]->Match( *mol_ , true ) ;
+	 match ; ++match ) {
+      OEIter<OEMatchPair<OEAtomBase> > mp = match->GetAtoms();
+      matches.push_back( vector<unsigned int>() );
+      for( ; mp ; ++mp )
+	matches.back().push_back( mp->target->GetIdx() );
+    }
+  } else {
+    const vector<boost::uint64_t> &atoms = eval_node( def.root_ );
+    for( int i = 0 ; i < num_words_ ; ++i ) {
+      for( boost::uint64_t w = atoms[i] ; w ; w &= w - 1 ) {
+	int bit = 0;
+	while( !( w & ( boost::uint64_t( 1 ) << bit ) ) ) {
+	  ++bit;
+	}
+	matches.push_back( vector<unsigned int>( 1 , i * 64 + bit ) );
+      }
+    }
+  }
+
+}
+
+// ***********************************************************************
+// make the expression tree for the atoms that match the definition as a
+// binding, returning its root node. Single-atom definitions are parsed, so
+// that the bindings they use become the nodes of those definitions and
+// everything else goes to OEChem as single-atom SMARTS. For anything else,
+// the atoms are the ones that start a match, which is what OEChem does with
+// the recursive SMARTS.
+int AtomTyper::compile_def( int def_num , vector<char> &in_progress ) {
+
+  if( -1 != defs_[def_num].root_ ) {
+    return defs_[def_num].root_;
+  }
+  if( in_progress[def_num] ) {
+    throw( string( "Can't expand vector bindings in SMARTS string " )
+	   + defs_[def_num].smarts_ + " label " + defs_[def_num].name_
+	   + ", it uses itself." );
+  }
+
+  const string &smarts = defs_[def_num].smarts_;
+  int root = -1;
+  vector<ATOM_EXPR_NODE> expr_nodes;
+  string expr;
+  if( defs_[def_num].single_atom_ ) {
+    expr = smarts.substr( 1 , smarts.length() - 2 );
+    size_t pos = 0;
+    int expr_root = parse_smarts_atom_expr( expr , pos , 0 , expr_nodes );
+    if( pos != expr.length() ) {
+      expr_root = -1;
+    } else if( 1 == expr_nodes.size() && !expr_nodes[0].has_ref_ ) {
+      // a single leaf with no bindings goes to OEChem as it is, so that
+      // [H], [2H], [H+] etc. are still hydrogen atoms.
+      root = add_atom_search( smarts );
+      expr_root = -1;
+    }
+    if( -1 != expr_root ) {
+      in_progress[def_num] = 1;
+      // children are always before their parents in expr_nodes, so the
+      // typer nodes can be made in the same order.
+      vector<int> typer_nodes( expr_nodes.size() , -1 );
+      for( int i = 0 , is = expr_nodes.size() ; i < is ; ++i ) {
+	ATOM_EXPR_NODE &en = expr_nodes[i];
+	if( !en.has_ref_ ) {
+	  string atom_smarts = expr.substr( en.start_ , en.end_ - en.start_ );
+	  if( 'H' == atom_smarts[0] ) {
+	    // in a bigger expression, a leading H is a hydrogen count, but
+	    // [H] on its own would be a hydrogen atom.
+	    atom_smarts = "*&" + atom_smarts;
+	  }
+	  typer_nodes[i] = add_atom_search( "[" + atom_smarts + "]" );
+	} else if( '$' == en.op_ ) {
+	  map<string,int>::iterator p = def_nums_.find( en.ref_ );
+	  if( p == def_nums_.end() ) {
+	    throw( string( "Can't expand vector bindings in SMARTS string " )
+		   + smarts + " label " + defs_[def_num].name_ );
+	  }
+	  typer_nodes[i] = compile_def( p->second , in_progress );
+	} else if( '!' == en.op_ ) {
+	  typer_nodes[i] = add_node( TYPER_NOT , typer_nodes[en.left_] , -1 , -1 );
+	} else if( ',' == en.op_ ) {
+	  typer_nodes[i] = add_node( TYPER_OR , typer_nodes[en.left_] ,
+				     typer_nodes[en.right_] , -1 );
+	} else {
+	  typer_nodes[i] = add_node( TYPER_AND , typer_nodes[en.left_] ,
+				     typer_nodes[en.right_] , -1 );
+	}
+      }
+      in_progress[def_num] = 0;
+      root = typer_nodes[expr_root];
+    }
+  }
+
+  if( -1 == root ) {
+    root = add_atom_search( "[$(" + expand_smarts( def_num ) + ")]" );
+  }
+
+  defs_[def_num].root_ = root;
+  return root;
+
+}
+
+// ***********************************************************************
+int AtomTyper::add_node( TYPER_OP op , int left , int right , int search ) {
+
+  TYPER_NODE node;
+  node.op_ = op;
+  node.left_ = left;
+  node.right_ = right;
+  node.search_ = search;
+  nodes_.push_back( node );
+  return nodes_.size() - 1;
+
+}
+
+// ***********************************************************************
+// the same bits of SMARTS turn up in lots of definitions, so they're only
+// searched for once.
+int AtomTyper::add_atom_search( const string &smarts ) {
+
+  map<string,int>::iterator p = atom_search_nodes_.find( smarts );
+  if( p != atom_search_nodes_.end() ) {
+    return p->second;
+  }
+
+  string exp_smarts = smarts;
+  if( string::npos != exp_smarts.find( "$" ) &&
+      !OESmartsLexReplace( exp_smarts , smarts_sub_defn_ ) ) {
+    throw( string( "Can't expand vector bindings in SMARTS string " ) + smarts );
+  }
+  atom_searches_.push_back( new OESubSearch( exp_smarts.c_str() , true ) );
+  atom_search_sigs_.push_back( SMARTSSignature( exp_smarts ) );
+  int node = add_node( TYPER_OE , -1 , -1 , atom_searches_.size() - 1 );
+  atom_search_nodes_.insert( make_pair( smarts , node ) );
+  return node;
+
+}
+
+// ***********************************************************************
+string AtomTyper::expand_smarts( int def_num ) const {
+
+  string exp_smarts = defs_[def_num].smarts_;
+  if( string::npos != exp_smarts.find( "$" ) &&
+      !OESmartsLexReplace( exp_smarts , smarts_sub_defn_ ) ) {
+    throw( string( "Can't expand vector bindings in SMARTS string " )
+	   + defs_[def_num].smarts_ + " label " + defs_[def_num].name_ );
+  }
+  return exp_smarts;
+
+}
+
+// ***********************************************************************
+// the atoms for each node are only worked out once per molecule, however
+// many definitions use them.
+const vector<boost::uint64_t> &AtomTyper::eval_node( int node_num ) {
+
+  vector<boost::uint64_t> &atoms = node_atoms_[node_num];
+  if( node_done_[node_num] ) {
+    return atoms;
+  }
+
+  const TYPER_NODE &node = nodes_[node_num];
+  if( TYPER_OE == node.op_ ) {
+    match_atoms( node.search_ , atoms );
+  } else if( TYPER_NOT == node.op_ ) {
+    const vector<boost::uint64_t> &left = eval_node( node.left_ );
+    atoms.resize( num_words_ );
+    for( int i = 0 ; i < num_words_ ; ++i ) {
+      atoms[i] = ~left[i] & all_atoms_[i];
+    }
+  } else {
+    const vector<boost::uint64_t> &left = eval_node( node.left_ );
+    const vector<boost::uint64_t> &right = eval_node( node.right_ );
+    atoms.resize( num_words_ );
+    if( TYPER_AND == node.op_ ) {
+      for( int i = 0 ; i < num_words_ ; ++i ) {
+	atoms[i] = left[i] & right[i];
+      }
+    } else {
+      for( int i = 0 ; i < num_words_ ; ++i ) {
+	atoms[i] = left[i] | right[i];
+      }
+    }
+  }
+
+  node_done_[node_num] = 1;
+  return atoms;
+
+}
+
+// ***********************************************************************
+void AtomTyper::match_atoms( int search_num ,
+			     vector<boost::uint64_t> &atoms ) {
+
+  atoms.assign( num_words_ , 0 );
+  if( !atom_search_sigs_[search_num].could_match( mol_sig_ ) ) {
+    return;
+  }
+  OEIter<OEMatchBase> match;
+  for( match = atom_searches_[search_num]->Match( *mol_ , true ) ; match ; ++match ) {
+    OEIter<OEMatchPair<OEAtomBase> > mp = match->GetAtoms();
+    if( mp ) {
+      unsigned int idx = mp->target->GetIdx();
+      atoms[idx / 64] |= boost::uint64_t( 1 ) << ( idx % 64 );
+    }
+  }
+
+}
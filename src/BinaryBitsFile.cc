@@ -0,0 +1,378 @@
+//
+// file BinaryBitsFile.cc
+// agent
+// 17th October 2026
+//
+// Implementation of BinaryBitsFile
+
+#include "BinaryBitsFile.H"
+#include "FileExceptions.H"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// ***********************************************************************
+// orders row numbers on their titles, as string comparison would
+class TitleIsLess {
+public :
+  TitleIsLess( const char *titles , const boost::uint64_t *offsets ) :
+    titles_( titles ) , offsets_( offsets ) {}
+  bool operator()( boost::uint32_t r1 , boost::uint32_t r2 ) const {
+    boost::uint64_t len1 = offsets_[r1 + 1] - offsets_[r1];
+    boost::uint64_t len2 = offsets_[r2 + 1] - offsets_[r2];
+    int cmp = memcmp( titles_ + offsets_[r1] , titles_ + offsets_[r2] ,
+		      min( len1 , len2 ) );
+    return cmp ? cmp < 0 : len1 < len2;
+  }
+private :
+  const char *titles_;
+  const boost::uint64_t *offsets_;
+};
+
+// ***********************************************************************
+// map the whole of tmp, which must have been flushed, returning 0 if it
+// can't be.
+void *map_tmp_file( FILE *tmp , size_t size ) {
+
+  void *map = mmap( 0 , size , PROT_READ , MAP_SHARED , fileno( tmp ) , 0 );
+  return MAP_FAILED == map ? 0 : map;
+
+}
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+FILE *open_binary_tmp_file( const string &filename , const string &extra ) {
+
+  string tmp_name = filename + extra + ".XXXXXX";
+  vector<char> tmpl( tmp_name.begin() , tmp_name.end() );
+  tmpl.push_back( '\0' );
+  int fd = mkstemp( &tmpl[0] );
+  if( -1 == fd ) {
+    throw DACLIB::FileWriteOpenError( tmp_name.c_str() );
+  }
+  unlink( &tmpl[0] );
+  FILE *fp = fdopen( fd , "w+b" );
+  if( !fp ) {
+    ::close( fd );
+    throw DACLIB::FileWriteOpenError( tmp_name.c_str() );
+  }
+  setvbuf( fp , 0 , _IOFBF , 1 << 20 );
+  return fp;
+
+}
+
+// ***********************************************************************
+bool append_binary_tmp_file( FILE *tmp , ostream &os ) {
+
+  if( fflush( tmp ) || fseek( tmp , 0 , SEEK_SET ) ) {
+    return false;
+  }
+  vector<char> buf( 1 << 20 );
+  size_t len;
+  while( ( len = fread( &buf[0] , 1 , buf.size() , tmp ) ) > 0 ) {
+    os.write( &buf[0] , len );
+  }
+  return !ferror( tmp );
+
+}
+
+// ***********************************************************************
+BinaryBitsFile::BinaryBitsFile( const string &filename ) :
+  filename_( filename ) , map_( 0 ) , map_size_( 0 ) , header_( 0 ) ,
+  rows_( 0 ) , titles_( 0 ) , title_offsets_( 0 ) , index_( 0 ) {
+
+  int fd = open( filename_.c_str() , O_RDONLY );
+  if( -1 == fd ) {
+    throw DACLIB::FileReadOpenError( filename_.c_str() );
+  }
+  struct stat st;
+  if( fstat( fd , &st ) ) {
+    close( fd );
+    throw DACLIB::FileReadOpenError( filename_.c_str() );
+  }
+  map_size_ = st.st_size;
+  if( map_size_ < sizeof( BINARY_BITS_HEADER ) ) {
+    close( fd );
+    throw( filename_ + string( " is too small to be a binary bits file." ) );
+  }
+  map_ = mmap( 0 , map_size_ , PROT_READ , MAP_SHARED , fd , 0 );
+  close( fd );
+  if( MAP_FAILED == map_ ) {
+    map_ = 0;
+    throw DACLIB::FileReadOpenError( filename_.c_str() );
+  }
+
+  try {
+    check_header();
+    read_col_names();
+  } catch( string & ) {
+    munmap( map_ , map_size_ );
+    map_ = 0;
+    throw;
+  }
+
+}
+
+// ***********************************************************************
+BinaryBitsFile::~BinaryBitsFile() {
+
+  if( map_ ) {
+    munmap( map_ , map_size_ );
+  }
+
+}
+
+// ***********************************************************************
+string BinaryBitsFile::title( unsigned int row_num ) const {
+
+  return string( titles_ + title_offsets_[row_num] ,
+		 title_offsets_[row_num + 1] - title_offsets_[row_num] );
+
+}
+
+// ***********************************************************************
+int BinaryBitsFile::find_row( const string &title ) const {
+
+  // lower bound on the title
+  unsigned int lo = 0 , hi = header_->num_rows_;
+  while( lo < hi ) {
+    unsigned int mid = lo + ( hi - lo ) / 2;
+    unsigned int r = index_[mid];
+    int cmp = title.compare( 0 , string::npos , titles_ + title_offsets_[r] ,
+			     title_offsets_[r + 1] - title_offsets_[r] );
+    if( cmp > 0 ) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if( lo < header_->num_rows_ && title == this->title( index_[lo] ) ) {
+    return index_[lo];
+  }
+  return -1;
+
+}
+
+// ***********************************************************************
+void BinaryBitsFile::check_header() {
+
+  const char *base = static_cast<const char *>( map_ );
+  header_ = reinterpret_cast<const BINARY_BITS_HEADER *>( base );
+  if( memcmp( header_->magic_ , BINARY_BITS_MAGIC , 8 ) ) {
+    throw( filename_ + string( " is not a binary bits file." ) );
+  }
+  if( BINARY_BITS_BYTE_ORDER != header_->byte_order_ ) {
+    throw( filename_ + string( " was written on a machine with a different byte order." ) );
+  }
+
+  const BINARY_BITS_HEADER &h = *header_;
+  boost::uint64_t rows_size = h.num_rows_ * h.words_per_row_ * sizeof( boost::uint64_t );
+  if( h.words_per_row_ != ( h.num_cols_ + 63 ) / 64 ||
+      h.names_offset_ + h.names_size_ > map_size_ ||
+      h.rows_offset_ + rows_size > map_size_ ||
+      h.titles_offset_ + h.titles_size_ > map_size_ ||
+      h.title_offsets_offset_ + ( h.num_rows_ + 1 ) * sizeof( boost::uint64_t ) > map_size_ ||
+      h.index_offset_ + h.num_rows_ * sizeof( boost::uint32_t ) > map_size_ ) {
+    throw( filename_ + string( " is corrupt or truncated." ) );
+  }
+
+  rows_ = reinterpret_cast<const boost::uint64_t *>( base + h.rows_offset_ );
+  titles_ = base + h.titles_offset_;
+  title_offsets_ = reinterpret_cast<const boost::uint64_t *>( base + h.title_offsets_offset_ );
+  index_ = reinterpret_cast<const boost::uint32_t *>( base + h.index_offset_ );
+  if( title_offsets_[h.num_rows_] != h.titles_size_ ) {
+    throw( filename_ + string( " is corrupt or truncated." ) );
+  }
+
+}
+
+// ***********************************************************************
+void BinaryBitsFile::read_col_names() {
+
+  const char *next = static_cast<const char *>( map_ ) + header_->names_offset_;
+  const char *end = next + header_->names_size_;
+  for( unsigned int i = 0 ; i < header_->num_cols_ ; ++i ) {
+    for( int j = 0 ; j < 2 ; ++j ) {
+      const char *term = static_cast<const char *>( memchr( next , '\0' , end - next ) );
+      if( !term ) {
+	throw( filename_ + string( " is corrupt or truncated." ) );
+      }
+      if( !j ) {
+	col_names_.push_back( string( next , term ) );
+      } else {
+	col_labels_.push_back( string( next , term ) );
+      }
+      next = term + 1;
+    }
+  }
+
+}
+
+// ***********************************************************************
+BinaryBitsWriter::BinaryBitsWriter( const string &filename ,
+				    const vector<string> &col_names ,
+				    const vector<string> &col_labels ) :
+  filename_( filename ) , titles_tmp_( 0 ) , offsets_tmp_( 0 ) {
+
+  ofs_.open( filename_.c_str() , ios::out | ios::binary );
+  if( !ofs_ ) {
+    throw DACLIB::FileWriteOpenError( filename_.c_str() );
+  }
+  titles_tmp_ = open_binary_tmp_file( filename_ , ".titles" );
+  try {
+    offsets_tmp_ = open_binary_tmp_file( filename_ , ".offsets" );
+  } catch( DACLIB::FileWriteOpenError & ) {
+    fclose( titles_tmp_ );
+    throw;
+  }
+
+  // the header is filled in as the sections are written, and goes in at the
+  // start once everything's known.
+  memset( &header_ , 0 , sizeof( header_ ) );
+  memcpy( header_.magic_ , BINARY_BITS_MAGIC , 8 );
+  header_.byte_order_ = BINARY_BITS_BYTE_ORDER;
+  header_.num_cols_ = col_names.size();
+  header_.words_per_row_ = ( col_names.size() + 63 ) / 64;
+  ofs_.write( reinterpret_cast<const char *>( &header_ ) , sizeof( header_ ) );
+  align();
+
+  header_.names_offset_ = ofs_.tellp();
+  for( int i = 0 , is = col_names.size() ; i < is ; ++i ) {
+    ofs_.write( col_names[i].c_str() , col_names[i].length() + 1 );
+    ofs_.write( col_labels[i].c_str() , col_labels[i].length() + 1 );
+  }
+  header_.names_size_ = boost::uint64_t( ofs_.tellp() ) - header_.names_offset_;
+  align();
+
+  header_.rows_offset_ = ofs_.tellp();
+  row_.resize( header_.words_per_row_ );
+
+  boost::uint64_t zero = 0;
+  fwrite( &zero , sizeof( zero ) , 1 , offsets_tmp_ );
+
+}
+
+// ***********************************************************************
+BinaryBitsWriter::~BinaryBitsWriter() {
+
+  try {
+    close();
+  } catch( string &msg ) {
+    // can't throw from a destructor, so this is all we can do.
+    cerr << msg << endl;
+  }
+  if( titles_tmp_ ) {
+    fclose( titles_tmp_ );
+  }
+  if( offsets_tmp_ ) {
+    fclose( offsets_tmp_ );
+  }
+
+}
+
+// ***********************************************************************
+void BinaryBitsWriter::add_row( const string &title ,
+				const vector<unsigned int> &cols ) {
+
+  fill( row_.begin() , row_.end() , 0 );
+  for( int i = 0 , is = cols.size() ; i < is ; ++i ) {
+    row_[cols[i] / 64] |= boost::uint64_t( 1 ) << ( cols[i] % 64 );
+  }
+  if( !row_.empty() ) {
+    ofs_.write( reinterpret_cast<const char *>( &row_[0] ) ,
+		row_.size() * sizeof( boost::uint64_t ) );
+  }
+  fwrite( title.data() , 1 , title.length() , titles_tmp_ );
+  header_.titles_size_ += title.length();
+  fwrite( &header_.titles_size_ , sizeof( header_.titles_size_ ) , 1 ,
+	  offsets_tmp_ );
+  ++header_.num_rows_;
+
+}
+
+// ***********************************************************************
+void BinaryBitsWriter::close() {
+
+  if( !ofs_.is_open() ) {
+    return;
+  }
+
+  header_.titles_offset_ = ofs_.tellp();
+  bool ok = append_binary_tmp_file( titles_tmp_ , ofs_ );
+  align();
+  header_.title_offsets_offset_ = ofs_.tellp();
+  ok = append_binary_tmp_file( offsets_tmp_ , ofs_ ) && ok;
+  header_.index_offset_ = ofs_.tellp();
+  ok = ok && write_index();
+
+  ofs_.seekp( 0 );
+  ofs_.write( reinterpret_cast<const char *>( &header_ ) , sizeof( header_ ) );
+  ok = ofs_.good() && ok;
+  ofs_.close();
+  if( !ok || ofs_.fail() ) {
+    throw( string( "Error writing file " ) + filename_ +
+	   ", possibly out of disk space." );
+  }
+
+}
+
+// ***********************************************************************
+// the index is the row numbers sorted on title, ties staying in row order.
+// The titles are sorted where they are in the temporary files, which have
+// been flushed by append_binary_tmp_file.
+bool BinaryBitsWriter::write_index() {
+
+  if( !header_.num_rows_ ) {
+    return true;
+  }
+  size_t offsets_size = ( header_.num_rows_ + 1 ) * sizeof( boost::uint64_t );
+  void *offsets_map = map_tmp_file( offsets_tmp_ , offsets_size );
+  // a file of empty titles can't be mapped, but then the titles are never
+  // looked at.
+  void *titles_map = header_.titles_size_ ?
+    map_tmp_file( titles_tmp_ , header_.titles_size_ ) : 0;
+  if( !offsets_map || ( header_.titles_size_ && !titles_map ) ) {
+    if( offsets_map ) {
+      munmap( offsets_map , offsets_size );
+    }
+    return false;
+  }
+
+  vector<boost::uint32_t> index( header_.num_rows_ );
+  for( boost::uint32_t i = 0 ; i < header_.num_rows_ ; ++i ) {
+    index[i] = i;
+  }
+  stable_sort( index.begin() , index.end() ,
+	       TitleIsLess( titles_map ? static_cast<const char *>( titles_map ) : "" ,
+			    static_cast<const boost::uint64_t *>( offsets_map ) ) );
+  ofs_.write( reinterpret_cast<const char *>( &index[0] ) ,
+	      index.size() * sizeof( boost::uint32_t ) );
+
+  munmap( offsets_map , offsets_size );
+  if( titles_map ) {
+    munmap( titles_map , header_.titles_size_ );
+  }
+  return true;
+
+}
+
+// ***********************************************************************
+// pad the file out to the next 8-byte boundary
+void BinaryBitsWriter::align() {
+
+  static const char zeros[8] = { 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 };
+  boost::uint64_t pos = ofs_.tellp();
+  ofs_.write( zeros , binary_bits_align( pos ) - pos );
+
+}
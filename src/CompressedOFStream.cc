@@ -0,0 +1,366 @@
+//
+// file CompressedOFStream.cc
+// agent
+// 17th October 2026
+//
+// Implementation of CompressedOFStream and the sinks behind it.
+
+#include "CompressedOFStream.H"
+#include "FileExceptions.H"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <boost/bind.hpp>
+
+#include <zlib.h>
+#ifdef SMG_USE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// big enough that the handing over between threads is a small cost
+const size_t BLOCK_SIZE = 4 << 20;
+
+// ***********************************************************************
+bool has_suffix( const string &filename , const string &suffix ) {
+
+  return filename.length() > suffix.length() &&
+    !filename.compare( filename.length() - suffix.length() , suffix.length() ,
+		       suffix );
+
+}
+
+// ***********************************************************************
+class PlainSink : public CompressedSink {
+
+public :
+
+  explicit PlainSink( FILE *fp ) : fp_( fp ) {}
+  ~PlainSink() { close(); }
+
+  bool write( const char *data , size_t len ) {
+    return len == fwrite( data , 1 , len , fp_ );
+  }
+  bool close() {
+    bool ok = true;
+    if( fp_ ) {
+      ok = !fclose( fp_ );
+      fp_ = 0;
+    }
+    return ok;
+  }
+
+private :
+
+  FILE *fp_;
+
+};
+
+// ***********************************************************************
+class GzipSink : public CompressedSink {
+
+public :
+
+  explicit GzipSink( gzFile gzf ) : gzf_( gzf ) {}
+  ~GzipSink() { close(); }
+
+  bool write( const char *data , size_t len ) {
+    // gzwrite takes an unsigned int length, which the blocks fit in
+    return int( len ) == gzwrite( gzf_ , data , len );
+  }
+  bool close() {
+    bool ok = true;
+    if( gzf_ ) {
+      ok = Z_OK == gzclose( gzf_ );
+      gzf_ = 0;
+    }
+    return ok;
+  }
+
+private :
+
+  gzFile gzf_;
+
+};
+
+#ifdef SMG_USE_ZSTD
+// ***********************************************************************
+class ZstdSink : public CompressedSink {
+
+public :
+
+  explicit ZstdSink( FILE *fp ) : fp_( fp ) , cctx_( ZSTD_createCCtx() ) ,
+			 out_buf_( ZSTD_CStreamOutSize() ) {}
+  ~ZstdSink() { close(); }
+
+  bool write( const char *data , size_t len ) {
+    ZSTD_inBuffer in = { data , len , 0 };
+    while( in.pos < in.size ) {
+      if( !compress( in , ZSTD_e_continue ) ) {
+	return false;
+      }
+    }
+    return true;
+  }
+  bool close() {
+    if( !fp_ ) {
+      return true;
+    }
+    ZSTD_inBuffer in = { 0 , 0 , 0 };
+    bool ok = true;
+    size_t remaining = 0;
+    do {
+      ok = compress( in , ZSTD_e_end , &remaining );
+    } while( ok && remaining );
+    ok = !fclose( fp_ ) && ok;
+    fp_ = 0;
+    ZSTD_freeCCtx( cctx_ );
+    return ok;
+  }
+
+private :
+
+  FILE *fp_;
+  ZSTD_CCtx *cctx_;
+  vector<char> out_buf_;
+
+  // one round of compression, writing out what it produces. remaining, if
+  // given, gets what ZSTD_compressStream2 says is still to be flushed.
+  bool compress( ZSTD_inBuffer &in , ZSTD_EndDirective mode ,
+		 size_t *remaining = 0 ) {
+    ZSTD_outBuffer out = { &out_buf_[0] , out_buf_.size() , 0 };
+    size_t ret = ZSTD_compressStream2( cctx_ , &out , &in , mode );
+    if( ZSTD_isError( ret ) ) {
+      return false;
+    }
+    if( remaining ) {
+      *remaining = ret;
+    }
+    return out.pos == fwrite( &out_buf_[0] , 1 , out.pos , fp_ );
+  }
+
+};
+#endif
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+CompressedStreamBuf::CompressedStreamBuf( const string &filename ) :
+  filename_( filename ) , fill_block_( 0 ) , pending_( 0 ) ,
+  pending_len_( 0 ) , finished_( false ) {
+
+  if( has_suffix( filename_ , ".gz" ) ) {
+    gzFile gzf = gzopen( filename_.c_str() , "wb6" );
+    if( !gzf ) {
+      throw DACLIB::FileWriteOpenError( filename_.c_str() );
+    }
+    sink_.reset( new GzipSink( gzf ) );
+  } else {
+    if( is_zstd_name( filename_ ) && !have_zstd() ) {
+      throw( string( "Can't write " ) + filename_ +
+	     string( " as this smg was built without zstd support." ) );
+    }
+    FILE *fp = fopen( filename_.c_str() , "wb" );
+    if( !fp ) {
+      throw DACLIB::FileWriteOpenError( filename_.c_str() );
+    }
+#ifdef SMG_USE_ZSTD
+    if( is_zstd_name( filename_ ) ) {
+      sink_.reset( new ZstdSink( fp ) );
+    } else {
+      sink_.reset( new PlainSink( fp ) );
+    }
+#else
+    sink_.reset( new PlainSink( fp ) );
+#endif
+  }
+
+  blocks_[0].resize( BLOCK_SIZE );
+  blocks_[1].resize( BLOCK_SIZE );
+  setp( &blocks_[0][0] , &blocks_[0][0] + BLOCK_SIZE );
+  writer_.reset( new boost::thread( boost::bind( &CompressedStreamBuf::write_blocks , this ) ) );
+
+}
+
+// ***********************************************************************
+CompressedStreamBuf::~CompressedStreamBuf() {
+
+  try {
+    close();
+  } catch( string &msg ) {
+    // can't throw from a destructor, so this is all we can do.
+    cerr << msg << endl;
+  }
+
+}
+
+// ***********************************************************************
+void CompressedStreamBuf::close() {
+
+  if( !writer_ ) {
+    return;
+  }
+  hand_off_block();
+  wait_for_writer();
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    finished_ = true;
+  }
+  cond_.notify_all();
+  writer_->join();
+  writer_.reset();
+  setp( 0 , 0 );
+
+  if( !sink_->close() && error_.empty() ) {
+    error_ = string( "Error closing file " ) + filename_ + ".";
+  }
+  if( !error_.empty() ) {
+    throw error_;
+  }
+
+}
+
+// ***********************************************************************
+bool CompressedStreamBuf::is_zstd_name( const string &filename ) {
+
+  return has_suffix( filename , ".zst" );
+
+}
+
+// ***********************************************************************
+bool CompressedStreamBuf::have_zstd() {
+
+#ifdef SMG_USE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+
+}
+
+// ***********************************************************************
+bool CompressedStreamBuf::is_compressed_name( const string &filename ) {
+
+  return has_suffix( filename , ".gz" ) || has_suffix( filename , ".zst" );
+
+}
+
+// ***********************************************************************
+string CompressedStreamBuf::part_name( const string &filename ,
+				       const string &extra ) {
+
+  static const char *comp_suffs[] = { ".gz" , ".zst" };
+  for( int i = 0 ; i < 2 ; ++i ) {
+    string suff( comp_suffs[i] );
+    if( has_suffix( filename , suff ) ) {
+      return filename.substr( 0 , filename.length() - suff.length() )
+	+ extra + suff;
+    }
+  }
+  return filename + extra;
+
+}
+
+// ***********************************************************************
+CompressedStreamBuf::int_type CompressedStreamBuf::overflow( int_type c ) {
+
+  if( !writer_ ) {
+    return traits_type::eof();
+  }
+  hand_off_block();
+  if( !traits_type::eq_int_type( c , traits_type::eof() ) ) {
+    *pptr() = traits_type::to_char_type( c );
+    pbump( 1 );
+  }
+  return traits_type::not_eof( c );
+
+}
+
+// ***********************************************************************
+streamsize CompressedStreamBuf::xsputn( const char *s , streamsize n ) {
+
+  streamsize done = 0;
+  while( done < n ) {
+    streamsize room = epptr() - pptr();
+    if( !room ) {
+      if( traits_type::eq_int_type( overflow( traits_type::eof() ) ,
+				    traits_type::eof() ) ) {
+	break;
+      }
+      continue;
+    }
+    streamsize len = min( room , n - done );
+    memcpy( pptr() , s + done , len );
+    pbump( len );
+    done += len;
+  }
+  return done;
+
+}
+
+// ***********************************************************************
+// give the block being filled to the writer thread, once it's finished
+// with the other one, and start filling the other one.
+void CompressedStreamBuf::hand_off_block() {
+
+  size_t len = pptr() - pbase();
+  if( !len ) {
+    return;
+  }
+  wait_for_writer();
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    pending_ = pbase();
+    pending_len_ = len;
+  }
+  cond_.notify_all();
+  fill_block_ = 1 - fill_block_;
+  setp( &blocks_[fill_block_][0] , &blocks_[fill_block_][0] + BLOCK_SIZE );
+
+}
+
+// ***********************************************************************
+void CompressedStreamBuf::wait_for_writer() {
+
+  boost::mutex::scoped_lock lock( mutex_ );
+  while( pending_ ) {
+    cond_.wait( lock );
+  }
+
+}
+
+// ***********************************************************************
+// this runs in the writer thread
+void CompressedStreamBuf::write_blocks() {
+
+  boost::mutex::scoped_lock lock( mutex_ );
+  while( 1 ) {
+    while( !pending_ && !finished_ ) {
+      cond_.wait( lock );
+    }
+    if( !pending_ ) {
+      break;
+    }
+    const char *block = pending_;
+    size_t len = pending_len_;
+    bool ok = true;
+    lock.unlock();
+    // once there's been an error, there's no point writing more
+    if( error_.empty() ) {
+      ok = sink_->write( block , len );
+    }
+    lock.lock();
+    if( !ok ) {
+      error_ = string( "Error writing file " ) + filename_ +
+	", possibly out of disk space.";
+    }
+    pending_ = 0;
+    cond_.notify_all();
+  }
+
+}
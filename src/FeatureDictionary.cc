@@ -0,0 +1,181 @@
+//
+// file FeatureDictionary.cc
+// agent
+// 17th October 2026
+//
+// Implementation of FeatureDictionary
+
+#include "FeatureDictionary.H"
+#include "FileExceptions.H"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include <boost/bind.hpp>
+
+using namespace std;
+
+// in spiv_nogr_bits.cc
+string hash_feature_name( const string &fn );
+
+namespace {
+const unsigned int NOT_IN_VOCAB = numeric_limits<unsigned int>::max();
+// when fixed, the most keys not in the vocabulary that are remembered, so a
+// long-running smg -serve doesn't grow without limit. Beyond that, they're
+// looked up by label each time.
+const unsigned int MAX_UNSEEN_KEYS = 1 << 20;
+}
+
+// ***********************************************************************
+FeatureDictionary::FeatureDictionary( LabelFunc label_func ) :
+  label_func_( label_func ) , fixed_( false ) , num_unseen_keys_( 0 ) {
+
+}
+
+// ***********************************************************************
+void FeatureDictionary::add_molecule( const vector<boost::uint64_t> &keys ,
+				      vector<unsigned int> &ids ) {
+
+  ids.clear();
+  for( int i = 0 , is = keys.size() ; i < is ; ++i ) {
+    boost::unordered_map<boost::uint64_t,unsigned int>::iterator p =
+      key_ids_.find( keys[i] );
+    if( p == key_ids_.end() ) {
+      if( fixed_ ) {
+	boost::unordered_map<string,unsigned int>::iterator q =
+	  label_ids_.find( label_func_( keys[i] ) );
+	if( q != label_ids_.end() ) {
+	  p = key_ids_.insert( make_pair( keys[i] , q->second ) ).first;
+	} else if( num_unseen_keys_ < MAX_UNSEEN_KEYS ) {
+	  p = key_ids_.insert( make_pair( keys[i] , NOT_IN_VOCAB ) ).first;
+	  ++num_unseen_keys_;
+	} else {
+	  continue;
+	}
+      } else {
+	p = key_ids_.insert( make_pair( keys[i] , (unsigned int) labels_.size() ) ).first;
+	labels_.push_back( label_func_( keys[i] ) );
+	short_names_.push_back( hash_feature_name( labels_.back() ) );
+	counts_.push_back( 0 );
+      }
+    }
+    if( fixed_ ) {
+      if( NOT_IN_VOCAB != p->second ) {
+	ids.push_back( p->second );
+      }
+    } else {
+      ++counts_[p->second];
+      ids.push_back( p->second );
+    }
+  }
+  sort( ids.begin() , ids.end() );
+
+}
+
+// ***********************************************************************
+void FeatureDictionary::column_ids( int min_occur ,
+				    vector<unsigned int> &col_ids ) const {
+
+  col_ids.clear();
+  if( fixed_ ) {
+    for( unsigned int i = 0 , is = labels_.size() ; i < is ; ++i ) {
+      col_ids.push_back( i );
+    }
+    return;
+  }
+  for( unsigned int i = 0 , is = labels_.size() ; i < is ; ++i ) {
+    if( counts_[i] >= min_occur ) {
+      col_ids.push_back( i );
+    }
+  }
+  sort( col_ids.begin() , col_ids.end() ,
+	boost::bind( less<string>() ,
+		     boost::bind( &FeatureDictionary::label , this , _1 ) ,
+		     boost::bind( &FeatureDictionary::label , this , _2 ) ) );
+
+}
+
+// ***********************************************************************
+void FeatureDictionary::report_collisions( const vector<unsigned int> &ids ,
+					   char feat_label ) const {
+
+  vector<unsigned int> sorted_ids( ids );
+  sort( sorted_ids.begin() , sorted_ids.end() ,
+	boost::bind( less<string>() ,
+		     boost::bind( &FeatureDictionary::short_name , this , _1 ) ,
+		     boost::bind( &FeatureDictionary::short_name , this , _2 ) ) );
+  for( int i = 1 , is = sorted_ids.size() ; i < is ; ++i ) {
+    if( short_names_[sorted_ids[i]] == short_names_[sorted_ids[i-1]] ) {
+      cout << "AWOOGA Collision : " << labels_[sorted_ids[i]] << " and "
+	   << labels_[sorted_ids[i-1]] << " have the same short name "
+	   << feat_label << short_names_[sorted_ids[i]] << endl;
+    }
+  }
+
+}
+
+// ***********************************************************************
+void FeatureDictionary::read_vocab( const string &filename , char feat_label ) {
+
+  ifstream ifs( filename.c_str() );
+  if( !ifs ) {
+    throw DACLIB::FileReadOpenError( filename.c_str() );
+  }
+
+  string tag , file_label;
+  ifs >> tag >> file_label;
+  if( tag != "smg_vocab" ) {
+    throw( filename + string( " is not an smg vocabulary file." ) );
+  }
+  if( file_label != string( 1 , feat_label ) ) {
+    throw( filename + string( " is a vocabulary for " ) + file_label +
+	   string( " features, not " ) + feat_label + string( "." ) );
+  }
+
+  key_ids_.clear();
+  num_unseen_keys_ = 0;
+  label_ids_.clear();
+  labels_.clear();
+  short_names_.clear();
+  counts_.clear();
+  string short_name , label;
+  int count;
+  while( ifs >> short_name >> label >> count ) {
+    string hashed = hash_feature_name( label );
+    if( short_name != feat_label + hashed ) {
+      throw( filename + string( " has short name " ) + short_name +
+	     string( " for " ) + label + string( ", which should be " ) +
+	     feat_label + hashed + string( "." ) );
+    }
+    if( !label_ids_.insert( make_pair( label , (unsigned int) labels_.size() ) ).second ) {
+      throw( filename + string( " has " ) + label + string( " more than once." ) );
+    }
+    labels_.push_back( label );
+    short_names_.push_back( hashed );
+    counts_.push_back( count );
+  }
+  if( !ifs.eof() ) {
+    throw( filename + string( " has a bad line after feature " ) +
+	   ( labels_.empty() ? string( "none" ) : labels_.back() ) + "." );
+  }
+  fixed_ = true;
+
+}
+
+// ***********************************************************************
+void FeatureDictionary::write_vocab( const string &filename , char feat_label ,
+				     const vector<unsigned int> &col_ids ) const {
+
+  ofstream ofs( filename.c_str() );
+  if( !ofs ) {
+    throw DACLIB::FileWriteOpenError( filename.c_str() );
+  }
+  ofs << "smg_vocab " << feat_label << endl;
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    ofs << feat_label << short_names_[col_ids[i]] << " " << labels_[col_ids[i]]
+	<< " " << counts_[col_ids[i]] << "\n";
+  }
+
+}
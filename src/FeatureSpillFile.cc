@@ -0,0 +1,106 @@
+//
+// file FeatureSpillFile.cc
+// agent
+// 17th October 2026
+//
+// Implementation of FeatureSpillFile
+
+#include "FeatureSpillFile.H"
+#include "FileExceptions.H"
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+// ***********************************************************************
+FeatureSpillFile::FeatureSpillFile( const string &file_in_dir ) :
+  fp_( 0 ) , num_mols_( 0 ) {
+
+  filename_ = file_in_dir + ".spill.XXXXXX";
+  vector<char> tmpl( filename_.begin() , filename_.end() );
+  tmpl.push_back( '\0' );
+  int fd = mkstemp( &tmpl[0] );
+  if( -1 == fd ) {
+    throw DACLIB::FileWriteOpenError( filename_.c_str() );
+  }
+  filename_ = &tmpl[0];
+  fp_ = fdopen( fd , "w+b" );
+  if( !fp_ ) {
+    close( fd );
+    unlink( filename_.c_str() );
+    throw DACLIB::FileWriteOpenError( filename_.c_str() );
+  }
+  // nobody else needs to see it, and this way it's tidied up however the
+  // program finishes.
+  unlink( filename_.c_str() );
+  setvbuf( fp_ , 0 , _IOFBF , 1 << 20 );
+
+}
+
+// ***********************************************************************
+FeatureSpillFile::~FeatureSpillFile() {
+
+  if( fp_ ) {
+    fclose( fp_ );
+  }
+
+}
+
+// ***********************************************************************
+void FeatureSpillFile::write_molecule( const string &mol_name ,
+				       const vector<unsigned int> &feat_ids ) {
+
+  boost::uint32_t name_len = mol_name.length();
+  boost::uint32_t num_ids = feat_ids.size();
+  bool ok = 1 == fwrite( &name_len , sizeof( name_len ) , 1 , fp_ ) &&
+    name_len == fwrite( mol_name.data() , 1 , name_len , fp_ ) &&
+    1 == fwrite( &num_ids , sizeof( num_ids ) , 1 , fp_ );
+  if( ok && num_ids ) {
+    vector<boost::uint32_t> ids( feat_ids.begin() , feat_ids.end() );
+    ok = num_ids == fwrite( &ids[0] , sizeof( boost::uint32_t ) , num_ids , fp_ );
+  }
+  if( !ok ) {
+    throw( string( "Error writing temporary file " ) + filename_ +
+	   ", possibly out of disk space." );
+  }
+  ++num_mols_;
+
+}
+
+// ***********************************************************************
+void FeatureSpillFile::rewind() {
+
+  if( fflush( fp_ ) || fseek( fp_ , 0 , SEEK_SET ) ) {
+    throw( string( "Error rewinding temporary file " ) + filename_ + "." );
+  }
+
+}
+
+// ***********************************************************************
+bool FeatureSpillFile::read_molecule( string &mol_name ,
+				      vector<unsigned int> &feat_ids ) {
+
+  boost::uint32_t name_len;
+  if( 1 != fread( &name_len , sizeof( name_len ) , 1 , fp_ ) ) {
+    return false;
+  }
+  mol_name.resize( name_len );
+  boost::uint32_t num_ids = 0;
+  bool ok = ( !name_len || name_len == fread( &mol_name[0] , 1 , name_len , fp_ ) ) &&
+    1 == fread( &num_ids , sizeof( num_ids ) , 1 , fp_ );
+  if( ok && num_ids ) {
+    vector<boost::uint32_t> ids( num_ids );
+    ok = num_ids == fread( &ids[0] , sizeof( boost::uint32_t ) , num_ids , fp_ );
+    feat_ids.assign( ids.begin() , ids.end() );
+  } else {
+    feat_ids.clear();
+  }
+  if( !ok ) {
+    throw( string( "Error reading temporary file " ) + filename_ + "." );
+  }
+  return true;
+
+}
@@ -0,0 +1,263 @@
+//
+// file FingerprintGenerator.cc
+// agent
+// 17th October 2026
+//
+// Implementation of FingerprintGenerator
+
+#include "FingerprintGenerator.H"
+
+#include <algorithm>
+#include <exception>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread.hpp>
+
+#include "AtomTyper.H"
+#include "FeatureDictionary.H"
+#include "FileExceptions.H"
+#include "PharmPoint.H"
+#include "SMARTSExceptions.H"
+#include "SpivMolecule.H"
+
+using namespace OEChem;
+using namespace std;
+
+namespace DACLIB {
+  void read_smarts_file( const string &smarts_file ,
+			 vector<pair<string,string> > &input_smarts ,
+			 vector<pair<string,string> > &smarts_sub_defn );
+}
+
+// ***********************************************************************
+// the DACLIB exceptions are all turned into strings, as their type info
+// isn't exported from a shared libsmg, so a program using it might not be
+// able to catch them.
+FingerprintGenerator::FingerprintGenerator( const string &smarts_file ,
+					    const string &points_file ,
+					    SMG_OUTPUT_TYPE output_type ,
+					    int min_dist , int max_dist ,
+					    unsigned int fold_bits ) :
+  pharm_points_( new PharmPoint ) {
+
+  if( max_dist < 0 || max_dist >= SPIV_MAX_DIST ) {
+    throw( string( "max_dist must be from 0 to " )
+	   + boost::lexical_cast<string>( SPIV_MAX_DIST - 1 ) + "." );
+  }
+  try {
+    DACLIB::read_smarts_file( smarts_file , input_smarts_ , smarts_sub_defn_ );
+    pharm_points_->read_points_file( points_file );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    throw( string( e.what() ) );
+  } catch( DACLIB::SMARTSSubDefnError &e ) {
+    throw( string( e.what() ) );
+  } catch( DACLIB::SMARTSFileError &e ) {
+    throw( string( e.what() ) );
+  }
+
+  feat_opts_.output_type_ = output_type;
+  feat_opts_.min_dist_ = min_dist;
+  feat_opts_.max_dist_ = max_dist;
+  feat_opts_.fold_bits_ = fold_bits;
+  feat_opts_.num_hashes_ = 0;
+  point_type_names( *pharm_points_ , feat_opts_.type_names_ );
+
+  // make one AtomTyper now, so bad SMARTS come out here rather than in the
+  // first generate().
+  return_typer( borrow_typer() );
+
+}
+
+// ***********************************************************************
+FingerprintGenerator::~FingerprintGenerator() {
+
+  for( int i = 0 , is = all_typers_.size() ; i < is ; ++i ) {
+    delete all_typers_[i];
+  }
+
+}
+
+// ***********************************************************************
+void FingerprintGenerator::generate( OEMolBase &mol , SMG_FINGERPRINT &fp ) {
+
+  fp.features_.clear();
+  // process_molecule picks the AtomTyper out of a vector by thread number
+  vector<AtomTyper *> typers( 1 , borrow_typer() );
+  try {
+    process_molecule( mol , fp.mol_name_ , fp.features_ , 0 , *pharm_points_ ,
+		      typers , feat_opts_ );
+  } catch( ... ) {
+    return_typer( typers.front() );
+    throw;
+  }
+  return_typer( typers.front() );
+
+}
+
+// ***********************************************************************
+void FingerprintGenerator::generate( const vector<OEMolBase *> &mols ,
+				     int num_threads ,
+				     SMG_CSR_FINGERPRINTS &fps ) {
+
+  vector<SMG_FINGERPRINT> mol_fps( mols.size() );
+  vector<string> errors( mols.size() );
+  size_t next_mol = 0;
+  boost::mutex next_mutex;
+  if( num_threads < 2 ) {
+    generate_batch( mols , next_mol , next_mutex , mol_fps , errors );
+  } else {
+    boost::thread_group threads;
+    for( int i = 0 ; i < num_threads ; ++i ) {
+      threads.create_thread( boost::bind( &FingerprintGenerator::generate_batch ,
+					  this , boost::cref( mols ) ,
+					  boost::ref( next_mol ) ,
+					  boost::ref( next_mutex ) ,
+					  boost::ref( mol_fps ) ,
+					  boost::ref( errors ) ) );
+    }
+    threads.join_all();
+  }
+
+  for( int i = 0 , is = errors.size() ; i < is ; ++i ) {
+    if( !errors[i].empty() ) {
+      throw( errors[i] );
+    }
+  }
+
+  fps.mol_names_.clear();
+  fps.indptr_.clear();
+  fps.indices_.clear();
+  fps.indptr_.push_back( 0 );
+  for( int i = 0 , is = mol_fps.size() ; i < is ; ++i ) {
+    fps.mol_names_.push_back( mol_fps[i].mol_name_ );
+    fps.indices_.insert( fps.indices_.end() , mol_fps[i].features_.begin() ,
+			 mol_fps[i].features_.end() );
+    fps.indptr_.push_back( fps.indices_.size() );
+  }
+
+}
+
+// ***********************************************************************
+string FingerprintGenerator::label( boost::uint64_t feature ) const {
+
+  if( feat_opts_.fold_bits_ ) {
+    return string( "F" ) + boost::lexical_cast<string>( feature );
+  }
+  return feature_key_label( feature , feat_opts_.output_type_ ,
+			    feat_opts_.type_names_ );
+
+}
+
+// ***********************************************************************
+// the keys are put through a FeatureDictionary, as smg does, so the columns
+// are numbered the same way as smg's output for the same molecules.
+void FingerprintGenerator::columns( const SMG_CSR_FINGERPRINTS &fps ,
+				    vector<boost::int32_t> &col_indices ,
+				    vector<string> &col_labels ) const {
+
+  col_indices.clear();
+  col_labels.clear();
+  if( feat_opts_.fold_bits_ ) {
+    col_indices.insert( col_indices.end() , fps.indices_.begin() ,
+			fps.indices_.end() );
+    for( unsigned int i = 0 ; i < feat_opts_.fold_bits_ ; ++i ) {
+      col_labels.push_back( label( i ) );
+    }
+    return;
+  }
+
+  FeatureDictionary feat_dict( boost::bind( &feature_key_label , _1 ,
+					    feat_opts_.output_type_ ,
+					    feat_opts_.type_names_ ) );
+  vector<boost::uint64_t> keys;
+  vector<unsigned int> ids;
+  for( int i = 0 , is = fps.mol_names_.size() ; i < is ; ++i ) {
+    keys.assign( fps.indices_.begin() + fps.indptr_[i] ,
+		 fps.indices_.begin() + fps.indptr_[i + 1] );
+    feat_dict.add_molecule( keys , ids );
+    col_indices.insert( col_indices.end() , ids.begin() , ids.end() );
+  }
+
+  vector<unsigned int> col_ids;
+  feat_dict.column_ids( 0 , col_ids );
+  vector<boost::int32_t> id_cols( col_ids.size() );
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    id_cols[col_ids[i]] = i;
+    col_labels.push_back( feat_dict.label( col_ids[i] ) );
+  }
+  for( int i = 0 , is = fps.mol_names_.size() ; i < is ; ++i ) {
+    vector<boost::int32_t>::iterator row_start = col_indices.begin() + fps.indptr_[i];
+    vector<boost::int32_t>::iterator row_end = col_indices.begin() + fps.indptr_[i + 1];
+    for( vector<boost::int32_t>::iterator p = row_start ; p != row_end ; ++p ) {
+      *p = id_cols[*p];
+    }
+    sort( row_start , row_end );
+  }
+
+}
+
+// ***********************************************************************
+// a new AtomTyper is made outside the lock, so other threads aren't held up
+// while its SMARTS are compiled.
+AtomTyper *FingerprintGenerator::borrow_typer() {
+
+  {
+    boost::mutex::scoped_lock lock( typer_mutex_ );
+    if( !free_typers_.empty() ) {
+      AtomTyper *typer = free_typers_.back();
+      free_typers_.pop_back();
+      return typer;
+    }
+  }
+
+  AtomTyper *typer = new AtomTyper( input_smarts_ , smarts_sub_defn_ );
+  boost::mutex::scoped_lock lock( typer_mutex_ );
+  all_typers_.push_back( typer );
+  return typer;
+
+}
+
+// ***********************************************************************
+void FingerprintGenerator::return_typer( AtomTyper *typer ) {
+
+  boost::mutex::scoped_lock lock( typer_mutex_ );
+  free_typers_.push_back( typer );
+
+}
+
+// ***********************************************************************
+void FingerprintGenerator::generate_batch( const vector<OEMolBase *> &mols ,
+					   size_t &next_mol ,
+					   boost::mutex &next_mutex ,
+					   vector<SMG_FINGERPRINT> &fps ,
+					   vector<string> &errors ) {
+
+  while( 1 ) {
+    size_t mol_num;
+    {
+      boost::mutex::scoped_lock lock( next_mutex );
+      if( next_mol == mols.size() ) {
+	return;
+      }
+      mol_num = next_mol++;
+    }
+    // nothing can be let out, as in its own thread it would take the whole
+    // program down.
+    bool failed = true;
+    try {
+      generate( *mols[mol_num] , fps[mol_num] );
+      failed = false;
+    } catch( string &msg ) {
+      errors[mol_num] = msg;
+    } catch( std::exception &e ) {
+      errors[mol_num] = e.what();
+    } catch( ... ) {
+    }
+    if( failed && errors[mol_num].empty() ) {
+      errors[mol_num] = "Unknown error processing molecule.";
+    }
+  }
+
+}
@@ -0,0 +1,357 @@
+//
+// file FingerprintStore.cc
+// agent
+// 17th October 2026
+//
+// Implementation of FingerprintStore
+
+#include "FingerprintStore.H"
+#include "BinaryBitsFile.H"
+#include "popcount_kernels.H"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+namespace {
+
+// rows in a tile for neighbour_pairs. Two tiles of 1024-bit rows are 32KB.
+const unsigned int TILE_ROWS = 128;
+
+// ***********************************************************************
+// better hits have higher Tanimoto, then lower row number
+bool hit_is_better( const FP_SEARCH_HIT &a , const FP_SEARCH_HIT &b ) {
+
+  if( a.tanimoto_ != b.tanimoto_ ) {
+    return a.tanimoto_ > b.tanimoto_;
+  }
+  return a.row_ < b.row_;
+
+}
+
+// ***********************************************************************
+// the highest Tanimoto possible between fingerprints with a and b bits set
+double tanimoto_bound( unsigned int a , unsigned int b ) {
+
+  if( a > b ) {
+    swap( a , b );
+  }
+  return b ? double( a ) / double( b ) : 0.0;
+
+}
+
+// ***********************************************************************
+void append_pairs( const vector<FP_NEIGHBOUR_PAIR> &new_pairs ,
+		   vector<FP_NEIGHBOUR_PAIR> *pairs ) {
+
+  pairs->insert( pairs->end() , new_pairs.begin() , new_pairs.end() );
+
+}
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+FingerprintStore::FingerprintStore( const BinaryBitsFile &bits_file ,
+				    int num_threads ) :
+  num_cols_( bits_file.num_cols() ) ,
+  words_per_row_( bits_file.words_per_row() ) , file_rows_( 0 ) ,
+  num_threads_( num_threads < 1 ? 1 : num_threads ) , search_num_( 0 ) ,
+  num_searching_( 0 ) , stopping_( false ) , query_( 0 ) , query_count_( 0 ) ,
+  top_k_( 0 ) , threshold_( 0.0 ) , thread_hits_( num_threads_ ) {
+
+  unsigned int num_rows = bits_file.num_rows();
+  if( num_rows ) {
+    file_rows_ = bits_file.row( 0 );
+  }
+
+  // count sort the rows on the number of bits set, keeping them in file
+  // order within each count.
+  vector<unsigned int> file_counts( num_rows );
+  count_starts_.resize( num_cols_ + 2 , 0 );
+  for( unsigned int i = 0 ; i < num_rows ; ++i ) {
+    file_counts[i] = popcount_words( bits_file.row( i ) , words_per_row_ );
+    ++count_starts_[file_counts[i] + 1];
+  }
+  for( unsigned int c = 1 ; c < count_starts_.size() ; ++c ) {
+    count_starts_[c] += count_starts_[c - 1];
+  }
+
+  orig_rows_.resize( num_rows );
+  counts_.resize( num_rows );
+  vector<unsigned int> next_row( count_starts_.begin() , count_starts_.end() - 1 );
+  for( unsigned int i = 0 ; i < num_rows ; ++i ) {
+    unsigned int r = next_row[file_counts[i]]++;
+    orig_rows_[r] = i;
+    counts_[r] = file_counts[i];
+  }
+
+  for( int i = 1 ; i < num_threads_ ; ++i ) {
+    search_threads_.create_thread( boost::bind( &FingerprintStore::search_thread ,
+						this , i ) );
+  }
+
+}
+
+// ***********************************************************************
+FingerprintStore::~FingerprintStore() {
+
+  {
+    boost::lock_guard<boost::mutex> lock( search_mutex_ );
+    stopping_ = true;
+  }
+  work_ready_.notify_all();
+  search_threads_.join_all();
+
+}
+
+// ***********************************************************************
+void FingerprintStore::make_query( vector<boost::uint64_t> &query ) const {
+
+  query.assign( words_per_row_ , 0 );
+
+}
+
+// ***********************************************************************
+void FingerprintStore::search( const vector<boost::uint64_t> &query ,
+			       double threshold , unsigned int top_k ,
+			       vector<FP_SEARCH_HIT> &hits ) {
+
+  hits.clear();
+  if( query.size() != words_per_row_ ) {
+    throw( string( "Query fingerprint is the wrong size for the search." ) );
+  }
+  unsigned int query_count = popcount_words( query.empty() ? 0 : &query[0] ,
+					     words_per_row_ );
+
+  if( num_threads_ > 1 ) {
+    boost::lock_guard<boost::mutex> lock( search_mutex_ );
+    query_ = query.empty() ? 0 : &query[0];
+    query_count_ = query_count;
+    threshold_ = threshold;
+    top_k_ = top_k;
+    num_searching_ = num_threads_ - 1;
+    ++search_num_;
+  }
+  work_ready_.notify_all();
+
+  search_rows( query.empty() ? 0 : &query[0] , query_count , threshold ,
+	       top_k , 0 , &hits );
+
+  if( num_threads_ > 1 ) {
+    boost::unique_lock<boost::mutex> lock( search_mutex_ );
+    while( num_searching_ ) {
+      work_done_.wait( lock );
+    }
+    for( int i = 1 ; i < num_threads_ ; ++i ) {
+      hits.insert( hits.end() , thread_hits_[i].begin() , thread_hits_[i].end() );
+    }
+  }
+
+  sort( hits.begin() , hits.end() , hit_is_better );
+  if( top_k && hits.size() > top_k ) {
+    hits.resize( top_k );
+  }
+
+}
+
+// ***********************************************************************
+// runs in its own thread, doing its share of each search as it comes.
+void FingerprintStore::search_thread( int thread_num ) {
+
+  unsigned int last_search = 0;
+  while( 1 ) {
+    {
+      boost::unique_lock<boost::mutex> lock( search_mutex_ );
+      while( !stopping_ && search_num_ == last_search ) {
+	work_ready_.wait( lock );
+      }
+      if( stopping_ ) {
+	return;
+      }
+      last_search = search_num_;
+    }
+    thread_hits_[thread_num].clear();
+    search_rows( query_ , query_count_ , threshold_ , top_k_ , thread_num ,
+		 &thread_hits_[thread_num] );
+    {
+      boost::lock_guard<boost::mutex> lock( search_mutex_ );
+      --num_searching_;
+    }
+    work_done_.notify_one();
+  }
+
+}
+
+// ***********************************************************************
+// Work out from the rows with the same count as the query, in order of
+// decreasing bound, and stop when the bound drops below the threshold or,
+// once there are top_k hits, the worst of them. Each count's rows are split
+// between the threads, so they all have a fair share of the ones that need
+// looking at.
+void FingerprintStore::search_rows( const boost::uint64_t *query ,
+				    unsigned int query_count , double threshold ,
+				    unsigned int top_k , int thread_num ,
+				    vector<FP_SEARCH_HIT> *hits ) const {
+
+  AndPopcountFunc and_popcount = and_popcount_kernel();
+  // with top_k, hits is a heap with the worst hit at the front
+  int up = query_count , down = int( query_count ) - 1;
+  while( 1 ) {
+    double up_bound = up <= int( num_cols_ ) ? tanimoto_bound( query_count , up ) : -1.0;
+    double down_bound = down >= 0 ? tanimoto_bound( query_count , down ) : -1.0;
+    int count;
+    double bound;
+    if( up_bound >= down_bound ) {
+      count = up++;
+      bound = up_bound;
+    } else {
+      count = down--;
+      bound = down_bound;
+    }
+    if( bound < 0.0 || bound < threshold ||
+	( top_k && hits->size() == top_k && bound < hits->front().tanimoto_ ) ) {
+      break;
+    }
+
+    unsigned int count_rows = count_starts_[count + 1] - count_starts_[count];
+    unsigned int first_row = count_starts_[count] +
+      boost::uint64_t( count_rows ) * thread_num / num_threads_;
+    unsigned int last_row = count_starts_[count] +
+      boost::uint64_t( count_rows ) * ( thread_num + 1 ) / num_threads_;
+    for( unsigned int r = first_row ; r < last_row ; ++r ) {
+      unsigned int common = and_popcount( query , row( r ) , words_per_row_ );
+      unsigned int either = query_count + count - common;
+      FP_SEARCH_HIT hit;
+      hit.row_ = orig_rows_[r];
+      hit.tanimoto_ = either ? double( common ) / double( either ) : 0.0;
+      if( hit.tanimoto_ < threshold ) {
+	continue;
+      }
+      if( !top_k ) {
+	hits->push_back( hit );
+      } else if( hits->size() < top_k ) {
+	hits->push_back( hit );
+	push_heap( hits->begin() , hits->end() , hit_is_better );
+      } else if( hit_is_better( hit , hits->front() ) ) {
+	pop_heap( hits->begin() , hits->end() , hit_is_better );
+	hits->back() = hit;
+	push_heap( hits->begin() , hits->end() , hit_is_better );
+      }
+    }
+  }
+
+}
+
+// ***********************************************************************
+void FingerprintStore::neighbour_pairs( double threshold ,
+					vector<FP_NEIGHBOUR_PAIR> &pairs ) const {
+
+  pairs.clear();
+  neighbour_pairs( threshold , boost::bind( &append_pairs , _1 , &pairs ) );
+
+}
+
+// ***********************************************************************
+void FingerprintStore::neighbour_pairs( double threshold ,
+					FPPairsFunc pairs_func ) const {
+
+  if( threshold <= 0.0 ) {
+    throw( string( "The threshold for neighbour pairs must be more than 0." ) );
+  }
+
+  unsigned int next_tile = 0;
+  boost::mutex tile_mutex , pairs_mutex;
+  if( num_threads_ < 2 ) {
+    tile_neighbour_pairs( threshold , &next_tile , &tile_mutex , pairs_func ,
+			  &pairs_mutex );
+  } else {
+    boost::thread_group threads;
+    for( int i = 0 ; i < num_threads_ ; ++i ) {
+      threads.create_thread( boost::bind( &FingerprintStore::tile_neighbour_pairs ,
+					  this , threshold , &next_tile ,
+					  &tile_mutex , pairs_func ,
+					  &pairs_mutex ) );
+    }
+    threads.join_all();
+  }
+
+}
+
+// ***********************************************************************
+// As the rows are in count order, the rows after row i that it could be
+// similar enough to are the ones up to the count where the bound drops
+// below the threshold. For a tile of rows, those are all in the tiles up
+// to the one that has that count for the tile's last row, and each row of
+// the tile stops early in the last of them.
+void FingerprintStore::tile_neighbour_pairs( double threshold ,
+					     unsigned int *next_tile ,
+					     boost::mutex *tile_mutex ,
+					     FPPairsFunc pairs_func ,
+					     boost::mutex *pairs_mutex ) const {
+
+  AndPopcountFunc and_popcount = and_popcount_kernel();
+  unsigned int num_rows = orig_rows_.size();
+  vector<FP_NEIGHBOUR_PAIR> pairs;
+  while( 1 ) {
+    unsigned int tile_start;
+    {
+      boost::mutex::scoped_lock lock( *tile_mutex );
+      tile_start = *next_tile;
+      if( tile_start >= num_rows ) {
+	break;
+      }
+      *next_tile += TILE_ROWS;
+    }
+    unsigned int tile_end = min( num_rows , tile_start + TILE_ROWS );
+
+    // the end of the rows any of the tile could pair with, with 1 to spare
+    // in case of rounding, as the bound is checked for each pair anyway.
+    unsigned int max_count = min( num_cols_ ,
+				  (unsigned int)( counts_[tile_end - 1] / threshold ) + 1 );
+    unsigned int last_row = count_starts_[max_count + 1];
+
+    // and the highest count each row of the tile could pair with
+    unsigned int max_counts[TILE_ROWS];
+    for( unsigned int i = tile_start ; i < tile_end ; ++i ) {
+      unsigned int mc = min( num_cols_ ,
+			     (unsigned int)( counts_[i] / threshold ) + 1 );
+      while( mc > counts_[i] && tanimoto_bound( counts_[i] , mc ) < threshold ) {
+	--mc;
+      }
+      max_counts[i - tile_start] = mc;
+    }
+
+    for( unsigned int j_start = tile_start ; j_start < last_row ;
+	 j_start += TILE_ROWS ) {
+      unsigned int j_end = min( last_row , j_start + TILE_ROWS );
+      for( unsigned int i = tile_start ; i < tile_end ; ++i ) {
+	const boost::uint64_t *row_i = row( i );
+	unsigned int max_count_i = max_counts[i - tile_start];
+	for( unsigned int j = max( i + 1 , j_start ) ; j < j_end ; ++j ) {
+	  if( counts_[j] > max_count_i ) {
+	    break;
+	  }
+	  unsigned int common = and_popcount( row_i , row( j ) , words_per_row_ );
+	  unsigned int either = counts_[i] + counts_[j] - common;
+	  double tanimoto = either ? double( common ) / double( either ) : 0.0;
+	  if( tanimoto >= threshold ) {
+	    FP_NEIGHBOUR_PAIR pair;
+	    pair.row1_ = min( orig_rows_[i] , orig_rows_[j] );
+	    pair.row2_ = max( orig_rows_[i] , orig_rows_[j] );
+	    pair.tanimoto_ = tanimoto;
+	    pairs.push_back( pair );
+	  }
+	}
+      }
+    }
+    if( !pairs.empty() ) {
+      boost::mutex::scoped_lock lock( *pairs_mutex );
+      pairs_func( pairs );
+    }
+    pairs.clear();
+  }
+
+}
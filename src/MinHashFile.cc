@@ -0,0 +1,199 @@
+//
+// file MinHashFile.cc
+// agent
+// 17th October 2026
+//
+// Implementation of MinHashFile and MinHashWriter
+
+#include "MinHashFile.H"
+#include "BinaryBitsFile.H"
+#include "FileExceptions.H"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// ***********************************************************************
+MinHashFile::MinHashFile( const string &filename ) :
+  filename_( filename ) , map_( 0 ) , map_size_( 0 ) , header_( 0 ) ,
+  rows_( 0 ) , titles_( 0 ) , title_offsets_( 0 ) {
+
+  int fd = open( filename_.c_str() , O_RDONLY );
+  if( -1 == fd ) {
+    throw DACLIB::FileReadOpenError( filename_.c_str() );
+  }
+  struct stat st;
+  if( fstat( fd , &st ) ) {
+    close( fd );
+    throw DACLIB::FileReadOpenError( filename_.c_str() );
+  }
+  map_size_ = st.st_size;
+  if( map_size_ < sizeof( MINHASH_HEADER ) ) {
+    close( fd );
+    throw( filename_ + string( " is too small to be a MinHash file." ) );
+  }
+  map_ = mmap( 0 , map_size_ , PROT_READ , MAP_SHARED , fd , 0 );
+  close( fd );
+  if( MAP_FAILED == map_ ) {
+    map_ = 0;
+    throw DACLIB::FileReadOpenError( filename_.c_str() );
+  }
+
+  try {
+    check_header();
+  } catch( string & ) {
+    munmap( map_ , map_size_ );
+    map_ = 0;
+    throw;
+  }
+
+}
+
+// ***********************************************************************
+MinHashFile::~MinHashFile() {
+
+  if( map_ ) {
+    munmap( map_ , map_size_ );
+  }
+
+}
+
+// ***********************************************************************
+string MinHashFile::title( unsigned int row_num ) const {
+
+  return string( titles_ + title_offsets_[row_num] ,
+		 title_offsets_[row_num + 1] - title_offsets_[row_num] );
+
+}
+
+// ***********************************************************************
+void MinHashFile::check_header() {
+
+  const char *base = static_cast<const char *>( map_ );
+  header_ = reinterpret_cast<const MINHASH_HEADER *>( base );
+  if( memcmp( header_->magic_ , MINHASH_MAGIC , 8 ) ) {
+    throw( filename_ + string( " is not a MinHash file." ) );
+  }
+  if( BINARY_BITS_BYTE_ORDER != header_->byte_order_ ) {
+    throw( filename_ + string( " was written on a machine with a different byte order." ) );
+  }
+
+  const MINHASH_HEADER &h = *header_;
+  if( h.rows_offset_ + h.num_rows_ * h.num_hashes_ * sizeof( boost::uint32_t ) > map_size_ ||
+      h.titles_offset_ + h.titles_size_ > map_size_ ||
+      h.title_offsets_offset_ + ( h.num_rows_ + 1 ) * sizeof( boost::uint64_t ) > map_size_ ) {
+    throw( filename_ + string( " is corrupt or truncated." ) );
+  }
+
+  rows_ = reinterpret_cast<const boost::uint32_t *>( base + h.rows_offset_ );
+  titles_ = base + h.titles_offset_;
+  title_offsets_ = reinterpret_cast<const boost::uint64_t *>( base + h.title_offsets_offset_ );
+  if( title_offsets_[h.num_rows_] != h.titles_size_ ) {
+    throw( filename_ + string( " is corrupt or truncated." ) );
+  }
+
+}
+
+// ***********************************************************************
+MinHashWriter::MinHashWriter( const string &filename ,
+			      unsigned int num_hashes ) :
+  filename_( filename ) , titles_tmp_( 0 ) , offsets_tmp_( 0 ) {
+
+  ofs_.open( filename_.c_str() , ios::out | ios::binary );
+  if( !ofs_ ) {
+    throw DACLIB::FileWriteOpenError( filename_.c_str() );
+  }
+  titles_tmp_ = open_binary_tmp_file( filename_ , ".titles" );
+  try {
+    offsets_tmp_ = open_binary_tmp_file( filename_ , ".offsets" );
+  } catch( DACLIB::FileWriteOpenError & ) {
+    fclose( titles_tmp_ );
+    throw;
+  }
+
+  memset( &header_ , 0 , sizeof( header_ ) );
+  memcpy( header_.magic_ , MINHASH_MAGIC , 8 );
+  header_.byte_order_ = BINARY_BITS_BYTE_ORDER;
+  header_.num_hashes_ = num_hashes;
+  ofs_.write( reinterpret_cast<const char *>( &header_ ) , sizeof( header_ ) );
+  align();
+  header_.rows_offset_ = ofs_.tellp();
+
+  boost::uint64_t zero = 0;
+  fwrite( &zero , sizeof( zero ) , 1 , offsets_tmp_ );
+
+}
+
+// ***********************************************************************
+MinHashWriter::~MinHashWriter() {
+
+  try {
+    close();
+  } catch( string &msg ) {
+    // can't throw from a destructor, so this is all we can do.
+    cerr << msg << endl;
+  }
+  if( titles_tmp_ ) {
+    fclose( titles_tmp_ );
+  }
+  if( offsets_tmp_ ) {
+    fclose( offsets_tmp_ );
+  }
+
+}
+
+// ***********************************************************************
+void MinHashWriter::add_row( const string &title ,
+			     const vector<boost::uint32_t> &signature ) {
+
+  if( !signature.empty() ) {
+    ofs_.write( reinterpret_cast<const char *>( &signature[0] ) ,
+		signature.size() * sizeof( boost::uint32_t ) );
+  }
+  fwrite( title.data() , 1 , title.length() , titles_tmp_ );
+  header_.titles_size_ += title.length();
+  fwrite( &header_.titles_size_ , sizeof( header_.titles_size_ ) , 1 ,
+	  offsets_tmp_ );
+  ++header_.num_rows_;
+
+}
+
+// ***********************************************************************
+void MinHashWriter::close() {
+
+  if( !ofs_.is_open() ) {
+    return;
+  }
+
+  header_.titles_offset_ = ofs_.tellp();
+  bool ok = append_binary_tmp_file( titles_tmp_ , ofs_ );
+  align();
+  header_.title_offsets_offset_ = ofs_.tellp();
+  ok = append_binary_tmp_file( offsets_tmp_ , ofs_ ) && ok;
+
+  ofs_.seekp( 0 );
+  ofs_.write( reinterpret_cast<const char *>( &header_ ) , sizeof( header_ ) );
+  ok = ofs_.good() && ok;
+  ofs_.close();
+  if( !ok || ofs_.fail() ) {
+    throw( string( "Error writing file " ) + filename_ +
+	   ", possibly out of disk space." );
+  }
+
+}
+
+// ***********************************************************************
+// pad the file out to the next 8-byte boundary
+void MinHashWriter::align() {
+
+  static const char zeros[8] = { 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 };
+  boost::uint64_t pos = ofs_.tellp();
+  ofs_.write( zeros , binary_bits_align( pos ) - pos );
+
+}
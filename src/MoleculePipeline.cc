@@ -0,0 +1,219 @@
+//
+// file MoleculePipeline.cc
+// agent
+// 17th October 2026
+//
+// Implementation of MoleculePipeline
+
+#include "MoleculePipeline.H"
+#include "SmgProfile.H"
+
+#include <boost/bind.hpp>
+
+using namespace std;
+using namespace OEChem;
+
+// ***********************************************************************
+MoleculePipeline::MoleculePipeline( oemolistream &ims , int num_threads ,
+				    WorkFunc work_func , SmgProfile *profile ) :
+  ims_( ims ) , num_threads_( num_threads < 1 ? 1 : num_threads ) ,
+  work_func_( work_func ) , profile_( profile ) , num_read_( 0 ) , num_returned_( 0 ) ,
+  reader_finished_( false ) , stopping_( false ) {
+
+  // enough molecules in flight that the workers don't run dry while a
+  // slow one is holding up the output, without reading the whole file in.
+  max_in_flight_ = 256 * num_threads_;
+
+  if( num_threads_ > 1 ) {
+    threads_.create_thread( boost::bind( &MoleculePipeline::read_molecules ,
+					 this ) );
+    for( int i = 0 ; i < num_threads_ ; ++i ) {
+      threads_.create_thread( boost::bind( &MoleculePipeline::do_work ,
+					   this , i ) );
+    }
+  }
+
+}
+
+// ***********************************************************************
+MoleculePipeline::~MoleculePipeline() {
+
+  {
+    boost::lock_guard<boost::mutex> lock( mutex_ );
+    stopping_ = true;
+  }
+  job_ready_.notify_all();
+  slot_free_.notify_all();
+  threads_.join_all();
+
+  for( int i = 0 , is = queued_jobs_.size() ; i < is ; ++i ) {
+    delete queued_jobs_[i]->mol_;
+    delete queued_jobs_[i];
+  }
+  map<unsigned int,SMG_JOB *>::iterator p , ps;
+  for( p = done_jobs_.begin() , ps = done_jobs_.end() ; p != ps ; ++p ) {
+    delete p->second->mol_;
+    delete p->second;
+  }
+
+}
+
+// ***********************************************************************
+bool MoleculePipeline::next_result( string &mol_name ,
+				    vector<boost::uint64_t> &feat_keys ) {
+
+  mol_name.clear();
+  feat_keys.clear();
+
+  if( 1 == num_threads_ ) {
+    OEMol oemol;
+    if( !read_molecule( oemol ) ) {
+      return false;
+    }
+    work_func_( oemol , mol_name , feat_keys , 0 );
+    ++num_read_;
+    ++num_returned_;
+    return true;
+  }
+
+  SMG_JOB *job = 0;
+  {
+    boost::unique_lock<boost::mutex> lock( mutex_ );
+    map<unsigned int,SMG_JOB *>::iterator p;
+    while( 1 ) {
+      p = done_jobs_.find( num_returned_ );
+      if( p != done_jobs_.end() ) {
+	break;
+      }
+      if( reader_finished_ && num_returned_ == num_read_ ) {
+	return false;
+      }
+      job_done_.wait( lock );
+    }
+    job = p->second;
+    done_jobs_.erase( p );
+    ++num_returned_;
+  }
+  slot_free_.notify_one();
+
+  string error;
+  mol_name.swap( job->mol_name_ );
+  feat_keys.swap( job->feat_keys_ );
+  error.swap( job->error_ );
+  delete job->mol_;
+  delete job;
+
+  if( !error.empty() ) {
+    throw( error );
+  }
+
+  return true;
+
+}
+
+// ***********************************************************************
+// runs in its own thread, putting molecules on the queue as long as there's
+// room in the window.
+void MoleculePipeline::read_molecules() {
+
+  while( 1 ) {
+    {
+      boost::unique_lock<boost::mutex> lock( mutex_ );
+      while( !stopping_ && num_read_ - num_returned_ >= max_in_flight_ ) {
+	slot_free_.wait( lock );
+      }
+      if( stopping_ ) {
+	break;
+      }
+    }
+
+    OEMol *oemol = new OEMol;
+    if( !read_molecule( *oemol ) ) {
+      delete oemol;
+      break;
+    }
+
+    SMG_JOB *job = new SMG_JOB;
+    job->mol_ = oemol;
+    {
+      boost::lock_guard<boost::mutex> lock( mutex_ );
+      job->seq_ = num_read_++;
+      queued_jobs_.push_back( job );
+    }
+    job_ready_.notify_one();
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock( mutex_ );
+    reader_finished_ = true;
+  }
+  job_ready_.notify_all();
+  job_done_.notify_all();
+
+}
+
+// ***********************************************************************
+// runs in each worker thread, taking the next molecule off the queue until
+// there aren't any more.
+void MoleculePipeline::do_work( int thread_num ) {
+
+  while( 1 ) {
+    SMG_JOB *job = 0;
+    {
+      boost::unique_lock<boost::mutex> lock( mutex_ );
+      while( !stopping_ && queued_jobs_.empty() && !reader_finished_ ) {
+	job_ready_.wait( lock );
+      }
+      if( stopping_ || queued_jobs_.empty() ) {
+	break;
+      }
+      job = queued_jobs_.front();
+      queued_jobs_.pop_front();
+    }
+
+    run_job( *job , thread_num );
+
+    {
+      boost::lock_guard<boost::mutex> lock( mutex_ );
+      done_jobs_.insert( make_pair( job->seq_ , job ) );
+    }
+    job_done_.notify_all();
+  }
+
+}
+
+// ***********************************************************************
+// the error is passed back to the main thread rather than dealt with here,
+// so that it's reported for the first failing molecule in input order, as
+// it would be running serially.
+void MoleculePipeline::run_job( SMG_JOB &job , int thread_num ) {
+
+  try {
+    work_func_( *job.mol_ , job.mol_name_ , job.feat_keys_ , thread_num );
+  } catch( string &msg ) {
+    job.error_ = msg;
+    if( job.error_.empty() ) {
+      job.error_ = "Unknown error processing molecule.";
+    }
+  }
+  // finished with the molecule, so don't hold onto it while the job waits
+  // for its turn to be output.
+  delete job.mol_;
+  job.mol_ = 0;
+
+}
+
+// ***********************************************************************
+// only ever called from one thread at a time, so the profile slot is safe.
+bool MoleculePipeline::read_molecule( OEMol &oemol ) {
+
+  boost::uint64_t start = profile_ ? profile_nsecs() : 0;
+  if( !( ims_ >> oemol ) ) {
+    return false;
+  }
+  if( profile_ ) {
+    profile_->time_stage( num_threads_ , PROF_READ , start );
+  }
+  return true;
+
+}
@@ -0,0 +1,488 @@
+//
+// file SMARTSSignature.cc
+// agent
+// 17th October 2026
+//
+// Implementation of SMARTSSignature
+
+#include "SMARTSSignature.H"
+#include "smarts_atom_expr.H"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace OEChem;
+
+// what's known about a SMARTS primitive or expression - the classes of atom
+// that it might match, and the ones it definitely matches.
+typedef struct {
+  SIG_CLASSES may_ , must_;
+} SIG_PRIM;
+
+// ***********************************************************************
+SIG_CLASSES sig_classes( boost::uint64_t b0 , boost::uint64_t b1 ) {
+
+  SIG_CLASSES c;
+  c.bits_[0] = b0;
+  c.bits_[1] = b1;
+  return c;
+
+}
+
+// ***********************************************************************
+SIG_CLASSES all_sig_classes() {
+
+  // SIG_NUM_CLASSES is 84, so the top 44 bits of the second word aren't used
+  return sig_classes( ~boost::uint64_t( 0 ) ,
+		      ( boost::uint64_t( 1 ) << ( SIG_NUM_CLASSES - 64 ) ) - 1 );
+
+}
+
+// ***********************************************************************
+bool operator==( const SIG_CLASSES &a , const SIG_CLASSES &b ) {
+
+  return a.bits_[0] == b.bits_[0] && a.bits_[1] == b.bits_[1];
+
+}
+
+// ***********************************************************************
+SIG_CLASSES operator&( const SIG_CLASSES &a , const SIG_CLASSES &b ) {
+
+  return sig_classes( a.bits_[0] & b.bits_[0] , a.bits_[1] & b.bits_[1] );
+
+}
+
+// ***********************************************************************
+SIG_CLASSES operator|( const SIG_CLASSES &a , const SIG_CLASSES &b ) {
+
+  return sig_classes( a.bits_[0] | b.bits_[0] , a.bits_[1] | b.bits_[1] );
+
+}
+
+// ***********************************************************************
+SIG_CLASSES operator~( const SIG_CLASSES &a ) {
+
+  return sig_classes( ~a.bits_[0] , ~a.bits_[1] ) & all_sig_classes();
+
+}
+
+// ***********************************************************************
+bool no_sig_classes( const SIG_CLASSES &a ) {
+
+  return !a.bits_[0] && !a.bits_[1];
+
+}
+
+// ***********************************************************************
+// elem is the element class, arom 0 for aliphatic, 1 for aromatic, charge
+// -1, 0 or 1 for the sign.
+int sig_class_num( int elem , int arom , int charge ) {
+
+  return ( elem * 2 + arom ) * 3 + charge + 1;
+
+}
+
+// ***********************************************************************
+// all the classes that satisfy the test function
+SIG_CLASSES sig_classes_where( bool ( *test )( int , int , int , int ) ,
+			       int val ) {
+
+  SIG_CLASSES c = sig_classes( 0 , 0 );
+  for( int e = 0 ; e < SIG_NUM_ELEMS ; ++e ) {
+    for( int a = 0 ; a < 2 ; ++a ) {
+      for( int ch = -1 ; ch < 2 ; ++ch ) {
+	if( test( e , a , ch , val ) ) {
+	  int n = sig_class_num( e , a , ch );
+	  c.bits_[n / 64] |= boost::uint64_t( 1 ) << ( n % 64 );
+	}
+      }
+    }
+  }
+  return c;
+
+}
+
+// ***********************************************************************
+bool sig_elem_is( int e , int , int , int val ) { return e == val; }
+bool sig_arom_is( int , int a , int , int val ) { return a == val; }
+bool sig_charge_is( int , int , int ch , int val ) { return ch == val; }
+
+// ***********************************************************************
+// element class for the atomic number. 0 is everything else.
+int sig_elem_class( int atomic_num ) {
+
+  static const int elems[] = { 1 , 5 , 6 , 7 , 8 , 9 , 14 , 15 , 16 , 17 ,
+			       34 , 35 , 53 };
+  for( int i = 0 ; i < SIG_NUM_ELEMS - 1 ; ++i ) {
+    if( elems[i] == atomic_num ) {
+      return i + 1;
+    }
+  }
+  return 0;
+
+}
+
+// ***********************************************************************
+// atomic number of the element symbol at the start of s, which is assumed
+// to be in a SMARTS atom in square brackets, or 0 if it's not an element.
+// len is set to the number of characters in the symbol.
+int sig_atomic_num( const char *s , int &len ) {
+
+  static const char *symbols[] = { "H" , "He" , "Li" , "Be" , "B" , "C" ,
+				   "N" , "O" , "F" , "Ne" , "Na" , "Mg" ,
+				   "Al" , "Si" , "P" , "S" , "Cl" , "Ar" ,
+				   "K" , "Ca" , "Sc" , "Ti" , "V" , "Cr" ,
+				   "Mn" , "Fe" , "Co" , "Ni" , "Cu" , "Zn" ,
+				   "Ga" , "Ge" , "As" , "Se" , "Br" , "Kr" ,
+				   "Rb" , "Sr" , "Y" , "Zr" , "Nb" , "Mo" ,
+				   "Tc" , "Ru" , "Rh" , "Pd" , "Ag" , "Cd" ,
+				   "In" , "Sn" , "Sb" , "Te" , "I" , "Xe" ,
+				   "Cs" , "Ba" , "La" , "Ce" , "Pr" , "Nd" ,
+				   "Pm" , "Sm" , "Eu" , "Gd" , "Tb" , "Dy" ,
+				   "Ho" , "Er" , "Tm" , "Yb" , "Lu" , "Hf" ,
+				   "Ta" , "W" , "Re" , "Os" , "Ir" , "Pt" ,
+				   "Au" , "Hg" , "Tl" , "Pb" , "Bi" , "Po" ,
+				   "At" , "Rn" , "Fr" , "Ra" , "Ac" , "Th" ,
+				   "Pa" , "U" , "Np" , "Pu" , "Am" , "Cm" ,
+				   "Bk" , "Cf" , "Es" , "Fm" , "Md" , "No" ,
+				   "Lr" , 0 };
+
+  // 2 letter symbols take precedence, as in [Cl] and [Na]
+  for( len = 2 ; len > 0 ; --len ) {
+    for( int i = 0 ; symbols[i] ; ++i ) {
+      if( int( strlen( symbols[i] ) ) == len &&
+	  !strncmp( s , symbols[i] , len ) ) {
+	return i + 1;
+      }
+    }
+  }
+  len = 0;
+  return 0;
+
+}
+
+// ***********************************************************************
+// a primitive that matches exactly the classes given.
+SIG_PRIM exact_sig_prim( const SIG_CLASSES &classes ) {
+
+  SIG_PRIM p;
+  p.may_ = p.must_ = classes;
+  return p;
+
+}
+
+// ***********************************************************************
+// a primitive that's known to match no more than the classes given.
+SIG_PRIM loose_sig_prim( const SIG_CLASSES &classes ) {
+
+  SIG_PRIM p;
+  p.may_ = classes;
+  p.must_ = sig_classes( 0 , 0 );
+  return p;
+
+}
+
+// ***********************************************************************
+SIG_PRIM element_sig_prim( int atomic_num , int arom ) {
+
+  int elem = sig_elem_class( atomic_num );
+  SIG_CLASSES classes = sig_classes_where( sig_elem_is , elem );
+  if( -1 != arom ) {
+    classes = classes & sig_classes_where( sig_arom_is , arom );
+  }
+  // element class 0 is lots of elements, so it's not certain that a
+  // particular one of them matches.
+  return elem ? exact_sig_prim( classes ) : loose_sig_prim( classes );
+
+}
+
+// ***********************************************************************
+SIG_PRIM and_sig_prims( const SIG_PRIM &a , const SIG_PRIM &b ) {
+
+  SIG_PRIM p;
+  p.may_ = a.may_ & b.may_;
+  p.must_ = a.must_ & b.must_;
+  return p;
+
+}
+
+// ***********************************************************************
+SIG_PRIM or_sig_prims( const SIG_PRIM &a , const SIG_PRIM &b ) {
+
+  SIG_PRIM p;
+  p.may_ = a.may_ | b.may_;
+  p.must_ = a.must_ | b.must_;
+  return p;
+
+}
+
+// ***********************************************************************
+SIG_PRIM not_sig_prim( const SIG_PRIM &a ) {
+
+  SIG_PRIM p;
+  p.may_ = ~a.must_;
+  p.must_ = ~a.may_;
+  return p;
+
+}
+
+// ***********************************************************************
+// the primitives in a run such as NH2+ or #6X4, which are anded together.
+SIG_PRIM sig_prim_run( const string &run ) {
+
+  SIG_PRIM p = exact_sig_prim( all_sig_classes() );
+  const char *s = run.c_str();
+  while( *s ) {
+    SIG_PRIM next = loose_sig_prim( all_sig_classes() );
+    int len = 0;
+    if( '*' == *s ) {
+      next = exact_sig_prim( all_sig_classes() );
+      ++s;
+    } else if( '#' == *s ) {
+      int atomic_num = strtol( s + 1 , const_cast<char **>( &s ) , 10 );
+      next = element_sig_prim( atomic_num , -1 );
+    } else if( '+' == *s || '-' == *s ) {
+      // +, ++, +2 etc. Only a charge of 0 is exact, as the classes only
+      // know the sign.
+      char sign = *s;
+      int charge = 0;
+      for( ; *s == sign ; ++s ) {
+	++charge;
+      }
+      if( isdigit( *s ) ) {
+	charge = strtol( s , const_cast<char **>( &s ) , 10 );
+      }
+      if( !charge ) {
+	next = exact_sig_prim( sig_classes_where( sig_charge_is , 0 ) );
+      } else {
+	next = loose_sig_prim( sig_classes_where( sig_charge_is ,
+						  '+' == sign ? 1 : -1 ) );
+      }
+    } else if( 'H' == *s && !( islower( s[1] ) &&
+			       sig_atomic_num( s , len ) && 2 == len ) ) {
+      // hydrogen count, which can't be narrowed down
+      for( ++s ; isdigit( *s ) ; ++s ) ;
+    } else if( 'A' == *s && !( islower( s[1] ) &&
+			       sig_atomic_num( s , len ) && 2 == len ) ) {
+      next = exact_sig_prim( sig_classes_where( sig_arom_is , 0 ) );
+      ++s;
+    } else if( 'a' == *s && 's' != s[1] ) {
+      next = exact_sig_prim( sig_classes_where( sig_arom_is , 1 ) );
+      ++s;
+    } else if( isupper( *s ) && 'D' != *s && 'X' != *s && 'R' != *s &&
+	       sig_atomic_num( s , len ) ) {
+      next = element_sig_prim( sig_atomic_num( s , len ) , 0 );
+      s += len;
+    } else if( !strncmp( s , "se" , 2 ) || !strncmp( s , "as" , 2 ) ) {
+      char sym[3] = { char( toupper( s[0] ) ) , s[1] , 0 };
+      next = element_sig_prim( sig_atomic_num( sym , len ) , 1 );
+      s += 2;
+    } else if( *s && strchr( "bcnops" , *s ) ) {
+      char sym[2] = { char( toupper( *s ) ) , 0 };
+      next = element_sig_prim( sig_atomic_num( sym , len ) , 1 );
+      ++s;
+    } else {
+      // anything else (D, X, R, r, v, x, h, @, ^, isotopes, recursive
+      // SMARTS) could be anything as far as the classes go. Skip it and
+      // any number that goes with it.
+      for( ++s ; isdigit( *s ) ; ++s ) ;
+    }
+    p = and_sig_prims( p , next );
+  }
+
+  return p;
+
+}
+
+// ***********************************************************************
+SIG_PRIM sig_prim_from_expr( const string &expr ,
+			     const vector<ATOM_EXPR_NODE> &nodes ,
+			     int node_num ) {
+
+  const ATOM_EXPR_NODE &node = nodes[node_num];
+  switch( node.op_ ) {
+  case 'P' :
+    if( '$' == expr[node.start_] ) {
+      return loose_sig_prim( all_sig_classes() );
+    }
+    return sig_prim_run( expr.substr( node.start_ , node.end_ - node.start_ ) );
+  case '!' :
+    return not_sig_prim( sig_prim_from_expr( expr , nodes , node.left_ ) );
+  case ',' :
+    return or_sig_prims( sig_prim_from_expr( expr , nodes , node.left_ ) ,
+			 sig_prim_from_expr( expr , nodes , node.right_ ) );
+  case ';' : case '&' :
+    return and_sig_prims( sig_prim_from_expr( expr , nodes , node.left_ ) ,
+			  sig_prim_from_expr( expr , nodes , node.right_ ) );
+  default :
+    return loose_sig_prim( all_sig_classes() );
+  }
+
+}
+
+// ***********************************************************************
+// recursive SMARTS that the atom can't match without, i.e. the ones that
+// are only anded into the expression.
+void required_recursive_smarts( const string &expr ,
+				const vector<ATOM_EXPR_NODE> &nodes ,
+				int node_num , vector<string> &rec_smarts ) {
+
+  const ATOM_EXPR_NODE &node = nodes[node_num];
+  if( ';' == node.op_ || '&' == node.op_ ) {
+    required_recursive_smarts( expr , nodes , node.left_ , rec_smarts );
+    required_recursive_smarts( expr , nodes , node.right_ , rec_smarts );
+  } else if( 'P' == node.op_ && '$' == expr[node.start_] ) {
+    // $( ... )
+    rec_smarts.push_back( expr.substr( node.start_ + 2 ,
+				       node.end_ - node.start_ - 3 ) );
+  }
+
+}
+
+// ***********************************************************************
+SMARTSSignature::SMARTSSignature( const string &smarts ) :
+  num_arom_( 0 ) , needs_ring_( false ) {
+
+  fill( elem_counts_ , elem_counts_ + SIG_NUM_ELEMS , 0 );
+  add_pattern( smarts );
+
+}
+
+// ***********************************************************************
+bool SMARTSSignature::could_match( const MOL_SIGNATURE &mol_sig ) const {
+
+  if( needs_ring_ && !mol_sig.has_ring_ ) {
+    return false;
+  }
+  if( num_arom_ > mol_sig.num_arom_ ) {
+    return false;
+  }
+  for( int i = 0 ; i < SIG_NUM_ELEMS ; ++i ) {
+    if( elem_counts_[i] > mol_sig.elem_counts_[i] ) {
+      return false;
+    }
+  }
+  for( int i = 0 , is = atom_classes_.size() ; i < is ; ++i ) {
+    if( no_sig_classes( atom_classes_[i] & mol_sig.classes_ ) ) {
+      return false;
+    }
+  }
+  return true;
+
+}
+
+// ***********************************************************************
+void SMARTSSignature::make_mol_signature( OEMolBase &mol ,
+					  MOL_SIGNATURE &mol_sig ) {
+
+  mol_sig.classes_ = sig_classes( 0 , 0 );
+  fill( mol_sig.elem_counts_ , mol_sig.elem_counts_ + SIG_NUM_ELEMS , 0 );
+  mol_sig.num_arom_ = 0;
+  mol_sig.has_ring_ = false;
+
+  for( OEIter<OEAtomBase> atom = mol.GetAtoms() ; atom ; ++atom ) {
+    int elem = sig_elem_class( atom->GetAtomicNum() );
+    int arom = atom->IsAromatic() ? 1 : 0;
+    int charge = atom->GetFormalCharge();
+    charge = charge < 0 ? -1 : ( charge > 0 ? 1 : 0 );
+    int n = sig_class_num( elem , arom , charge );
+    mol_sig.classes_.bits_[n / 64] |= boost::uint64_t( 1 ) << ( n % 64 );
+    ++mol_sig.elem_counts_[elem];
+    mol_sig.num_arom_ += arom;
+    if( atom->IsInRing() ) {
+      mol_sig.has_ring_ = true;
+    }
+  }
+
+}
+
+// ***********************************************************************
+// add the requirements of the SMARTS pattern. The counts for a recursive
+// SMARTS are kept separately, as its atoms can be the same as the ones in
+// the pattern it's in.
+void SMARTSSignature::add_pattern( const string &smarts ) {
+
+  int elem_counts[SIG_NUM_ELEMS];
+  fill( elem_counts , elem_counts + SIG_NUM_ELEMS , 0 );
+  int num_arom = 0;
+  vector<string> rec_smarts;
+
+  for( size_t i = 0 , is = smarts.length() ; i < is ; ) {
+    char c = smarts[i];
+    if( '[' == c ) {
+      int depth = 0;
+      size_t j = i;
+      for( ; j < is ; ++j ) {
+	if( '[' == smarts[j] || '(' == smarts[j] ) {
+	  ++depth;
+	} else if( ( ']' == smarts[j] || ')' == smarts[j] ) && !--depth ) {
+	  break;
+	}
+      }
+      string expr = smarts.substr( i + 1 , j - i - 1 );
+      i = j + 1;
+      vector<ATOM_EXPR_NODE> nodes;
+      size_t pos = 0;
+      int root = parse_smarts_atom_expr( expr , pos , 0 , nodes );
+      if( -1 == root || pos != expr.length() ) {
+	continue;
+      }
+      add_pattern_atom( sig_prim_from_expr( expr , nodes , root ).may_ ,
+			elem_counts , num_arom );
+      required_recursive_smarts( expr , nodes , root , rec_smarts );
+    } else if( isdigit( c ) || '%' == c ) {
+      // ring closure
+      needs_ring_ = true;
+      i += '%' == c ? 3 : 1;
+    } else if( !strncmp( smarts.c_str() + i , "Cl" , 2 ) ||
+	       !strncmp( smarts.c_str() + i , "Br" , 2 ) ) {
+      add_pattern_atom( sig_prim_run( smarts.substr( i , 2 ) ).may_ ,
+			elem_counts , num_arom );
+      i += 2;
+    } else if( strchr( "BCNOPSFIbcnopsaA" , c ) ) {
+      add_pattern_atom( sig_prim_run( string( 1 , c ) ).may_ ,
+			elem_counts , num_arom );
+      ++i;
+    } else {
+      // bonds, branches, * etc.
+      ++i;
+    }
+  }
+
+  for( int i = 0 ; i < SIG_NUM_ELEMS ; ++i ) {
+    elem_counts_[i] = max( elem_counts_[i] , elem_counts[i] );
+  }
+  num_arom_ = max( num_arom_ , num_arom );
+
+  for( int i = 0 , is = rec_smarts.size() ; i < is ; ++i ) {
+    add_pattern( rec_smarts[i] );
+  }
+
+}
+
+// ***********************************************************************
+void SMARTSSignature::add_pattern_atom( const SIG_CLASSES &classes ,
+					int *elem_counts , int &num_arom ) {
+
+  if( classes == all_sig_classes() ) {
+    return;
+  }
+  atom_classes_.push_back( classes );
+
+  // if the atom can only be 1 element or has to be aromatic, the molecule
+  // needs at least one atom like that for each of them in the pattern.
+  SIG_CLASSES arom = sig_classes_where( sig_arom_is , 1 );
+  if( ( classes & arom ) == classes ) {
+    ++num_arom;
+  }
+  for( int e = 1 ; e < SIG_NUM_ELEMS ; ++e ) {
+    if( ( classes & sig_classes_where( sig_elem_is , e ) ) == classes ) {
+      ++elem_counts[e];
+      break;
+    }
+  }
+
+}
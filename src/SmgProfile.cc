@@ -0,0 +1,290 @@
+//
+// file SmgProfile.cc
+// agent
+// 17th October 2026
+//
+// Implementation of SmgProfile
+
+#include "SmgProfile.H"
+#include "FileExceptions.H"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace {
+
+// ***********************************************************************
+// 4 buckets for each power of 2, from the top 2 bits after the leading one.
+int time_bucket( boost::uint64_t nsecs ) {
+
+  if( nsecs < 4 ) {
+    return int( nsecs );
+  }
+  int lg = 63 - __builtin_clzll( nsecs );
+  return lg * 4 + int( ( nsecs >> ( lg - 2 ) ) & 3 );
+
+}
+
+// ***********************************************************************
+// the top of the range of times in the bucket. Buckets 4 to 7 aren't used.
+boost::uint64_t time_bucket_top( int bucket ) {
+
+  if( bucket < 4 ) {
+    return bucket;
+  }
+  int lg = bucket / 4;
+  return ( boost::uint64_t( 5 + bucket % 4 ) << ( lg - 2 ) ) - 1;
+
+}
+
+// ***********************************************************************
+// bucket 0 is 0, bucket b > 0 is 2^(b-1) to 2^b - 1.
+int count_bucket( size_t count ) {
+
+  return count ? 64 - __builtin_clzll( count ) : 0;
+
+}
+
+// ***********************************************************************
+string json_string( const string &str ) {
+
+  string ret( "\"" );
+  for( int i = 0 , is = str.length() ; i < is ; ++i ) {
+    if( '"' == str[i] || '\\' == str[i] ) {
+      ret += '\\';
+    }
+    ret += str[i];
+  }
+  return ret + "\"";
+
+}
+
+// ***********************************************************************
+bool slower_smarts( const SMARTS_MATCH_STATS &s1 ,
+		    const SMARTS_MATCH_STATS &s2 ) {
+
+  return s1.nsecs_ > s2.nsecs_;
+
+}
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+SmgProfile::SmgProfile( int num_slots ) : final_write_nsecs_( 0 ) {
+
+  for( int i = 0 ; i < num_slots ; ++i ) {
+    slots_.push_back( new PROFILE_SLOT );
+    memset( slots_.back() , 0 , sizeof( PROFILE_SLOT ) );
+  }
+
+}
+
+// ***********************************************************************
+SmgProfile::~SmgProfile() {
+
+  for( int i = 0 , is = slots_.size() ; i < is ; ++i ) {
+    delete slots_[i];
+  }
+
+}
+
+// ***********************************************************************
+boost::uint64_t SmgProfile::time_stage( int slot , PROFILE_STAGE stage ,
+					boost::uint64_t start ) {
+
+  boost::uint64_t now = profile_nsecs();
+  boost::uint64_t nsecs = now - start;
+  STAGE_TIMES &times = slots_[slot]->stages_[stage];
+  ++times.num_;
+  times.total_nsecs_ += nsecs;
+  times.max_nsecs_ = max( times.max_nsecs_ , nsecs );
+  ++times.buckets_[time_bucket( nsecs )];
+  return now;
+
+}
+
+// ***********************************************************************
+void SmgProfile::add_counts( int slot , size_t num_sites , size_t num_pairs ,
+			     size_t num_triplets ) {
+
+  size_t nums[3] = { num_sites , num_pairs , num_triplets };
+  for( int i = 0 ; i < 3 ; ++i ) {
+    FEATURE_COUNTS &counts = slots_[slot]->counts_[i];
+    counts.total_ += nums[i];
+    counts.max_ = max( counts.max_ , nums[i] );
+    ++counts.buckets_[count_bucket( nums[i] )];
+  }
+
+}
+
+// ***********************************************************************
+void SmgProfile::add_smarts_stats( const vector<SMARTS_MATCH_STATS> &stats ) {
+
+  if( smarts_stats_.empty() ) {
+    smarts_stats_ = stats;
+    return;
+  }
+  for( int i = 0 , is = min( stats.size() , smarts_stats_.size() ) ; i < is ; ++i ) {
+    smarts_stats_[i].num_calls_ += stats[i].num_calls_;
+    smarts_stats_[i].num_hits_ += stats[i].num_hits_;
+    smarts_stats_[i].num_matches_ += stats[i].num_matches_;
+    smarts_stats_[i].nsecs_ += stats[i].nsecs_;
+  }
+
+}
+
+// ***********************************************************************
+// the stage times are summed over the threads, so with more than 1 they
+// can add up to more than wall_secs.
+void SmgProfile::write_json( const string &filename , int num_threads ,
+			     double wall_secs ) const {
+
+  ofstream ofs( filename.c_str() );
+  if( !ofs ) {
+    throw DACLIB::FileWriteOpenError( filename.c_str() );
+  }
+
+  // merge the slots
+  PROFILE_SLOT all;
+  memset( &all , 0 , sizeof( all ) );
+  for( int i = 0 , is = slots_.size() ; i < is ; ++i ) {
+    for( int j = 0 ; j < PROF_NUM_STAGES ; ++j ) {
+      const STAGE_TIMES &st = slots_[i]->stages_[j];
+      all.stages_[j].num_ += st.num_;
+      all.stages_[j].total_nsecs_ += st.total_nsecs_;
+      all.stages_[j].max_nsecs_ = max( all.stages_[j].max_nsecs_ , st.max_nsecs_ );
+      for( int k = 0 ; k < NUM_TIME_BUCKETS ; ++k ) {
+	all.stages_[j].buckets_[k] += st.buckets_[k];
+      }
+    }
+    for( int j = 0 ; j < 3 ; ++j ) {
+      const FEATURE_COUNTS &fc = slots_[i]->counts_[j];
+      all.counts_[j].total_ += fc.total_;
+      all.counts_[j].max_ = max( all.counts_[j].max_ , fc.max_ );
+      for( int k = 0 ; k < NUM_COUNT_BUCKETS ; ++k ) {
+	all.counts_[j].buckets_[k] += fc.buckets_[k];
+      }
+    }
+  }
+
+  rusage usage;
+  getrusage( RUSAGE_SELF , &usage );
+  size_t num_mols = 0;
+  for( int i = 0 ; i < NUM_COUNT_BUCKETS ; ++i ) {
+    num_mols += all.counts_[0].buckets_[i];
+  }
+
+  ofs << "{" << endl
+      << "  \"num_molecules\": " << num_mols << "," << endl
+      << "  \"num_threads\": " << num_threads << "," << endl
+      << "  \"wall_seconds\": " << fixed << setprecision( 6 ) << wall_secs
+      << "," << endl
+      << "  \"peak_rss_kb\": " << usage.ru_maxrss << "," << endl
+      << "  \"final_write_seconds\": " << 1.0e-9 * final_write_nsecs_ << ","
+      << endl
+      << "  \"stages\": {" << endl;
+  static const char *stage_names[] = { "read" , "aromaticity" , "setup" ,
+				       "sites" , "distances" , "pairs" ,
+				       "triplets" , "keys" , "output" };
+  for( int i = 0 ; i < PROF_NUM_STAGES ; ++i ) {
+    write_stage( ofs , stage_names[i] , all.stages_[i] );
+    ofs << ( i < PROF_NUM_STAGES - 1 ? "," : "" ) << endl;
+  }
+  ofs << "  }," << endl
+      << "  \"counts\": {" << endl;
+  static const char *count_names[] = { "sites" , "pairs" , "triplets" };
+  for( int i = 0 ; i < 3 ; ++i ) {
+    write_counts( ofs , count_names[i] , all.counts_[i] , num_mols );
+    ofs << ( i < 2 ? "," : "" ) << endl;
+  }
+  ofs << "  }," << endl;
+  write_smarts( ofs );
+  ofs << "}" << endl;
+
+}
+
+// ***********************************************************************
+// the percentiles are the tops of the buckets they fall in.
+void SmgProfile::write_stage( ostream &os , const string &name ,
+			      const STAGE_TIMES &times ) const {
+
+  static const double pcs[] = { 0.5 , 0.9 , 0.99 };
+  static const char *pc_names[] = { "p50_us" , "p90_us" , "p99_us" };
+
+  os << "    " << json_string( name ) << ": { \"count\": " << times.num_
+     << ", \"total_seconds\": " << setprecision( 6 )
+     << 1.0e-9 * times.total_nsecs_
+     << ", \"mean_us\": " << setprecision( 3 )
+     << ( times.num_ ? 1.0e-3 * times.total_nsecs_ / times.num_ : 0.0 );
+  int bucket = 0;
+  boost::uint64_t so_far = 0;
+  for( int i = 0 ; i < 3 ; ++i ) {
+    boost::uint64_t target = boost::uint64_t( pcs[i] * times.num_ );
+    while( bucket < NUM_TIME_BUCKETS - 1 &&
+	   so_far + times.buckets_[bucket] <= target ) {
+      so_far += times.buckets_[bucket++];
+    }
+    boost::uint64_t top = min( time_bucket_top( bucket ) , times.max_nsecs_ );
+    os << ", \"" << pc_names[i] << "\": " << 1.0e-3 * top;
+  }
+  os << ", \"max_us\": " << 1.0e-3 * times.max_nsecs_ << " }";
+
+}
+
+// ***********************************************************************
+void SmgProfile::write_counts( ostream &os , const string &name ,
+			       const FEATURE_COUNTS &counts ,
+			       size_t num_mols ) const {
+
+  os << "    " << json_string( name ) << ": { \"mean\": " << setprecision( 3 )
+     << ( num_mols ? double( counts.total_ ) / num_mols : 0.0 )
+     << ", \"max\": " << counts.max_ << ", \"histogram\": [";
+  bool first = true;
+  for( int i = 0 ; i < NUM_COUNT_BUCKETS ; ++i ) {
+    if( !counts.buckets_[i] ) {
+      continue;
+    }
+    size_t lo = i ? size_t( 1 ) << ( i - 1 ) : 0;
+    size_t hi = i ? ( lo << 1 ) - 1 : 0;
+    os << ( first ? "" : "," ) << endl
+       << "      { \"min\": " << lo << ", \"max\": " << hi
+       << ", \"molecules\": " << counts.buckets_[i] << " }";
+    first = false;
+  }
+  os << " ] }";
+
+}
+
+// ***********************************************************************
+// slowest first, leaving out the bindings that are never matched directly.
+void SmgProfile::write_smarts( ostream &os ) const {
+
+  vector<SMARTS_MATCH_STATS> stats;
+  for( int i = 0 , is = smarts_stats_.size() ; i < is ; ++i ) {
+    if( smarts_stats_[i].num_calls_ ) {
+      stats.push_back( smarts_stats_[i] );
+    }
+  }
+  sort( stats.begin() , stats.end() , slower_smarts );
+
+  os << "  \"smarts\": [";
+  for( int i = 0 , is = stats.size() ; i < is ; ++i ) {
+    os << ( i ? "," : "" ) << endl
+       << "    { \"name\": " << json_string( stats[i].name_ )
+       << ", \"molecules\": " << stats[i].num_calls_
+       << ", \"molecules_matched\": " << stats[i].num_hits_
+       << ", \"matches\": " << stats[i].num_matches_
+       << ", \"total_seconds\": " << setprecision( 6 )
+       << 1.0e-9 * stats[i].nsecs_
+       << ", \"mean_us\": " << setprecision( 3 )
+       << 1.0e-3 * stats[i].nsecs_ / stats[i].num_calls_ << " }";
+  }
+  os << " ]" << endl;
+
+}
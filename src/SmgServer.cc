@@ -0,0 +1,347 @@
+//
+// file SmgServer.cc
+// agent
+// 17th October 2026
+//
+// Implementation of SmgServer
+
+#include "SmgServer.H"
+#include "FeatureDictionary.H"
+#include "serve_frames.H"
+#include "spiv_nogr_bits.H"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <oechem.h>
+
+using namespace std;
+using namespace OEChem;
+
+namespace {
+
+// ***********************************************************************
+// true if the client at the other end of fd is run by the same user as the
+// server, or root.
+bool peer_is_owner( int fd ) {
+
+  ucred cred;
+  socklen_t len = sizeof( cred );
+  if( getsockopt( fd , SOL_SOCKET , SO_PEERCRED , &cred , &len ) ) {
+    return false;
+  }
+  return cred.uid == geteuid() || 0 == cred.uid;
+
+}
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+SmgServer::SmgServer( const string &socket_path , int num_threads ,
+		      PharmPoint &pharm_points ,
+		      vector<AtomTyper *> &thread_typers ,
+		      const SMG_FEATURE_OPTS &feat_opts ,
+		      FeatureDictionary &feat_dict ) :
+  socket_path_( socket_path ) , num_threads_( num_threads ) ,
+  pharm_points_( pharm_points ) , thread_typers_( thread_typers ) ,
+  feat_opts_( feat_opts ) , feat_dict_( feat_dict ) ,
+  feat_label_( feature_label( feat_opts.output_type_ ) ) , listen_fd_( -1 ) ,
+  stop_workers_( false ) , finished_( false ) {
+
+}
+
+// ***********************************************************************
+SmgServer::~SmgServer() {
+
+  if( -1 != listen_fd_ ) {
+    close( listen_fd_ );
+    unlink( socket_path_.c_str() );
+  }
+
+}
+
+// ***********************************************************************
+void SmgServer::run() {
+
+  sockaddr_un addr;
+  memset( &addr , 0 , sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if( socket_path_.length() >= sizeof( addr.sun_path ) ) {
+    throw( string( "Socket path " ) + socket_path_ + string( " is too long." ) );
+  }
+  strcpy( addr.sun_path , socket_path_.c_str() );
+
+  listen_fd_ = socket( AF_UNIX , SOCK_STREAM , 0 );
+  if( -1 == listen_fd_ ) {
+    throw( string( "Couldn't make socket : " ) + strerror( errno ) );
+  }
+  // one left behind by a server that didn't finish tidily would stop the
+  // bind.
+  unlink( socket_path_.c_str() );
+  if( bind( listen_fd_ , reinterpret_cast<sockaddr *>( &addr ) , sizeof( addr ) ) ||
+      listen( listen_fd_ , 64 ) ) {
+    throw( string( "Couldn't listen on socket " ) + socket_path_ + " : " +
+	   strerror( errno ) );
+  }
+
+  for( int i = 0 ; i < num_threads_ ; ++i ) {
+    workers_.create_thread( boost::bind( &SmgServer::do_jobs , this , i ) );
+  }
+  cerr << "smg serving on " << socket_path_ << " with " << num_threads_
+       << " threads." << endl;
+
+  while( 1 ) {
+    int fd = accept( listen_fd_ , 0 , 0 );
+    int accept_errno = errno;
+    boost::mutex::scoped_lock lock( conn_mutex_ );
+    if( finished_ ) {
+      if( -1 != fd ) {
+	close( fd );
+      }
+      break;
+    }
+    if( -1 == fd ) {
+      if( EINTR == accept_errno || ECONNABORTED == accept_errno ) {
+	continue;
+      }
+      cerr << "Error accepting connection : " << strerror( accept_errno )
+	   << endl;
+      break;
+    }
+    conn_fds_.insert( fd );
+    boost::thread( boost::bind( &SmgServer::serve_connection , this ,
+				fd ) ).detach();
+  }
+
+  // let the connections finish anything they're waiting on before the
+  // workers stop.
+  {
+    boost::mutex::scoped_lock lock( conn_mutex_ );
+    while( !conn_fds_.empty() ) {
+      conns_done_.wait( lock );
+    }
+  }
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    stop_workers_ = true;
+  }
+  job_cond_.notify_all();
+  workers_.join_all();
+
+}
+
+// ***********************************************************************
+// the worker threads
+void SmgServer::do_jobs( int thread_num ) {
+
+  while( 1 ) {
+    SERVE_JOB *job = 0;
+    {
+      boost::mutex::scoped_lock lock( mutex_ );
+      while( job_queue_.empty() && !stop_workers_ ) {
+	job_cond_.wait( lock );
+      }
+      if( job_queue_.empty() ) {
+	return;
+      }
+      job = job_queue_.front();
+      job_queue_.pop_front();
+    }
+
+    OEGraphMol mol;
+    if( !OESmilesToMol( mol , job->smiles_ ) ) {
+      job->error_ = "couldn't parse SMILES " + job->smiles_;
+    } else {
+      mol.SetTitle( job->mol_name_ );
+      try {
+	string mol_name;
+	process_molecule( mol , mol_name , job->feat_keys_ , thread_num ,
+			  pharm_points_ , thread_typers_ , feat_opts_ );
+      } catch( string &msg ) {
+	job->error_ = msg;
+      }
+    }
+
+    boost::mutex::scoped_lock lock( mutex_ );
+    if( !--job->request_->num_pending_ ) {
+      done_cond_.notify_all();
+    }
+  }
+
+}
+
+// ***********************************************************************
+void SmgServer::serve_connection( int fd ) {
+
+  bool can_shutdown = peer_is_owner( fd );
+  string request , response;
+  while( read_serve_frame( fd , request ) ) {
+    bool more = answer_request( request , can_shutdown , response );
+    if( !write_serve_frame( fd , response ) ) {
+      break;
+    }
+    if( !more ) {
+      shutdown();
+      break;
+    }
+  }
+
+  boost::mutex::scoped_lock lock( conn_mutex_ );
+  conn_fds_.erase( fd );
+  close( fd );
+  conns_done_.notify_all();
+
+}
+
+// ***********************************************************************
+// stop accepting connections, and cut off the ones there are, which makes
+// their threads finish once they've answered what they're doing.
+void SmgServer::shutdown() {
+
+  boost::mutex::scoped_lock lock( conn_mutex_ );
+  finished_ = true;
+  ::shutdown( listen_fd_ , SHUT_RDWR );
+  for( set<int>::iterator p = conn_fds_.begin() ; p != conn_fds_.end() ; ++p ) {
+    ::shutdown( *p , SHUT_RDWR );
+  }
+
+}
+
+// ***********************************************************************
+bool SmgServer::answer_request( const string &request , bool can_shutdown ,
+				string &response ) {
+
+  istringstream iss( request );
+  string line , command;
+  getline( iss , line );
+  istringstream( line ) >> command;
+  if( "shutdown" == command ) {
+    if( !can_shutdown ) {
+      response = "ERROR shutdown is only allowed for the user running the server\n";
+      return true;
+    }
+    response = "OK 0 0\n";
+    return false;
+  }
+  bool want_bits = "bits" == command;
+  if( !want_bits && "labels" != command ) {
+    response = "ERROR unknown request " + command + "\n";
+    return true;
+  }
+  unsigned int num_cols = 0;
+  if( want_bits ) {
+    if( feat_opts_.fold_bits_ ) {
+      num_cols = feat_opts_.fold_bits_;
+    } else if( feat_dict_.fixed() ) {
+      num_cols = feat_dict_.size();
+    } else {
+      response = "ERROR bits need the columns fixed by -read_vocab or -fold\n";
+      return true;
+    }
+  }
+
+  SERVE_REQUEST req;
+  while( getline( iss , line ) ) {
+    SERVE_JOB job;
+    istringstream( line ) >> job.smiles_ >> job.mol_name_;
+    if( job.smiles_.empty() ) {
+      continue;
+    }
+    if( job.mol_name_.empty() ) {
+      job.mol_name_ = boost::lexical_cast<string>( req.jobs_.size() + 1 );
+    }
+    job.request_ = &req;
+    req.jobs_.push_back( job );
+  }
+  run_jobs( req );
+
+  response = "OK " + boost::lexical_cast<string>( req.jobs_.size() ) + " " +
+    boost::lexical_cast<string>( num_cols ) + "\n";
+  for( int i = 0 , is = req.jobs_.size() ; i < is ; ++i ) {
+    if( want_bits ) {
+      add_bits( req.jobs_[i] , num_cols , response );
+    } else {
+      add_labels( req.jobs_[i] , response );
+    }
+  }
+  return true;
+
+}
+
+// ***********************************************************************
+// put all the request's jobs in the queue in one go, and wait till they're
+// done.
+void SmgServer::run_jobs( SERVE_REQUEST &request ) {
+
+  boost::mutex::scoped_lock lock( mutex_ );
+  request.num_pending_ = request.jobs_.size();
+  for( int i = 0 , is = request.jobs_.size() ; i < is ; ++i ) {
+    job_queue_.push_back( &request.jobs_[i] );
+  }
+  job_cond_.notify_all();
+  while( request.num_pending_ ) {
+    done_cond_.wait( lock );
+  }
+
+}
+
+// ***********************************************************************
+void SmgServer::add_labels( const SERVE_JOB &job , string &response ) {
+
+  response += job.mol_name_;
+  if( !job.error_.empty() ) {
+    response += " ERROR " + job.error_ + "\n";
+    return;
+  }
+  for( int i = 0 , is = job.feat_keys_.size() ; i < is ; ++i ) {
+    response += " ";
+    response += feat_label_;
+    if( feat_opts_.fold_bits_ ) {
+      response += "F" + boost::lexical_cast<string>( job.feat_keys_[i] );
+    } else {
+      response += hash_feature_name( feature_key_label( job.feat_keys_[i] ,
+							feat_opts_.output_type_ ,
+							feat_opts_.type_names_ ) );
+    }
+  }
+  response += "\n";
+
+}
+
+// ***********************************************************************
+void SmgServer::add_bits( const SERVE_JOB &job , unsigned int num_cols ,
+			  string &response ) {
+
+  response += job.mol_name_;
+  if( !job.error_.empty() ) {
+    response += " ERROR " + job.error_ + "\n";
+    return;
+  }
+  response += "\n";
+
+  vector<unsigned int> cols;
+  if( feat_opts_.fold_bits_ ) {
+    cols.assign( job.feat_keys_.begin() , job.feat_keys_.end() );
+  } else {
+    // with the dictionary fixed, the ids are the column numbers
+    boost::mutex::scoped_lock lock( dict_mutex_ );
+    feat_dict_.add_molecule( job.feat_keys_ , cols );
+  }
+  vector<boost::uint64_t> row( ( num_cols + 63 ) / 64 , 0 );
+  for( int i = 0 , is = cols.size() ; i < is ; ++i ) {
+    row[cols[i] / 64] |= boost::uint64_t( 1 ) << ( cols[i] % 64 );
+  }
+  if( !row.empty() ) {
+    response.append( reinterpret_cast<const char *>( &row[0] ) ,
+		     row.size() * sizeof( boost::uint64_t ) );
+  }
+
+}
@@ -8,7 +8,10 @@
 
 #include <algorithm>
 
+#include <boost/lexical_cast.hpp>
+
 #include "stddefs.H"
+#include "AtomTyper.H"
 #include "PharmPoint.H"
 #include "SpivMolecule.H"
 
@@ -16,57 +19,67 @@ using namespace OESystem;
 using namespace OEPlatform;
 
 // ***********************************************************************
-SpivMolecule::SpivMolecule( OEMolBase &mol ) : OEMol( mol ) {
-
-  atom_atom_dists_ = 0;
+SpivMolecule::SpivMolecule( OEMolBase &mol ) : OEMol( mol ) ,
+						site_dists_max_dist_( -1 ) {
 
 }
 
 // ***********************************************************************
 SpivMolecule::~SpivMolecule() {
 
-  DACLIB::destroy_square_matrix( atom_atom_dists_ );
-
 }
 
 // ***********************************************************************
 // make the 2D pharmacophore sites.
 void SpivMolecule::make_pphore_sites( PharmPoint &pharm_points ,
-				      map<string,OESubSearch *> &oe_subs ) {
+				      AtomTyper &atom_typer ) {
 
   pphore_site_atoms_.clear();
   pphore_site_labels_.clear();
+  pphore_site_types_.clear();
+  site_site_dists_.clear();
 
   map<string,vector<string> > &points_defs = pharm_points.points_defs();
   map<string,vector<string> >::iterator p , ps;
   vector<string>::iterator q;
-  map<string,OESubSearch *>::iterator r;
 
-  OESubSearch *subs;
-  OEIter<OEMatchBase> match;
-  vector<unsigned int> next_ats;
+  // the same SMARTS may be used by more than 1 point type (e.g. PIP and BOTH
+  // in test.points), so each one is only matched the first time it's needed,
+  // and the matches kept for any other points that use it.
+  typedef map<string,vector<vector<unsigned int> > > SMARTS_MATCHES;
+  SMARTS_MATCHES smarts_matches;
+  SMARTS_MATCHES::iterator sm;
+
+  atom_typer.set_molecule( *this );
   for( p = points_defs.begin() , ps= points_defs.end() ; p != ps ; ++p ) {
     //    cout << "Point type " << p->first << endl;
     if( p->second.empty() )
       continue; // point defined by key word (e.g. ITMOC, ITMOC_ALO) not SMARTS.
 
+    int type_code = pharm_points.type_code_from_string( p->first );
+    if( type_code > SPIV_MAX_TYPE ) {
+      string msg = "Too many point types for pairs and triplets, at "
+	+ p->first;
+      throw( msg );
+    }
     for( q = p->second.begin() ; q != p->second.end() ; ++q ) {
 
-      r = oe_subs.find( *q );
-      if( r == oe_subs.end() ) {
-	string msg = "No SMARTS definition for " + *q +
-	  " needed for point type " + p->first;
-	throw( msg );
-      }
-      subs = r->second;
-      for( match = subs->Match( *this , true ) ; match ; ++match ) {
-	OEIter<OEMatchPair<OEAtomBase> > mp = match->GetAtoms();
-	next_ats.clear();
-	for( ; mp ; ++mp )
-	  next_ats.push_back( mp->target->GetIdx() );
-	pphore_site_atoms_.push_back( next_ats );
-	pphore_site_labels_.push_back( p->first );
+      sm = smarts_matches.find( *q );
+      if( sm == smarts_matches.end() ) {
+	if( !atom_typer.has_definition( *q ) ) {
+	  string msg = "No SMARTS definition for " + *q +
+	    " needed for point type " + p->first;
+	  throw( msg );
+	}
+	sm = smarts_matches.insert( make_pair( *q , vector<vector<unsigned int> >() ) ).first;
+	atom_typer.match( *q , sm->second );
       }
+      pphore_site_atoms_.insert( pphore_site_atoms_.end() ,
+				 sm->second.begin() , sm->second.end() );
+      pphore_site_labels_.insert( pphore_site_labels_.end() ,
+				  sm->second.size() , p->first );
+      pphore_site_types_.insert( pphore_site_types_.end() ,
+				 sm->second.size() , type_code );
     }
   }
 
@@ -89,21 +102,25 @@ void SpivMolecule::report_pphore_sites( ostream &os ) {
 // ***********************************************************************
 // sites must be made before pairs, and sites need the SMARTS defs so can't
 // be generated in this function.
-void SpivMolecule::make_pphore_pairs() {
+void SpivMolecule::make_pphore_pairs( int min_dist , int max_dist ) {
 
   if( pphore_site_labels_.empty() )
     return; // need sites for the pairs
 
-  if( !atom_atom_dists_ )
-    make_atom_atom_dists_matrix();
+  check_site_site_dists( max_dist );
 
   pphore_pairs_.clear();
 
+  if( max_dist < 0 )
+    max_dist = numeric_limits<int>::max();
+
   //  cout << "XXXXXXXXXXXXXXXXXXXXXXXX" << GetTitle() << endl;
 
   for( int i = 0 , is = pphore_site_labels_.size() - 1 ; i < is ; ++i ) {
     for( int j = i + 1 , js = pphore_site_labels_.size() ; j < js ; ++j ) {
-      pphore_pairs_.push_back( make_spiv_pair( i , j ) );
+      int dist = shortest_site_site_dist( i , j );
+      if( dist >= min_dist && dist <= max_dist )
+	pphore_pairs_.push_back( make_spiv_pair( i , j ) );
     }
   }
 
@@ -113,7 +130,7 @@ void SpivMolecule::make_pphore_pairs() {
 
 #ifdef NOTYET
   for( int i = 0 , is = pphore_pairs_.size() ; i < is ; ++i )
-    cout << pphore_pairs_[i].label_ << " : "
+    cout << pphore_pair_label( pphore_pairs_[i] ) << " : "
 	 << pphore_pairs_[i].site1_ << " - " << pphore_pairs_[i].site2_
 	 << " : " << pphore_pairs_[i].dist_ << endl;
 #endif
@@ -121,15 +138,19 @@ void SpivMolecule::make_pphore_pairs() {
 }
 
 // ***********************************************************************
-// pairs must be made before triplets
-void SpivMolecule::make_pphore_triplets() {
+// sites must be made before triplets. The pairs aren't needed, everything
+// comes from the site-site distances matrix.
+void SpivMolecule::make_pphore_triplets( int min_dist , int max_dist ) {
 
-  if( pphore_pairs_.empty() )
-    make_pphore_pairs();
-  if( pphore_pairs_.size() < 3 )
-    return; // need 3 pairs for the triplets
+  const int num_sites = pphore_site_labels_.size();
+  if( num_sites < 3 )
+    return; // need 3 sites for the triplets
+
+  check_site_site_dists( max_dist );
 
   pphore_triplets_.clear();
+  if( max_dist < 0 )
+    max_dist = numeric_limits<int>::max();
 
   // the triplets are encoded using the algorithm of Abrahamian et al.
   // (paper 273, JCICS, 43, 458-468). The three features are labelled
@@ -137,55 +158,71 @@ void SpivMolecule::make_pphore_triplets() {
   // edges, f1 is at the other end of the longest edge, f3 the other end of
   // the shortest edge.  If two edges have the same distance, priority is
   // given to the one with the higher label (label1>label2).
-  SPIV_PAIR triplet_pairs[3];
+  // Each edge is given a sort key of distance, then the 2 site types, which
+  // are in order because the sites are, then the edge number, so the 3 keys
+  // are always different and the longest edge has the biggest one. Edges
+  // are 0 : i-j, 1 : j-k, 2 : i-k. The site common to 2 edges is the one
+  // that isn't in the third, opp_sites below, so f2 (sites_[1]) is the site
+  // opposite the middle edge, f1 (sites_[0]) the one opposite the longest
+  // and f3 (sites_[2]) the one opposite the shortest.
+  // A triplet with any edge outside the distance limits isn't made, and as
+  // soon as i-j is outside them, all the k for that i-j are skipped.
+  const int *types = &pphore_site_types_[0];
   SPIV_TRIPLET spiv_triplet;
-  for( int i = 0 , is = pphore_site_labels_.size() - 2 ; i < is ; ++i ) {
-    for( int j = i + 1 , js = pphore_site_labels_.size() - 1 ; j < js ; ++j ) {
-      for( int k = j + 1 , ks = pphore_site_labels_.size() ; k < ks ; ++k ) {
-
-	triplet_pairs[0] = make_spiv_pair( i , j );
-	triplet_pairs[1] = make_spiv_pair( j , k );
-	triplet_pairs[2] = make_spiv_pair( i , k );
-
-	sort( triplet_pairs , triplet_pairs + 3 , SpivPairIsLonger() );
-	// spiv_triplet.sites_[1] is site in common for sides 2 and 0 (longest
-	// and shortest).  spiv_triplet.sites_[0] is other end of side 2,
-	// spiv_triplet.sites_[2] is other end of site 0
-	if( triplet_pairs[2].site1_ == triplet_pairs[0].site1_ ) {
-	  spiv_triplet.sites_[1] = triplet_pairs[2].site1_;
-	  spiv_triplet.sites_[0] = triplet_pairs[2].site2_;
-	} else if( triplet_pairs[2].site1_ == triplet_pairs[0].site2_ ) {
-	  spiv_triplet.sites_[1] = triplet_pairs[2].site1_;
-	  spiv_triplet.sites_[0] = triplet_pairs[2].site2_;
-	} else if( triplet_pairs[2].site2_ == triplet_pairs[0].site1_ ) {
-	  spiv_triplet.sites_[1] = triplet_pairs[2].site2_;
-	  spiv_triplet.sites_[0] = triplet_pairs[2].site1_;
-	} else if( triplet_pairs[2].site2_ == triplet_pairs[0].site2_ ) {
-	  spiv_triplet.sites_[1] = triplet_pairs[2].site2_;
-	  spiv_triplet.sites_[0] = triplet_pairs[2].site1_;
-	}
-	if( spiv_triplet.sites_[1] == triplet_pairs[0].site1_ )
-	  spiv_triplet.sites_[2] = triplet_pairs[0].site2_;
-	else
-	  spiv_triplet.sites_[2] = triplet_pairs[0].site1_;
-
-	spiv_triplet.dists_[0] = triplet_pairs[2].dist_;
-	spiv_triplet.dists_[1] = triplet_pairs[1].dist_;
-	spiv_triplet.dists_[2] = triplet_pairs[0].dist_;
-
-	spiv_triplet.site_labels_[0] =
-	  pphore_site_labels_[spiv_triplet.sites_[0]];
-	spiv_triplet.site_labels_[1] =
-	  pphore_site_labels_[spiv_triplet.sites_[1]];
-	spiv_triplet.site_labels_[2] =
-	  pphore_site_labels_[spiv_triplet.sites_[2]];
-
-	spiv_triplet.label_ = triplet_pairs[2].label_ + "-" +
-	  triplet_pairs[1].label_ + "-" + triplet_pairs[0].label_;
+  int edge_dists[3] , opp_sites[3];
+  boost::uint64_t edge_keys[3];
+  for( int i = 0 ; i < num_sites - 2 ; ++i ) {
+    const int *i_dists = &site_site_dists_[i * num_sites];
+    boost::uint64_t i_type = types[i];
+    opp_sites[1] = i;
+    for( int j = i + 1 ; j < num_sites - 1 ; ++j ) {
+      const int *j_dists = &site_site_dists_[j * num_sites];
+      boost::uint64_t j_type = types[j];
+      opp_sites[2] = j;
+      edge_dists[0] = i_dists[j];
+      if( edge_dists[0] < min_dist || edge_dists[0] > max_dist )
+	continue;
+      edge_keys[0] = ( ( spiv_dist_code( edge_dists[0] ) << SPIV_TYPE_BITS
+			 | i_type ) << SPIV_TYPE_BITS | j_type ) << 2;
+      for( int k = j + 1 ; k < num_sites ; ++k ) {
+	boost::uint64_t k_type = types[k];
+	opp_sites[0] = k;
+	edge_dists[1] = j_dists[k];
+	edge_dists[2] = i_dists[k];
+	if( edge_dists[1] < min_dist || edge_dists[1] > max_dist ||
+	    edge_dists[2] < min_dist || edge_dists[2] > max_dist )
+	  continue;
+	edge_keys[1] = ( ( ( spiv_dist_code( edge_dists[1] ) << SPIV_TYPE_BITS
+			     | j_type ) << SPIV_TYPE_BITS | k_type ) << 2 ) | 1;
+	edge_keys[2] = ( ( ( spiv_dist_code( edge_dists[2] ) << SPIV_TYPE_BITS
+			     | i_type ) << SPIV_TYPE_BITS | k_type ) << 2 ) | 2;
+
+	boost::uint64_t longest = max( max( edge_keys[0] , edge_keys[1] ) ,
+				       edge_keys[2] );
+	boost::uint64_t shortest = min( min( edge_keys[0] , edge_keys[1] ) ,
+					edge_keys[2] );
+	boost::uint64_t middle = edge_keys[0] ^ edge_keys[1] ^ edge_keys[2] ^
+	  longest ^ shortest;
+	int long_edge = longest & 3;
+	int mid_edge = middle & 3;
+	int short_edge = shortest & 3;
+
+	spiv_triplet.sites_[0] = opp_sites[long_edge];
+	spiv_triplet.sites_[1] = opp_sites[mid_edge];
+	spiv_triplet.sites_[2] = opp_sites[short_edge];
+	spiv_triplet.dists_[0] = edge_dists[short_edge];
+	spiv_triplet.dists_[1] = edge_dists[mid_edge];
+	spiv_triplet.dists_[2] = edge_dists[long_edge];
+
+	int site_types[3] = { types[spiv_triplet.sites_[0]] ,
+			      types[spiv_triplet.sites_[1]] ,
+			      types[spiv_triplet.sites_[2]] };
+	spiv_triplet.key_ = spiv_triplet_key( site_types ,
+					      spiv_triplet.dists_ );
 
 	pphore_triplets_.push_back( spiv_triplet );
       }
-    }    
+    }
   }
 
   sort( pphore_triplets_.begin() , pphore_triplets_.end() ,
@@ -221,39 +258,97 @@ void SpivMolecule::get_feature_atoms( const string &feature_type ,
 }
 
 // ***********************************************************************
-void SpivMolecule::make_atom_atom_dists_matrix() {
-
-  if( atom_atom_dists_ )
-    return; // only want to do it once
-
+// Rather than all the atom-atom distances, which took an O(N^3) Floyd's
+// algorithm, do a breadth-first search outwards from all the atoms of each
+// site at once.  The first time the search reaches an atom of another site,
+// that's the shortest distance between them. Each search stops when all
+// the remaining sites have been found, or at max_dist if that's not -ve.
+void SpivMolecule::make_site_site_dists_matrix( int max_dist ) {
+
+  const int num_sites = pphore_site_atoms_.size();
+  site_site_dists_ = vector<int>( num_sites * num_sites , SPIV_NO_PATH );
+  site_dists_max_dist_ = max_dist < 0 ? -1 : max_dist;
+  if( !num_sites )
+    return;
+  for( int i = 0 ; i < num_sites ; ++i )
+    site_site_dists_[i * num_sites + i] = 0;
+
+  // the bonds, as a list of neighbours for each atom, all in 1 vector
   const int max_idx = GetMaxAtomIdx();
-  DACLIB::make_square_matrix( atom_atom_dists_ , max_idx );
-
-  int half_max = numeric_limits<int>::max() / 2;
-  fill( atom_atom_dists_[0] , atom_atom_dists_[0] + max_idx * max_idx ,
-	half_max );
-  for( int i = 0 ; i < max_idx ; ++i )
-    atom_atom_dists_[i][i] = 0;
-
-  // put the bonds in
+  vector<unsigned int> nbr_starts( max_idx + 1 , 0 ) , nbrs;
   OEIter<OEAtomBase> atom , conns;
   for( atom = GetAtoms() ; atom ; ++atom ) {
-    int this_idx = atom->GetIdx();
     for( conns = atom->GetAtoms() ; conns ; ++conns )
-      atom_atom_dists_[this_idx][conns->GetIdx()] =
-	atom_atom_dists_[conns->GetIdx()][this_idx] = 1;
+      ++nbr_starts[atom->GetIdx() + 1];
+  }
+  for( int i = 0 ; i < max_idx ; ++i )
+    nbr_starts[i + 1] += nbr_starts[i];
+  nbrs.resize( nbr_starts[max_idx] );
+  vector<unsigned int> next_nbr( nbr_starts.begin() , nbr_starts.end() - 1 );
+  for( atom = GetAtoms() ; atom ; ++atom ) {
+    for( conns = atom->GetAtoms() ; conns ; ++conns )
+      nbrs[next_nbr[atom->GetIdx()]++] = conns->GetIdx();
   }
 
-  // now use Floyd's algorithm to find the minimum through-bond distance
-  // between each pair of atoms. This is taken from 'Practical Algorithms
-  // in C++' by Flamig p 386.
-  for( int k = 0 ; k < max_idx ; ++k ) {
-    for( int i = 0 ; i < max_idx ; ++i ) {
-      for( int j = 0 ; j < max_idx ; ++j ) {
-	int old_dist = atom_atom_dists_[i][j];
-	int new_dist = atom_atom_dists_[i][k] + atom_atom_dists_[k][j];
-	if( new_dist < old_dist )
-	  atom_atom_dists_[i][j] = new_dist;
+  // and the sites that each atom is in, likewise.
+  vector<unsigned int> site_starts( max_idx + 1 , 0 ) , atom_sites;
+  for( int i = 0 ; i < num_sites ; ++i ) {
+    for( int j = 0 , js = pphore_site_atoms_[i].size() ; j < js ; ++j )
+      ++site_starts[pphore_site_atoms_[i][j] + 1];
+  }
+  for( int i = 0 ; i < max_idx ; ++i )
+    site_starts[i + 1] += site_starts[i];
+  atom_sites.resize( site_starts[max_idx] );
+  vector<unsigned int> next_site( site_starts.begin() , site_starts.end() - 1 );
+  for( int i = 0 ; i < num_sites ; ++i ) {
+    for( int j = 0 , js = pphore_site_atoms_[i].size() ; j < js ; ++j )
+      atom_sites[next_site[pphore_site_atoms_[i][j]]++] = i;
+  }
+
+  vector<int> atom_dists( max_idx , -1 );
+  vector<unsigned int> bfs_queue;
+  bfs_queue.reserve( max_idx );
+  // the matrix is symmetrical, so each search only needs to find the sites
+  // after the one it's starting from.
+  for( int i = 0 ; i < num_sites - 1 ; ++i ) {
+    int *dists_row = &site_site_dists_[i * num_sites];
+    int num_to_find = num_sites - i - 1;
+    for( int j = 0 , js = bfs_queue.size() ; j < js ; ++j )
+      atom_dists[bfs_queue[j]] = -1;
+    bfs_queue.clear();
+    for( int j = 0 , js = pphore_site_atoms_[i].size() ; j < js ; ++j ) {
+      unsigned int at = pphore_site_atoms_[i][j];
+      if( -1 == atom_dists[at] ) {
+	atom_dists[at] = 0;
+	bfs_queue.push_back( at );
+      }
+    }
+
+    for( unsigned int q = 0 ; q < bfs_queue.size() && num_to_find ; ++q ) {
+      unsigned int at = bfs_queue[q];
+      int at_dist = atom_dists[at];
+      for( unsigned int k = site_starts[at] ; k < site_starts[at + 1] ; ++k ) {
+	int site = atom_sites[k];
+	if( site > i && SPIV_NO_PATH == dists_row[site] ) {
+	  if( at_dist >= SPIV_MAX_DIST ) {
+	    string msg = string( "Molecule " ) + GetTitle() + " has sites "
+	      + boost::lexical_cast<string>( at_dist ) + " bonds apart, more than"
+	      + " the " + boost::lexical_cast<string>( SPIV_MAX_DIST - 1 )
+	      + " that pairs and triplets can be made for. Use a smaller"
+	      + " -max_dist.";
+	    throw( msg );
+	  }
+	  dists_row[site] = site_site_dists_[site * num_sites + i] = at_dist;
+	  --num_to_find;
+	}
+      }
+      if( max_dist >= 0 && at_dist >= max_dist )
+	continue;
+      for( unsigned int k = nbr_starts[at] ; k < nbr_starts[at + 1] ; ++k ) {
+	if( -1 == atom_dists[nbrs[k]] ) {
+	  atom_dists[nbrs[k]] = at_dist + 1;
+	  bfs_queue.push_back( nbrs[k] );
+	}
       }
     }
   }
@@ -265,44 +360,84 @@ void SpivMolecule::make_atom_atom_dists_matrix() {
 // site2.
 int SpivMolecule::shortest_site_site_dist( int site1 , int site2 ) {
 
-  if( !atom_atom_dists_ )
-    make_atom_atom_dists_matrix();
+  if( site_site_dists_.empty() )
+    make_site_site_dists_matrix();
 
-  int shortest_dist = numeric_limits<int>::max();
-  vector<unsigned int> &i_atoms = pphore_site_atoms_[site1];
-  vector<unsigned int> &j_atoms = pphore_site_atoms_[site2];
-  for( int k = 0 , ks = i_atoms.size() ; k < ks ; ++k ) {
-    for( int l = 0 , ls = j_atoms.size() ; l < ls ; ++l ) {
-      if( atom_atom_dists_[i_atoms[k]][j_atoms[l]] < shortest_dist )
-	shortest_dist = atom_atom_dists_[i_atoms[k]][j_atoms[l]];
-    }
+  return site_site_dists_[site1 * pphore_site_atoms_.size() + site2];
+
+}
+
+// *******************************************************************
+void SpivMolecule::check_site_site_dists( int max_dist ) {
+
+  if( site_site_dists_.empty() ||
+      ( -1 != site_dists_max_dist_ &&
+	( max_dist < 0 || max_dist > site_dists_max_dist_ ) ) )
+    make_site_site_dists_matrix( max_dist );
+
+}
+
+// **************************************************************************
+string spiv_pair_key_label( boost::uint64_t key ,
+			    const vector<string> &type_names ) {
+
+  int type1 = int( ( key >> ( SPIV_DIST_BITS + SPIV_TYPE_BITS ) ) & SPIV_MAX_TYPE );
+  int type2 = int( ( key >> SPIV_DIST_BITS ) & SPIV_MAX_TYPE );
+  return type_names[type1] + ":" +
+    boost::lexical_cast<string>( spiv_dist_from_code( key ) ) + ":" +
+    type_names[type2];
+
+}
+
+// **************************************************************************
+// as pphore_triplet_label, the edges are sites 0-1, 0-2 and 1-2 with
+// distances 0 to 2, each with the sites in order of type.
+string spiv_triplet_key_label( boost::uint64_t key ,
+			       const vector<string> &type_names ) {
+
+  static const int edge_ends[3][2] = { { 0 , 1 } , { 0 , 2 } , { 1 , 2 } };
+  string label;
+  for( int i = 0 ; i < 3 ; ++i ) {
+    int type1 = spiv_triplet_type( key , edge_ends[i][0] );
+    int type2 = spiv_triplet_type( key , edge_ends[i][1] );
+    if( type1 > type2 )
+      std::swap( type1 , type2 );
+    int dist = spiv_dist_from_code( key >> ( ( 2 - i ) * SPIV_DIST_BITS ) );
+    if( i )
+      label += "-";
+    label += spiv_pair_key_label( spiv_pair_key( type1 , type2 , dist ) ,
+				  type_names );
   }
 
-  return shortest_dist;
+  return label;
 
 }
 
 // **************************************************************************
 bool spiv_triplet_matches_criteria( const SPIV_TRIPLET &spiv_triplet ,
-				    string *site_labels , int *min_dists ,
+				    const int *site_types , int *min_dists ,
 				    int *max_dists ) {
 
-  // the distances are stored thus: site_labels[0] to site_labels[1]
+  // the distances are stored thus: site_types[0] to site_types[1]
   // dists min_dists[0] to max_dists[0], 1 to 2, min_dists[1], 2 to 0,
   // min_dists[2] but the sites won't necessarily be in the same order as
   // in the triplet, where dists_[0] is the longest dist, between 1 and 0,
   // dists_[2] is the shortest dist, between 1 and 2, and dists_[1] is the
   // other distance, between 0 and 2.  Need to deal with the 3 cyclic
   // permutations of this.
-  // if the corners correspond, then the spiv_triplet.site_labels_ correspond
+  // if the corners correspond, then the spiv_triplet site types correspond
   // to min_dists and max_dists in order 0 => 0, 1 => 2, 2 => 1.
 
-  if( ( site_labels[0] == "*" ||
-	spiv_triplet.site_labels_[0] == site_labels[0] ) &&
-      ( site_labels[1] == "*" ||
-	spiv_triplet.site_labels_[1] == site_labels[1] ) &&
-      ( site_labels[2] == "*" ||
-	spiv_triplet.site_labels_[2] == site_labels[2] ) &&
+  int trip_types[3] = { spiv_triplet_type( spiv_triplet.key_ , 0 ) ,
+			spiv_triplet_type( spiv_triplet.key_ , 1 ) ,
+			spiv_triplet_type( spiv_triplet.key_ , 2 ) };
+
+  if( ( -1 == site_types[0] ||
+	trip_types[0] == site_types[0] ) &&
+      ( -1 == site_types[1] ||
+	trip_types[1] == site_types[1] ) &&
+      ( -1 == site_types[2] ||
+	trip_types[2] == site_types[2] ) &&
       spiv_triplet.dists_[0] >= min_dists[0] &&
       spiv_triplet.dists_[0] <= max_dists[0] &&
       spiv_triplet.dists_[2] >= min_dists[1] &&
@@ -311,12 +446,12 @@ bool spiv_triplet_matches_criteria( const SPIV_TRIPLET &spiv_triplet ,
       spiv_triplet.dists_[1] <= max_dists[2] )
     return true;
 
-  if( ( site_labels[2] == "*" ||
-	spiv_triplet.site_labels_[0] == site_labels[2] ) &&
-      ( site_labels[0] == "*" ||
-	spiv_triplet.site_labels_[1] == site_labels[0] ) &&
-      ( site_labels[1] == "*" ||
-	spiv_triplet.site_labels_[2] == site_labels[1] ) &&
+  if( ( -1 == site_types[2] ||
+	trip_types[0] == site_types[2] ) &&
+      ( -1 == site_types[0] ||
+	trip_types[1] == site_types[0] ) &&
+      ( -1 == site_types[1] ||
+	trip_types[2] == site_types[1] ) &&
       spiv_triplet.dists_[0] >= min_dists[2] &&
       spiv_triplet.dists_[0] <= max_dists[2] &&
       spiv_triplet.dists_[2] >= min_dists[0] &&
@@ -325,12 +460,12 @@ bool spiv_triplet_matches_criteria( const SPIV_TRIPLET &spiv_triplet ,
       spiv_triplet.dists_[1] <= max_dists[1] )
     return true;
 
-  if( ( site_labels[1] == "*" ||
-	spiv_triplet.site_labels_[0] == site_labels[1] ) &&
-      ( site_labels[2] == "*" ||
-	spiv_triplet.site_labels_[1] == site_labels[2] ) &&
-      ( site_labels[0] == "*" ||
-	spiv_triplet.site_labels_[2] == site_labels[0] ) &&
+  if( ( -1 == site_types[1] ||
+	trip_types[0] == site_types[1] ) &&
+      ( -1 == site_types[2] ||
+	trip_types[1] == site_types[2] ) &&
+      ( -1 == site_types[0] ||
+	trip_types[2] == site_types[0] ) &&
       spiv_triplet.dists_[0] >= min_dists[1] &&
       spiv_triplet.dists_[0] <= max_dists[1] &&
       spiv_triplet.dists_[2] >= min_dists[2] &&
@@ -339,12 +474,12 @@ bool spiv_triplet_matches_criteria( const SPIV_TRIPLET &spiv_triplet ,
       spiv_triplet.dists_[1] <= max_dists[0] )
     return true;
 
-  if( ( site_labels[0] == "*" ||
-	spiv_triplet.site_labels_[0] == site_labels[0] ) &&
-      ( site_labels[2] == "*" ||
-	spiv_triplet.site_labels_[1] == site_labels[2] ) &&
-      ( site_labels[1] == "*" ||
-	spiv_triplet.site_labels_[2] == site_labels[1] ) &&
+  if( ( -1 == site_types[0] ||
+	trip_types[0] == site_types[0] ) &&
+      ( -1 == site_types[2] ||
+	trip_types[1] == site_types[2] ) &&
+      ( -1 == site_types[1] ||
+	trip_types[2] == site_types[1] ) &&
       spiv_triplet.dists_[0] >= min_dists[2] &&
       spiv_triplet.dists_[0] <= max_dists[2] &&
       spiv_triplet.dists_[2] >= min_dists[1] &&
@@ -353,12 +488,12 @@ bool spiv_triplet_matches_criteria( const SPIV_TRIPLET &spiv_triplet ,
       spiv_triplet.dists_[1] <= max_dists[0] )
     return true;
 
-  if( ( site_labels[2] == "*" ||
-	spiv_triplet.site_labels_[0] == site_labels[2] ) &&
-      ( site_labels[1] == "*" ||
-	spiv_triplet.site_labels_[1] == site_labels[1] ) &&
-      ( site_labels[0] == "*" ||
-	spiv_triplet.site_labels_[2] == site_labels[0] ) &&
+  if( ( -1 == site_types[2] ||
+	trip_types[0] == site_types[2] ) &&
+      ( -1 == site_types[1] ||
+	trip_types[1] == site_types[1] ) &&
+      ( -1 == site_types[0] ||
+	trip_types[2] == site_types[0] ) &&
       spiv_triplet.dists_[0] >= min_dists[1] &&
       spiv_triplet.dists_[0] <= max_dists[1] &&
       spiv_triplet.dists_[2] >= min_dists[0] &&
@@ -367,12 +502,12 @@ bool spiv_triplet_matches_criteria( const SPIV_TRIPLET &spiv_triplet ,
       spiv_triplet.dists_[1] <= max_dists[2] )
     return true;
 
-  if( ( site_labels[1] == "*" ||
-	spiv_triplet.site_labels_[0] == site_labels[1] ) &&
-      ( site_labels[0] == "*" ||
-	spiv_triplet.site_labels_[1] == site_labels[0] ) &&
-      ( site_labels[2] == "*" ||
-	spiv_triplet.site_labels_[2] == site_labels[2] ) &&
+  if( ( -1 == site_types[1] ||
+	trip_types[0] == site_types[1] ) &&
+      ( -1 == site_types[0] ||
+	trip_types[1] == site_types[0] ) &&
+      ( -1 == site_types[2] ||
+	trip_types[2] == site_types[2] ) &&
       spiv_triplet.dists_[0] >= min_dists[0] &&
       spiv_triplet.dists_[0] <= max_dists[0] &&
       spiv_triplet.dists_[2] >= min_dists[2] &&
@@ -390,7 +525,6 @@ SPIV_PAIR SpivMolecule::make_spiv_pair( int site1 , int site2 ) {
 
   SPIV_PAIR spiv_pair;
 
-  static ostringstream oss;
   // want the shortest distance between an atom in site i and another atom
   // in site j
   int shortest_dist = shortest_site_site_dist( site1 , site2 );
@@ -402,18 +536,49 @@ SPIV_PAIR SpivMolecule::make_spiv_pair( int site1 , int site2 ) {
 
   spiv_pair.site1_ = site1;
   spiv_pair.site2_ = site2;
-  spiv_pair.site_label1_ = pphore_site_labels_[spiv_pair.site1_];
-  spiv_pair.site_label2_ = pphore_site_labels_[spiv_pair.site2_];
   spiv_pair.dist_ = shortest_dist;
-  oss.str( "" );
-  oss << spiv_pair.site_label1_ << ":" << shortest_dist
-      << ":" << spiv_pair.site_label2_;
-  spiv_pair.label_ = oss.str();
+  spiv_pair.key_ = spiv_pair_key( pphore_site_types_[site1] ,
+				  pphore_site_types_[site2] , shortest_dist );
 
   return spiv_pair;
 
 }
 
+// ***********************************************************************
+string SpivMolecule::pphore_pair_label( const SPIV_PAIR &spiv_pair ) const {
+
+  return pphore_site_labels_[spiv_pair.site1_] + ":" +
+    boost::lexical_cast<string>( spiv_pair.dist_ ) + ":" +
+    pphore_site_labels_[spiv_pair.site2_];
+
+}
+
+// ***********************************************************************
+// the label is the 3 pair labels, shortest first. sites_[1] is at the
+// junction of the shortest and longest edges, sites_[0] the other end of the
+// shortest and sites_[2] the other end of the longest, so the middle edge
+// is sites_[0] to sites_[2]. Each pair label has the sites in order of
+// type, as in make_spiv_pair.
+string SpivMolecule::pphore_triplet_label( const SPIV_TRIPLET &spiv_triplet ) const {
+
+  static const int edge_ends[3][2] = { { 0 , 1 } , { 0 , 2 } , { 1 , 2 } };
+  string label;
+  for( int i = 0 ; i < 3 ; ++i ) {
+    SPIV_PAIR edge;
+    edge.site1_ = spiv_triplet.sites_[edge_ends[i][0]];
+    edge.site2_ = spiv_triplet.sites_[edge_ends[i][1]];
+    if( pphore_site_types_[edge.site1_] > pphore_site_types_[edge.site2_] )
+      std::swap( edge.site1_ , edge.site2_ );
+    edge.dist_ = spiv_triplet.dists_[i];
+    if( i )
+      label += "-";
+    label += pphore_pair_label( edge );
+  }
+
+  return label;
+
+}
+
 // ***********************************************************************
 void SpivMolecule::get_sites_atoms( const string &feature_name ,
 				    vector<unsigned int> &atoms1 ) const {
@@ -433,7 +598,7 @@ void SpivMolecule::get_pairs_atoms( const string &feature_name ,
 				    vector<unsigned int> &atoms2 ) const {
 
   for( int i = 0 , is = pphore_pairs_.size() ; i < is ; ++i ) {
-    if( feature_name == pphore_pairs_[i].label_ ) {
+    if( feature_name == pphore_pair_label( pphore_pairs_[i] ) ) {
       atoms1 = pphore_site_atoms_[pphore_pairs_[i].site1_];
       atoms2 = pphore_site_atoms_[pphore_pairs_[i].site2_];
       return;
@@ -449,7 +614,7 @@ void SpivMolecule::get_triplets_atoms( const string &feature_name ,
 				       vector<unsigned int> &atoms3 ) const {
   
   for( int i = 0 , is = pphore_triplets_.size() ; i < is ; ++i ) {
-    if( feature_name == pphore_triplets_[i].label_ ) {
+    if( feature_name == pphore_triplet_label( pphore_triplets_[i] ) ) {
       atoms1 = pphore_site_atoms_[pphore_triplets_[i].sites_[0]];
       atoms2 = pphore_site_atoms_[pphore_triplets_[i].sites_[1]];
       atoms3 = pphore_site_atoms_[pphore_triplets_[i].sites_[2]];
@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# file make_smg_golden.sh
+# agent
+# 17th October 2026
+#
+# Writes the golden files that test_smg_output.sh checks smg against, using
+# an smg built from the original code, before any of the speed-ups, with the
+# real OEChem. The sites, pairs and triplets bitstrings and the pairs labels
+# of the small test SMILES are made, each with its name decode file. Only
+# options the original smg had are used, so any smg from then on can make
+# them. Commit them in test_dir/smg_golden.
+#
+# make_smg_golden.sh <baseline_smg> <test_dir> <golden_dir>
+
+SMG=$1
+TEST_DIR=$2
+GOLDEN=$3
+SMG_ARGS="-sm $TEST_DIR/test.smt -po $TEST_DIR/test.points -mo $TEST_DIR/chembl_20_first_10000_small.smi"
+
+if [ -z "$GOLDEN" ]; then
+    echo "make_smg_golden.sh <baseline_smg> <test_dir> <golden_dir>"
+    exit 1
+fi
+mkdir -p $GOLDEN || exit 1
+
+for feat in sites pairs triplets; do
+    $SMG $SMG_ARGS -ou $GOLDEN/$feat.bits -$feat -b > /dev/null 2>&1 ||
+        { echo "smg -$feat -b failed" ; exit 1 ; }
+done
+$SMG $SMG_ARGS -ou $GOLDEN/pairs.labels -pa -l > /dev/null 2>&1 ||
+    { echo "smg -pa -l failed" ; exit 1 ; }
+
+echo "Golden files written to $GOLDEN."
+exit 0
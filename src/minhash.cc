@@ -0,0 +1,104 @@
+//
+// file minhash.cc
+// agent
+// 17th October 2026
+//
+// The MinHash and LSH functions. The hash functions are the feature hash
+// mixed with the number of the hash function by the splitmix64 finaliser,
+// which is cheap and mixes well enough that the functions behave as
+// independent.
+
+#include "minhash.H"
+
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// ***********************************************************************
+inline boost::uint64_t mix64( boost::uint64_t x ) {
+
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+
+}
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+void minhash_signature( const vector<unsigned int> &feat_hashes ,
+			unsigned int num_hashes ,
+			vector<boost::uint32_t> &signature ) {
+
+  signature.assign( num_hashes , MINHASH_EMPTY );
+  for( int i = 0 , is = feat_hashes.size() ; i < is ; ++i ) {
+    boost::uint64_t fh = feat_hashes[i];
+    for( unsigned int j = 0 ; j < num_hashes ; ++j ) {
+      boost::uint32_t h = mix64( ( boost::uint64_t( j + 1 ) << 32 ) | fh );
+      // keep MINHASH_EMPTY for molecules with no features
+      if( MINHASH_EMPTY == h ) {
+	--h;
+      }
+      if( h < signature[j] ) {
+	signature[j] = h;
+      }
+    }
+  }
+
+}
+
+// ***********************************************************************
+double minhash_similarity( const boost::uint32_t *sig1 ,
+			   const boost::uint32_t *sig2 ,
+			   unsigned int num_hashes ) {
+
+  if( minhash_is_empty( sig1 , num_hashes ) ||
+      minhash_is_empty( sig2 , num_hashes ) ) {
+    return 0.0;
+  }
+  unsigned int num_same = 0;
+  for( unsigned int i = 0 ; i < num_hashes ; ++i ) {
+    num_same += sig1[i] == sig2[i];
+  }
+  return double( num_same ) / double( num_hashes );
+
+}
+
+// ***********************************************************************
+boost::uint64_t minhash_band_hash( const boost::uint32_t *signature ,
+				   unsigned int band_num ,
+				   unsigned int rows_per_band ) {
+
+  const boost::uint32_t *band = signature + band_num * rows_per_band;
+  boost::uint64_t h = mix64( band_num + 1 );
+  for( unsigned int i = 0 ; i < rows_per_band ; ++i ) {
+    h = mix64( h ^ band[i] );
+  }
+  return h;
+
+}
+
+// ***********************************************************************
+void minhash_choose_bands( unsigned int num_hashes , double threshold ,
+			   unsigned int &num_bands ,
+			   unsigned int &rows_per_band ) {
+
+  num_bands = num_hashes;
+  rows_per_band = 1;
+  double best_diff = 2.0;
+  for( unsigned int r = 1 ; r <= num_hashes ; ++r ) {
+    unsigned int b = num_hashes / r;
+    double diff = fabs( pow( 1.0 / b , 1.0 / r ) - threshold );
+    if( diff < best_diff ) {
+      best_diff = diff;
+      num_bands = b;
+      rows_per_band = r;
+    }
+  }
+
+}
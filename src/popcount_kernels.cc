@@ -0,0 +1,242 @@
+//
+// file popcount_kernels.cc
+// agent
+// 17th October 2026
+//
+// The popcount kernels. The SIMD ones are compiled for their instruction
+// sets with target attributes rather than compiler flags, so the rest of
+// the program still runs on anything, and are only called if
+// __builtin_cpu_supports says the machine has the instructions.
+
+#include "popcount_kernels.H"
+
+#if defined( __x86_64__ ) && defined( __GNUC__ )
+#define DAC_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// ***********************************************************************
+// the usual bit-twiddling, for compilers and machines without popcnt
+inline unsigned int popcount64( boost::uint64_t x ) {
+
+  x = x - ( ( x >> 1 ) & 0x5555555555555555ULL );
+  x = ( x & 0x3333333333333333ULL ) + ( ( x >> 2 ) & 0x3333333333333333ULL );
+  x = ( x + ( x >> 4 ) ) & 0x0F0F0F0F0F0F0F0FULL;
+  return ( x * 0x0101010101010101ULL ) >> 56;
+
+}
+
+// ***********************************************************************
+unsigned int and_popcount_generic( const boost::uint64_t *a ,
+				   const boost::uint64_t *b ,
+				   unsigned int num_words ) {
+
+  unsigned int count = 0;
+  for( unsigned int i = 0 ; i < num_words ; ++i ) {
+    count += popcount64( a[i] & b[i] );
+  }
+  return count;
+
+}
+
+#ifdef DAC_X86_KERNELS
+
+// ***********************************************************************
+__attribute__(( target( "popcnt" ) ))
+unsigned int and_popcount_popcnt( const boost::uint64_t *a ,
+				  const boost::uint64_t *b ,
+				  unsigned int num_words ) {
+
+  // two counts so consecutive popcnts don't wait on each other
+  boost::uint64_t c0 = 0 , c1 = 0;
+  unsigned int i = 0;
+  for( ; i + 2 <= num_words ; i += 2 ) {
+    c0 += _mm_popcnt_u64( a[i] & b[i] );
+    c1 += _mm_popcnt_u64( a[i + 1] & b[i + 1] );
+  }
+  if( i < num_words ) {
+    c0 += _mm_popcnt_u64( a[i] & b[i] );
+  }
+  return c0 + c1;
+
+}
+
+// ***********************************************************************
+// AVX2 has no popcount, so look up the count of each nibble with a shuffle
+// and add the bytes up with sad against zero.
+__attribute__(( target( "avx2,popcnt" ) ))
+unsigned int and_popcount_avx2( const boost::uint64_t *a ,
+				const boost::uint64_t *b ,
+				unsigned int num_words ) {
+
+  const __m256i lookup = _mm256_setr_epi8( 0 , 1 , 1 , 2 , 1 , 2 , 2 , 3 ,
+					   1 , 2 , 2 , 3 , 2 , 3 , 3 , 4 ,
+					   0 , 1 , 1 , 2 , 1 , 2 , 2 , 3 ,
+					   1 , 2 , 2 , 3 , 2 , 3 , 3 , 4 );
+  const __m256i low_mask = _mm256_set1_epi8( 0x0f );
+  __m256i acc = _mm256_setzero_si256();
+  unsigned int i = 0;
+  for( ; i + 4 <= num_words ; i += 4 ) {
+    __m256i v = _mm256_and_si256( _mm256_loadu_si256( reinterpret_cast<const __m256i *>( a + i ) ) ,
+				  _mm256_loadu_si256( reinterpret_cast<const __m256i *>( b + i ) ) );
+    __m256i lo = _mm256_shuffle_epi8( lookup , _mm256_and_si256( v , low_mask ) );
+    __m256i hi = _mm256_shuffle_epi8( lookup ,
+				      _mm256_and_si256( _mm256_srli_epi16( v , 4 ) ,
+							low_mask ) );
+    acc = _mm256_add_epi64( acc , _mm256_sad_epu8( _mm256_add_epi8( lo , hi ) ,
+						   _mm256_setzero_si256() ) );
+  }
+  boost::uint64_t count = _mm256_extract_epi64( acc , 0 ) +
+    _mm256_extract_epi64( acc , 1 ) + _mm256_extract_epi64( acc , 2 ) +
+    _mm256_extract_epi64( acc , 3 );
+  for( ; i < num_words ; ++i ) {
+    count += _mm_popcnt_u64( a[i] & b[i] );
+  }
+  return count;
+
+}
+
+// ***********************************************************************
+__attribute__(( target( "avx512f,avx512vpopcntdq" ) ))
+unsigned int and_popcount_avx512( const boost::uint64_t *a ,
+				  const boost::uint64_t *b ,
+				  unsigned int num_words ) {
+
+  __m512i acc = _mm512_setzero_si512();
+  unsigned int i = 0;
+  for( ; i + 8 <= num_words ; i += 8 ) {
+    __m512i v = _mm512_and_si512( _mm512_loadu_si512( a + i ) ,
+				  _mm512_loadu_si512( b + i ) );
+    acc = _mm512_add_epi64( acc , _mm512_popcnt_epi64( v ) );
+  }
+  if( i < num_words ) {
+    // masked loads for the last few words, so nothing past the end is read
+    __mmask8 mask = ( 1U << ( num_words - i ) ) - 1;
+    __m512i v = _mm512_and_si512( _mm512_maskz_loadu_epi64( mask , a + i ) ,
+				  _mm512_maskz_loadu_epi64( mask , b + i ) );
+    acc = _mm512_add_epi64( acc , _mm512_popcnt_epi64( v ) );
+  }
+  // _mm512_reduce_add_epi64 sets off GCC 12's -Wuninitialized at -O2, so
+  // the lanes are added up by hand.
+  boost::uint64_t counts[8];
+  _mm512_storeu_si512( counts , acc );
+  boost::uint64_t count = 0;
+  for( int j = 0 ; j < 8 ; ++j ) {
+    count += counts[j];
+  }
+  return count;
+
+}
+
+#endif
+
+typedef struct {
+  const char *name_;
+  AndPopcountFunc func_;
+} KERNEL;
+
+// slowest first
+const KERNEL KERNELS[] = {
+  { "generic" , and_popcount_generic } ,
+#ifdef DAC_X86_KERNELS
+  { "popcnt" , and_popcount_popcnt } ,
+  { "avx2" , and_popcount_avx2 } ,
+  { "avx512" , and_popcount_avx512 } ,
+#endif
+};
+const int NUM_KERNELS = sizeof( KERNELS ) / sizeof( KERNEL );
+
+// ***********************************************************************
+bool kernel_supported( int kernel_num ) {
+
+#ifdef DAC_X86_KERNELS
+  __builtin_cpu_init();
+  string name( KERNELS[kernel_num].name_ );
+  if( "popcnt" == name ) {
+    return __builtin_cpu_supports( "popcnt" );
+  } else if( "avx2" == name ) {
+    return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "popcnt" );
+  } else if( "avx512" == name ) {
+    return __builtin_cpu_supports( "avx512f" ) &&
+      __builtin_cpu_supports( "avx512vpopcntdq" );
+  }
+#endif
+  return 0 == kernel_num;
+
+}
+
+// ***********************************************************************
+// the number of the best kernel this machine can run. It's a static in a
+// function so it's sorted out before anyone needs it, whatever the order
+// the statics of the different files are set up in.
+int &current_kernel() {
+
+  static int kernel_num = -1;
+  if( -1 == kernel_num ) {
+    kernel_num = 0;
+    for( int i = NUM_KERNELS - 1 ; i > 0 ; --i ) {
+      if( kernel_supported( i ) ) {
+	kernel_num = i;
+	break;
+      }
+    }
+  }
+  return kernel_num;
+
+}
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+AndPopcountFunc and_popcount_kernel() {
+
+  return KERNELS[current_kernel()].func_;
+
+}
+
+// ***********************************************************************
+const char *and_popcount_kernel_name() {
+
+  return KERNELS[current_kernel()].name_;
+
+}
+
+// ***********************************************************************
+bool select_and_popcount_kernel( const string &name ) {
+
+  for( int i = 0 ; i < NUM_KERNELS ; ++i ) {
+    if( name == KERNELS[i].name_ && kernel_supported( i ) ) {
+      current_kernel() = i;
+      return true;
+    }
+  }
+  return false;
+
+}
+
+// ***********************************************************************
+void available_and_popcount_kernels( vector<string> &names ) {
+
+  names.clear();
+  for( int i = 0 ; i < NUM_KERNELS ; ++i ) {
+    if( kernel_supported( i ) ) {
+      names.push_back( KERNELS[i].name_ );
+    }
+  }
+
+}
+
+// ***********************************************************************
+unsigned int popcount_words( const boost::uint64_t *a , unsigned int num_words ) {
+
+  unsigned int count = 0;
+  for( unsigned int i = 0 ; i < num_words ; ++i ) {
+    count += popcount64( a[i] );
+  }
+  return count;
+
+}
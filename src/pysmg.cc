@@ -0,0 +1,493 @@
+//
+// file pysmg.cc
+// agent
+// 17th October 2026
+//
+// The Python module pysmg, which makes smg fingerprints of SMILES with a
+// FingerprintGenerator, so they can be had in Python without running smg
+// and reading its output back in. It's written straight to the Python C API
+// so it doesn't need anything else to build.
+//
+//   import pysmg
+//   gen = pysmg.Generator( 'test.smt' , 'test.points' , features = 'pairs' ,
+//                          min_dist = 0 , max_dist = 100 , fold_bits = 0 )
+//   names , indptr , indices , columns = gen.csr( smiles , num_threads = 4 )
+//   names , bits = gen.packed( smiles , num_threads = 4 )
+//
+// smiles is a list of strings, each a SMILES optionally followed by a name.
+// Molecules without a name are called by their position in the list, from 1.
+// csr gives the features as a compressed sparse row matrix, indptr being
+// int64 and indices int32 column numbers, sorted within each row, and
+// columns the labels of the columns. Unfolded, the columns are the features
+// of the molecules in the call, in order of label as in smg's output, so
+// they're not the same from one call to the next; folded, they're the bits.
+// packed needs fold_bits, and gives a uint64 array of one row per molecule,
+// bit b of a row being bit b % 64 of word b / 64.
+// The arrays are read-only NumPy arrays on top of the vectors the C++ made,
+// so nothing's copied, or pysmg.Buffer objects, which have the buffer
+// protocol, if NumPy isn't there. The GIL is released while the
+// fingerprints are made, so several Python threads can use the same
+// Generator at once. A Generator can only be initialised once.
+
+#include <Python.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <oechem.h>
+
+#include "FingerprintGenerator.H"
+
+using namespace OEChem;
+using namespace std;
+
+namespace {
+
+// ***************************************************************************
+// pysmg.Buffer, which owns a vector made by the C++ and shows it to Python
+// through the buffer protocol.
+typedef struct {
+  PyObject_HEAD
+  void *vals_;
+  void ( *free_vals_ )( void * );
+  void *data_;
+  Py_ssize_t len_;
+  Py_ssize_t itemsize_;
+  char format_[2];
+  int ndim_;
+  Py_ssize_t shape_[2];
+  Py_ssize_t strides_[2];
+} SMG_BUFFER;
+
+// the types are made by PyInit_pysmg
+PyTypeObject *buffer_type = 0;
+
+// ***************************************************************************
+template <typename T> void delete_vector( void *vals ) {
+
+  delete static_cast<vector<T> *>( vals );
+
+}
+
+// ***************************************************************************
+// vals is swapped into the Buffer, so it's left empty. num_cols of 0 makes
+// a 1-dimensional buffer.
+template <typename T>
+PyObject *make_buffer( vector<T> &vals , char format , Py_ssize_t num_rows ,
+		       Py_ssize_t num_cols ) {
+
+  SMG_BUFFER *buf = PyObject_New( SMG_BUFFER , buffer_type );
+  if( !buf ) {
+    return 0;
+  }
+  vector<T> *buf_vals = new vector<T>;
+  buf_vals->swap( vals );
+  buf->vals_ = buf_vals;
+  buf->free_vals_ = &delete_vector<T>;
+  // an empty buffer still needs somewhere to point
+  buf->data_ = buf_vals->empty() ? static_cast<void *>( &buf->len_ ) :
+    static_cast<void *>( &( *buf_vals )[0] );
+  buf->len_ = buf_vals->size() * sizeof( T );
+  buf->itemsize_ = sizeof( T );
+  buf->format_[0] = format;
+  buf->format_[1] = '\0';
+  buf->ndim_ = num_cols ? 2 : 1;
+  buf->shape_[0] = num_rows;
+  buf->shape_[1] = num_cols;
+  buf->strides_[0] = num_cols ? num_cols * sizeof( T ) : sizeof( T );
+  buf->strides_[1] = sizeof( T );
+  return reinterpret_cast<PyObject *>( buf );
+
+}
+
+// ***************************************************************************
+void buffer_dealloc( PyObject *self ) {
+
+  SMG_BUFFER *buf = reinterpret_cast<SMG_BUFFER *>( self );
+  buf->free_vals_( buf->vals_ );
+  PyTypeObject *type = Py_TYPE( self );
+  PyObject_Del( self );
+  Py_DECREF( type );
+
+}
+
+// ***************************************************************************
+// The data's always C-contiguous, so any request can have it, except a
+// writable one. A request without PyBUF_FORMAT or PyBUF_ND gets plain
+// bytes, as from PyBuffer_FillInfo. Otherwise, itemsize is the size of the
+// real items even if the format isn't asked for, as the buffer protocol
+// says, and without PyBUF_ND the shape is left to be worked out from len
+// and itemsize.
+int buffer_getbuffer( PyObject *self , Py_buffer *view , int flags ) {
+
+  if( ( flags & PyBUF_WRITABLE ) == PyBUF_WRITABLE ) {
+    PyErr_SetString( PyExc_BufferError , "pysmg.Buffer is read-only." );
+    view->obj = 0;
+    return -1;
+  }
+  SMG_BUFFER *buf = reinterpret_cast<SMG_BUFFER *>( self );
+  if( !( flags & PyBUF_FORMAT ) && ( flags & PyBUF_ND ) != PyBUF_ND ) {
+    return PyBuffer_FillInfo( view , self , buf->data_ , buf->len_ , 1 ,
+			      flags );
+  }
+  view->obj = self;
+  Py_INCREF( self );
+  view->buf = buf->data_;
+  view->len = buf->len_;
+  view->readonly = 1;
+  view->itemsize = buf->itemsize_;
+  view->format = ( flags & PyBUF_FORMAT ) ? buf->format_ : 0;
+  if( ( flags & PyBUF_ND ) == PyBUF_ND ) {
+    view->ndim = buf->ndim_;
+    view->shape = buf->shape_;
+  } else {
+    view->ndim = 1;
+    view->shape = 0;
+  }
+  view->strides = ( flags & PyBUF_STRIDES ) == PyBUF_STRIDES ? buf->strides_ : 0;
+  view->suboffsets = 0;
+  view->internal = 0;
+  return 0;
+
+}
+
+PyType_Slot buffer_slots[] = {
+  { Py_tp_dealloc , reinterpret_cast<void *>( buffer_dealloc ) } ,
+  { Py_bf_getbuffer , reinterpret_cast<void *>( buffer_getbuffer ) } ,
+  { Py_tp_doc , const_cast<char *>( "Fingerprint data made by pysmg, with the"
+				    " buffer protocol." ) } ,
+  { 0 , 0 }
+};
+
+PyType_Spec buffer_spec = {
+  "pysmg.Buffer" , sizeof( SMG_BUFFER ) , 0 , Py_TPFLAGS_DEFAULT , buffer_slots
+};
+
+// ***************************************************************************
+// a NumPy array on top of buf, which it keeps hold of, or buf itself if
+// there's no NumPy. Takes the reference to buf.
+PyObject *as_array( PyObject *buf ) {
+
+  static PyObject *numpy_asarray = 0;
+  static bool tried_numpy = false;
+  if( !buf ) {
+    return 0;
+  }
+  if( !tried_numpy ) {
+    tried_numpy = true;
+    PyObject *numpy = PyImport_ImportModule( "numpy" );
+    if( numpy ) {
+      numpy_asarray = PyObject_GetAttrString( numpy , "asarray" );
+      Py_DECREF( numpy );
+    }
+    PyErr_Clear();
+  }
+  if( !numpy_asarray ) {
+    return buf;
+  }
+  PyObject *arr = PyObject_CallFunctionObjArgs( numpy_asarray , buf , NULL );
+  Py_DECREF( buf );
+  return arr;
+
+}
+
+// ***************************************************************************
+// pysmg.Generator
+typedef struct {
+  PyObject_HEAD
+  FingerprintGenerator *gen_;
+} SMG_GENERATOR;
+
+
+// ***************************************************************************
+void generator_dealloc( PyObject *self ) {
+
+  delete reinterpret_cast<SMG_GENERATOR *>( self )->gen_;
+  PyTypeObject *type = Py_TYPE( self );
+  type->tp_free( self );
+  Py_DECREF( type );
+
+}
+
+// ***************************************************************************
+int generator_init( PyObject *self , PyObject *args , PyObject *kwargs ) {
+
+  static const char *kwlist[] = { "smarts_file" , "points_file" , "features" ,
+				  "min_dist" , "max_dist" , "fold_bits" , 0 };
+  const char *smarts_file , *points_file , *features = "pairs";
+  int min_dist = 0 , max_dist = 100;
+  unsigned int fold_bits = 0;
+  if( !PyArg_ParseTupleAndKeywords( args , kwargs , "ss|siiI" ,
+				    const_cast<char **>( kwlist ) ,
+				    &smarts_file , &points_file , &features ,
+				    &min_dist , &max_dist , &fold_bits ) ) {
+    return -1;
+  }
+  SMG_OUTPUT_TYPE output_type = SMG_UNDEFINED;
+  if( string( "sites" ) == features ) {
+    output_type = SMG_SITES;
+  } else if( string( "pairs" ) == features ) {
+    output_type = SMG_PAIRS;
+  } else if( string( "triplets" ) == features ) {
+    output_type = SMG_TRIPLETS;
+  } else {
+    PyErr_SetString( PyExc_ValueError ,
+		     "features must be one of sites, pairs or triplets." );
+    return -1;
+  }
+
+  // another thread could be using the FingerprintGenerator with the GIL
+  // released, so it can't be replaced.
+  SMG_GENERATOR *gen = reinterpret_cast<SMG_GENERATOR *>( self );
+  if( gen->gen_ ) {
+    PyErr_SetString( PyExc_RuntimeError ,
+		     "Generator can only be initialised once." );
+    return -1;
+  }
+  try {
+    gen->gen_ = new FingerprintGenerator( smarts_file , points_file ,
+					  output_type , min_dist , max_dist ,
+					  fold_bits );
+  } catch( string &msg ) {
+    PyErr_SetString( PyExc_ValueError , msg.c_str() );
+    return -1;
+  }
+  return 0;
+
+}
+
+// ***************************************************************************
+// the SMILES and names from the list of strings
+bool read_smiles_list( PyObject *smiles_list , vector<string> &smiles ,
+		       vector<string> &names ) {
+
+  PyObject *seq = PySequence_Fast( smiles_list ,
+				   "smiles must be a list of strings." );
+  if( !seq ) {
+    return false;
+  }
+  for( Py_ssize_t i = 0 , is = PySequence_Fast_GET_SIZE( seq ) ; i < is ; ++i ) {
+    const char *line = PyUnicode_AsUTF8( PySequence_Fast_GET_ITEM( seq , i ) );
+    if( !line ) {
+      Py_DECREF( seq );
+      return false;
+    }
+    string str( line );
+    string::size_type smi_end = str.find_first_of( " \t" );
+    smiles.push_back( str.substr( 0 , smi_end ) );
+    string::size_type name_start = str.find_first_not_of( " \t" , smi_end );
+    if( string::npos == smi_end || string::npos == name_start ) {
+      names.push_back( boost::lexical_cast<string>( i + 1 ) );
+    } else {
+      names.push_back( str.substr( name_start ,
+				   str.find_last_not_of( " \t\r\n" ) - name_start + 1 ) );
+    }
+  }
+  Py_DECREF( seq );
+  return true;
+
+}
+
+// ***************************************************************************
+// the fingerprints of the molecules in the list of SMILES, with the GIL
+// released while they're made. Returns false with the Python error set if
+// it couldn't be done.
+bool make_fingerprints( PyObject *self , PyObject *args , PyObject *kwargs ,
+			SMG_CSR_FINGERPRINTS &fps ) {
+
+  static const char *kwlist[] = { "smiles" , "num_threads" , 0 };
+  PyObject *smiles_list;
+  int num_threads = 1;
+  if( !PyArg_ParseTupleAndKeywords( args , kwargs , "O|i" ,
+				    const_cast<char **>( kwlist ) ,
+				    &smiles_list , &num_threads ) ) {
+    return false;
+  }
+  FingerprintGenerator *gen = reinterpret_cast<SMG_GENERATOR *>( self )->gen_;
+  if( !gen ) {
+    PyErr_SetString( PyExc_RuntimeError , "Generator wasn't initialised." );
+    return false;
+  }
+  vector<string> smiles , names;
+  if( !read_smiles_list( smiles_list , smiles , names ) ) {
+    return false;
+  }
+
+  string error;
+  PyObject *error_type = PyExc_ValueError;
+  vector<OEMolBase *> mols;
+  Py_BEGIN_ALLOW_THREADS
+  for( int i = 0 , is = smiles.size() ; i < is ; ++i ) {
+    OEGraphMol *mol = new OEGraphMol;
+    mols.push_back( mol );
+    if( !OESmilesToMol( *mol , smiles[i] ) ) {
+      error = "Couldn't parse SMILES " + smiles[i] + " for " + names[i] + ".";
+      break;
+    }
+    mol->SetTitle( names[i] );
+  }
+  if( error.empty() ) {
+    try {
+      gen->generate( mols , num_threads , fps );
+    } catch( string &msg ) {
+      error = msg;
+      error_type = PyExc_RuntimeError;
+    }
+  }
+  for( int i = 0 , is = mols.size() ; i < is ; ++i ) {
+    delete mols[i];
+  }
+  Py_END_ALLOW_THREADS
+
+  if( !error.empty() ) {
+    PyErr_SetString( error_type , error.c_str() );
+    return false;
+  }
+  return true;
+
+}
+
+// ***************************************************************************
+PyObject *make_string_list( const vector<string> &names ) {
+
+  PyObject *list = PyList_New( names.size() );
+  if( !list ) {
+    return 0;
+  }
+  for( int i = 0 , is = names.size() ; i < is ; ++i ) {
+    PyObject *name = PyUnicode_FromString( names[i].c_str() );
+    if( !name ) {
+      Py_DECREF( list );
+      return 0;
+    }
+    PyList_SET_ITEM( list , i , name );
+  }
+  return list;
+
+}
+
+// ***************************************************************************
+PyObject *generator_csr( PyObject *self , PyObject *args , PyObject *kwargs ) {
+
+  SMG_CSR_FINGERPRINTS fps;
+  if( !make_fingerprints( self , args , kwargs , fps ) ) {
+    return 0;
+  }
+  FingerprintGenerator *gen = reinterpret_cast<SMG_GENERATOR *>( self )->gen_;
+  vector<boost::int32_t> col_indices;
+  vector<string> col_labels;
+  Py_BEGIN_ALLOW_THREADS
+  gen->columns( fps , col_indices , col_labels );
+  Py_END_ALLOW_THREADS
+
+  PyObject *names = make_string_list( fps.mol_names_ );
+  PyObject *columns = make_string_list( col_labels );
+  Py_ssize_t num_indptr = fps.indptr_.size() , num_indices = col_indices.size();
+  PyObject *indptr = as_array( make_buffer( fps.indptr_ , 'q' , num_indptr , 0 ) );
+  PyObject *indices = as_array( make_buffer( col_indices , 'i' , num_indices ,
+					     0 ) );
+  if( !names || !columns || !indptr || !indices ) {
+    Py_XDECREF( names );
+    Py_XDECREF( columns );
+    Py_XDECREF( indptr );
+    Py_XDECREF( indices );
+    return 0;
+  }
+  return Py_BuildValue( "(NNNN)" , names , indptr , indices , columns );
+
+}
+
+// ***************************************************************************
+PyObject *generator_packed( PyObject *self , PyObject *args ,
+			    PyObject *kwargs ) {
+
+  FingerprintGenerator *gen = reinterpret_cast<SMG_GENERATOR *>( self )->gen_;
+  if( gen && !gen->fold_bits() ) {
+    PyErr_SetString( PyExc_ValueError ,
+		     "packed needs the Generator to have fold_bits." );
+    return 0;
+  }
+  SMG_CSR_FINGERPRINTS fps;
+  if( !make_fingerprints( self , args , kwargs , fps ) ) {
+    return 0;
+  }
+  Py_ssize_t num_rows = fps.mol_names_.size();
+  Py_ssize_t num_words = ( gen->fold_bits() + 63 ) / 64;
+  vector<boost::uint64_t> bits( num_rows * num_words , 0 );
+  for( Py_ssize_t i = 0 ; i < num_rows ; ++i ) {
+    boost::uint64_t *row = bits.empty() ? 0 : &bits[0] + i * num_words;
+    for( boost::int64_t j = fps.indptr_[i] ; j < fps.indptr_[i + 1] ; ++j ) {
+      row[fps.indices_[j] / 64] |= boost::uint64_t( 1 ) << ( fps.indices_[j] % 64 );
+    }
+  }
+  PyObject *names = make_string_list( fps.mol_names_ );
+  PyObject *arr = as_array( make_buffer( bits , 'Q' , num_rows , num_words ) );
+  if( !names || !arr ) {
+    Py_XDECREF( names );
+    Py_XDECREF( arr );
+    return 0;
+  }
+  return Py_BuildValue( "(NN)" , names , arr );
+
+}
+
+// the keyword methods go through void (*)() to keep -Wcast-function-type
+// quiet.
+PyMethodDef generator_methods[] = {
+  { "csr" , reinterpret_cast<PyCFunction>(
+      reinterpret_cast<void (*)()>( generator_csr ) ) ,
+    METH_VARARGS | METH_KEYWORDS ,
+    "csr(smiles, num_threads=1) -> (names, indptr, indices, columns)" } ,
+  { "packed" , reinterpret_cast<PyCFunction>(
+      reinterpret_cast<void (*)()>( generator_packed ) ) ,
+    METH_VARARGS | METH_KEYWORDS ,
+    "packed(smiles, num_threads=1) -> (names, bits)" } ,
+  { 0 , 0 , 0 , 0 }
+};
+
+PyType_Slot generator_slots[] = {
+  { Py_tp_dealloc , reinterpret_cast<void *>( generator_dealloc ) } ,
+  { Py_tp_init , reinterpret_cast<void *>( generator_init ) } ,
+  { Py_tp_new , reinterpret_cast<void *>( PyType_GenericNew ) } ,
+  { Py_tp_methods , generator_methods } ,
+  { Py_tp_doc , const_cast<char *>( "Generator(smarts_file, points_file,"
+				    " features='pairs', min_dist=0,"
+				    " max_dist=100, fold_bits=0)" ) } ,
+  { 0 , 0 }
+};
+
+PyType_Spec generator_spec = {
+  "pysmg.Generator" , sizeof( SMG_GENERATOR ) , 0 , Py_TPFLAGS_DEFAULT ,
+  generator_slots
+};
+
+PyModuleDef pysmg_module = {
+  PyModuleDef_HEAD_INIT , "pysmg" ,
+  "smg fingerprints of SMILES, as NumPy arrays." , -1 , 0 , 0 , 0 , 0 , 0
+};
+
+} // end of anonymous namespace
+
+// ***************************************************************************
+PyMODINIT_FUNC PyInit_pysmg() {
+
+  buffer_type = reinterpret_cast<PyTypeObject *>( PyType_FromSpec( &buffer_spec ) );
+  PyObject *generator_type = PyType_FromSpec( &generator_spec );
+  if( !buffer_type || !generator_type ) {
+    return 0;
+  }
+
+  PyObject *module = PyModule_Create( &pysmg_module );
+  if( !module ) {
+    return 0;
+  }
+  Py_INCREF( buffer_type );
+  PyModule_AddObject( module , "Buffer" ,
+		      reinterpret_cast<PyObject *>( buffer_type ) );
+  PyModule_AddObject( module , "Generator" , generator_type );
+  return module;
+
+}
@@ -0,0 +1,78 @@
+//
+// file serve_frames.cc
+// agent
+// 17th October 2026
+//
+// Implementation of the smg -serve frame functions.
+
+#include "serve_frames.H"
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// ***********************************************************************
+bool read_all( int fd , char *buf , size_t len ) {
+
+  while( len ) {
+    ssize_t n = read( fd , buf , len );
+    if( n < 0 && EINTR == errno ) {
+      continue;
+    }
+    if( n <= 0 ) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+
+}
+
+// ***********************************************************************
+// MSG_NOSIGNAL so a peer that's gone away doesn't kill the program with
+// SIGPIPE.
+bool write_all( int fd , const char *buf , size_t len ) {
+
+  while( len ) {
+    ssize_t n = send( fd , buf , len , MSG_NOSIGNAL );
+    if( n < 0 && EINTR == errno ) {
+      continue;
+    }
+    if( n <= 0 ) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+
+}
+
+} // end of anonymous namespace
+
+// ***********************************************************************
+bool read_serve_frame( int fd , string &frame ) {
+
+  boost::uint32_t len;
+  if( !read_all( fd , reinterpret_cast<char *>( &len ) , sizeof( len ) ) ||
+      len > MAX_SERVE_FRAME_SIZE ) {
+    return false;
+  }
+  frame.resize( len );
+  return !len || read_all( fd , &frame[0] , len );
+
+}
+
+// ***********************************************************************
+bool write_serve_frame( int fd , const string &frame ) {
+
+  boost::uint32_t len = frame.length();
+  return write_all( fd , reinterpret_cast<const char *>( &len ) , sizeof( len ) ) &&
+    write_all( fd , frame.data() , frame.length() );
+
+}
@@ -0,0 +1,137 @@
+//
+// file smarts_atom_expr.cc
+// agent
+// 17th October 2026
+//
+// Functions for picking apart the expression inside a SMARTS atom.
+
+#include "smarts_atom_expr.H"
+
+#include <cctype>
+
+using namespace std;
+
+// ***********************************************************************
+bool is_single_atom_smarts( const string &smarts ) {
+
+  if( smarts.length() < 3 || '[' != smarts[0] ) {
+    return false;
+  }
+  int depth = 0;
+  for( size_t i = 0 , is = smarts.length() ; i < is ; ++i ) {
+    if( '[' == smarts[i] || '(' == smarts[i] ) {
+      ++depth;
+    } else if( ']' == smarts[i] || ')' == smarts[i] ) {
+      --depth;
+      if( !depth ) {
+	return i == is - 1;
+      }
+    }
+  }
+  return false;
+
+}
+
+// ***********************************************************************
+bool is_binding_name_char( char c ) {
+
+  return isalnum( c ) || '_' == c;
+
+}
+
+// ***********************************************************************
+int add_expr_node( char op , int left , int right , size_t start ,
+		   size_t end , vector<ATOM_EXPR_NODE> &nodes ) {
+
+  ATOM_EXPR_NODE node;
+  node.op_ = op;
+  node.left_ = left;
+  node.right_ = right;
+  node.start_ = start;
+  node.end_ = end;
+  node.has_ref_ = ( -1 != left && nodes[left].has_ref_ ) ||
+    ( -1 != right && nodes[right].has_ref_ );
+  nodes.push_back( node );
+  return nodes.size() - 1;
+
+}
+
+// ***********************************************************************
+// recursive descent parse of the expression inside a SMARTS atom, by level
+// of operator precedence - 0 for ';', 1 for ',', 2 for '&' or nothing, 3 for
+// '!'. Returns the index of the node for the expression, or -1 if it's not
+// understood.
+int parse_smarts_atom_expr( const string &expr , size_t &pos , int level ,
+		     vector<ATOM_EXPR_NODE> &nodes ) {
+
+  size_t start = pos;
+  if( 3 == level ) {
+    if( pos == expr.length() ) {
+      return -1;
+    }
+    if( '!' == expr[pos] ) {
+      ++pos;
+      int left = parse_smarts_atom_expr( expr , pos , 3 , nodes );
+      if( -1 == left ) {
+	return -1;
+      }
+      return add_expr_node( '!' , left , -1 , start , pos , nodes );
+    }
+    if( '$' == expr[pos] && pos + 1 < expr.length() && '(' == expr[pos+1] ) {
+      // recursive SMARTS, which OEChem can do, once any bindings in it
+      // have been expanded.
+      int depth = 0;
+      for( ++pos ; pos < expr.length() ; ++pos ) {
+	if( '(' == expr[pos] ) {
+	  ++depth;
+	} else if( ')' == expr[pos] && !--depth ) {
+	  break;
+	}
+      }
+      if( pos == expr.length() ) {
+	return -1;
+      }
+      ++pos;
+      return add_expr_node( 'P' , -1 , -1 , start , pos , nodes );
+    }
+    if( '$' == expr[pos] ) {
+      for( ++pos ; pos < expr.length() && is_binding_name_char( expr[pos] ) ;
+	   ++pos ) ;
+      if( pos == start + 1 ) {
+	return -1;
+      }
+      int node = add_expr_node( '$' , -1 , -1 , start , pos , nodes );
+      nodes[node].ref_ = expr.substr( start + 1 , pos - start - 1 );
+      nodes[node].has_ref_ = true;
+      return node;
+    }
+    while( pos < expr.length() && string::npos == string( ";,&!$" ).find( expr[pos] ) ) {
+      ++pos;
+    }
+    if( pos == start ) {
+      return -1;
+    }
+    return add_expr_node( 'P' , -1 , -1 , start , pos , nodes );
+  }
+
+  int left = parse_smarts_atom_expr( expr , pos , level + 1 , nodes );
+  while( -1 != left && pos < expr.length() ) {
+    char op = expr[pos];
+    if( 2 == level && ( '!' == op || '$' == op ) ) {
+      op = '&'; // implicit high-precedence and, e.g. N$SP3
+    } else if( ( 0 == level && ';' == op ) || ( 1 == level && ',' == op ) ||
+	       ( 2 == level && '&' == op ) ) {
+      ++pos;
+    } else {
+      break;
+    }
+    int right = parse_smarts_atom_expr( expr , pos , level + 1 , nodes );
+    if( -1 == right ) {
+      return -1;
+    }
+    left = add_expr_node( op , left , right , start , pos , nodes );
+  }
+  return left;
+
+}
+
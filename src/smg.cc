@@ -13,35 +13,39 @@
 #include <set>
 #include <string>
 
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include "AtomTyper.H"
+#include "BinaryBitsFile.H"
+#include "CompressedOFStream.H"
+#include "FeatureDictionary.H"
+#include "FeatureSpillFile.H"
 #include "FileExceptions.H"
+#include "MinHashFile.H"
+#include "MoleculePipeline.H"
 #include "SMARTSExceptions.H"
 #include "PharmPoint.H"
+#include "SmgProfile.H"
+#include "SmgServer.H"
 #include "SpivMolecule.H"
+#include "smg_features.H"
+#include "sparse_bits_output.H"
 #include "spiv_nogr_bits.H"
 
 using namespace boost;
 using namespace std;
 
-typedef enum { SMG_UNDEFINED , SMG_SITES , SMG_PAIRS ,
-	       SMG_TRIPLETS } SMG_OUTPUT_TYPE;
-typedef enum { SMG_BITSTRINGS , SMG_LABELS } SMG_OUTPUT_FORMAT;
+typedef enum { SMG_BITSTRINGS , SMG_LABELS , SMG_BINARY , SMG_LIBSVM ,
+	       SMG_CSR , SMG_NPZ , SMG_MINHASH } SMG_OUTPUT_FORMAT;
 
 namespace DACLIB {
   void read_smarts_file( const string &smarts_file ,
 			 vector<pair<string,string> > &input_smarts ,
 			 vector<pair<string,string> > &smarts_sub_defn );
-  void apply_daylight_aromatic_model( OEMolBase &mol );
 }
 
-// in spiv_nogr_bits.cc
-void build_short_feature_names( const map<string,int> &uniq_names ,
-				int min_occur , char feat_label ,
-				vector<pair<string,string> > &short_names );
-string hash_feature_name( const string &fn );
-
 extern string BUILD_TIME; // in build_time.cc
 
 // ***************************************************************************
@@ -57,9 +61,28 @@ void print_usage( ostream &os ) {
      << "    [-a[wk] <int>]" << endl
      << "    [-or[c] <int>]"
      << "    [-mi[n_dist] <int>]"
-     << "    [-ma[x_dist] <int>]" << endl
+     << "    [-ma[x_dist] <int>] (0 to " << SPIV_MAX_DIST - 1 << ", default 100)"
+     << endl
+     << "    [-th[reads] <int>]" << endl
      << "    [-b[itstrings]]" << endl
-     << "    [-l[abels]]" << endl;
+     << "    [-l[abels]]" << endl
+     << "    [-output_fo[rmat] <bitstrings|labels|binary|libsvm|csr|npz|minhash>]" << endl
+     << "    [-wr[ite_vocab] <string>]" << endl
+     << "    [-re[ad_vocab] <string>]" << endl
+     << "    [-fo[ld] <int>]" << endl
+     << "    [-nu[m_hashes] <int>]" << endl
+     << "    [-ser[ve] <string>]" << endl
+     << "    [-pr[ofile] <string>]" << endl
+     << "With -serve, smg listens on the Unix socket given for batches of SMILES"
+     << " instead" << endl
+     << "of reading -molecule_file, and -output_file isn't needed. See SmgServer.H"
+     << " for" << endl
+     << "the protocol." << endl
+     << "With -profile, the times taken by each stage and each SMARTS pattern,"
+     << " the" << endl
+     << "numbers of sites, pairs and triplets and the peak memory use are"
+     << " written to" << endl
+     << "the file given as JSON at the end of the run." << endl;
 
 }
 
@@ -68,7 +91,11 @@ void parse_args( int argc , char **argv , string &mol_filename ,
 		 string &smarts_filename , string &points_filename ,
 		 string &output_filename , SMG_OUTPUT_TYPE &output_type ,
 		 SMG_OUTPUT_FORMAT &output_format ,
-		 int &min_occur , int &min_dist , int &max_dist ) {
+		 int &min_occur , int &min_dist , int &max_dist ,
+		 int &num_threads , string &read_vocab_filename ,
+		 string &write_vocab_filename , unsigned int &fold_bits ,
+		 unsigned int &num_hashes , string &serve_socket ,
+		 string &profile_filename ) {
 
   if( 1 == argc ) {
     print_usage( cout );
@@ -79,9 +106,88 @@ void parse_args( int argc , char **argv , string &mol_filename ,
   min_occur = -1;
   min_dist = 0;
   max_dist = 100;
+  num_threads = 1;
+  fold_bits = 0;
+  num_hashes = 128;
 
   for( int i = 1 ; i < argc ; ++i ) {
-    if( !strncmp( argv[i] , "-molecule_file" , 3 ) ) {
+    // this one first, as -ou is -output_file
+    if( !strncmp( argv[i] , "-output_format" , 10 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-output_format requires a second argument.";
+	exit( 1 );
+      }
+      if( !strcmp( argv[i] , "bitstrings" ) ) {
+	output_format = SMG_BITSTRINGS;
+      } else if( !strcmp( argv[i] , "labels" ) ) {
+	output_format = SMG_LABELS;
+      } else if( !strcmp( argv[i] , "binary" ) ) {
+	output_format = SMG_BINARY;
+      } else if( !strcmp( argv[i] , "libsvm" ) ) {
+	output_format = SMG_LIBSVM;
+      } else if( !strcmp( argv[i] , "csr" ) ) {
+	output_format = SMG_CSR;
+      } else if( !strcmp( argv[i] , "npz" ) ) {
+	output_format = SMG_NPZ;
+      } else if( !strcmp( argv[i] , "minhash" ) ) {
+	output_format = SMG_MINHASH;
+      } else {
+	cerr << "-output_format must be one of bitstrings, labels, binary,"
+	     << " libsvm, csr, npz or minhash." << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-fold" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-fold requires a second argument.";
+	exit( 1 );
+      }
+      int fb = 0;
+      try {
+	fb = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-fold requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( fb < 1 ) {
+	cerr << "-fold requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+      fold_bits = fb;
+    } else if( !strncmp( argv[i] , "-num_hashes" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-num_hashes requires a second argument.";
+	exit( 1 );
+      }
+      int nh = 0;
+      try {
+	nh = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-num_hashes requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( nh < 1 ) {
+	cerr << "-num_hashes requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+      num_hashes = nh;
+    } else if( !strncmp( argv[i] , "-write_vocab" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-write_vocab requires a second argument.";
+	exit( 1 );
+      }
+      write_vocab_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-read_vocab" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-read_vocab requires a second argument.";
+	exit( 1 );
+      }
+      read_vocab_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-molecule_file" , 3 ) ) {
       ++i;
       if( i == argc ) {
 	cerr << "-molecule_file requires a second argument.";
@@ -157,6 +263,44 @@ void parse_args( int argc , char **argv , string &mol_filename ,
 	cerr << "-max_dist requires an integer argument." << endl;
 	exit( 1 );
       }
+      // the distances have SPIV_DIST_BITS in the feature keys, and there's no
+      // longer a way of asking for no distances at all with a -ve max_dist.
+      if( max_dist < 0 || max_dist >= SPIV_MAX_DIST ) {
+	cerr << "-max_dist must be from 0 to " << SPIV_MAX_DIST - 1 << "."
+	     << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-threads" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-threads requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	num_threads = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-threads requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( num_threads < 1 ) {
+	cerr << "-threads requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-serve" , 4 ) ||
+	       !strcmp( argv[i] , "--serve" ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-serve requires a second argument.";
+	exit( 1 );
+      }
+      serve_socket = argv[i];
+    } else if( !strncmp( argv[i] , "-profile" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-profile requires a second argument.";
+	exit( 1 );
+      }
+      profile_filename = argv[i];
     } else if( !strncmp( argv[i] , "-help" , 2 ) ) {
       print_usage( cout );
       exit( 0 );
@@ -173,7 +317,7 @@ void parse_args( int argc , char **argv , string &mol_filename ,
     }
   }
 
-  if( mol_filename.empty() ) {
+  if( mol_filename.empty() && serve_socket.empty() ) {
     cerr << "No molecule file specfied." << endl;
     print_usage( cerr );
     exit( 1 );
@@ -188,16 +332,80 @@ void parse_args( int argc , char **argv , string &mol_filename ,
     print_usage( cerr );
     exit( 1 );
   }
-  if( output_filename.empty() ) {
+  if( output_filename.empty() && serve_socket.empty() ) {
     cerr << "No output file specfied." << endl;
     print_usage( cerr );
     exit( 1 );
   }
+  if( CompressedStreamBuf::is_zstd_name( output_filename ) &&
+      !CompressedStreamBuf::have_zstd() ) {
+    cerr << "This smg was built without zstd support, so can't write "
+	 << output_filename << "." << endl;
+    exit( 1 );
+  }
+  // these are binary files, written as they are
+  if( CompressedStreamBuf::is_compressed_name( output_filename ) &&
+      ( SMG_BINARY == output_format || SMG_CSR == output_format ||
+	SMG_NPZ == output_format || SMG_MINHASH == output_format ) ) {
+    cerr << "Binary, csr, npz and minhash output can't be compressed, so the"
+	 << " output file can't end in .gz or .zst." << endl;
+    exit( 1 );
+  }
   if( SMG_UNDEFINED == output_type ) {
     cerr << "No output format specified (sites, pairs or triplets)." << endl;
     print_usage( cerr );
     exit( 1 );
   }
+  // folded fingerprints are streamed out as they come, so only go in the
+  // fixed width formats, and have no vocabulary.
+  if( fold_bits ) {
+    if( SMG_BITSTRINGS != output_format && SMG_BINARY != output_format ) {
+      cerr << "-fold can only be used with bitstrings or binary output." << endl;
+      exit( 1 );
+    }
+    if( !read_vocab_filename.empty() || !write_vocab_filename.empty() ) {
+      cerr << "-fold can't be used with -read_vocab or -write_vocab." << endl;
+      exit( 1 );
+    }
+    // every bit is written, so there's nothing for them to leave out
+    if( -1 != min_occur ) {
+      cerr << "-fold can't be used with -awk or -orc." << endl;
+      exit( 1 );
+    }
+  }
+  // the server only sends labels and bits back, and doesn't add to the
+  // dictionary.
+  if( !serve_socket.empty() ) {
+    if( SMG_MINHASH == output_format ) {
+      cerr << "-serve can't be used with minhash output." << endl;
+      exit( 1 );
+    }
+    if( !write_vocab_filename.empty() ) {
+      cerr << "-serve can't be used with -write_vocab." << endl;
+      exit( 1 );
+    }
+    if( !profile_filename.empty() ) {
+      cerr << "-serve can't be used with -profile." << endl;
+      exit( 1 );
+    }
+  }
+  // MinHash signatures are made from the feature labels as they come, so
+  // there's no vocabulary and nothing to fold.
+  if( SMG_MINHASH == output_format ) {
+    if( fold_bits ) {
+      cerr << "-fold can't be used with minhash output." << endl;
+      exit( 1 );
+    }
+    if( !read_vocab_filename.empty() || !write_vocab_filename.empty() ) {
+      cerr << "minhash output can't be used with -read_vocab or -write_vocab."
+	   << endl;
+      exit( 1 );
+    }
+    if( min_occur > 1 ) {
+      cerr << "-awk/-orc can't be used with minhash output." << endl;
+      exit( 1 );
+    }
+  }
 
 }
 
@@ -222,107 +430,88 @@ void read_molecules( const string &mol_filename ,
 }
 
 // ***************************************************************************
-void write_feature_bits( char feat_label , const string &output_filename ,
-			 const vector<vector<string> > &feature_names ,
-			 int min_occur , SMG_OUTPUT_FORMAT output_format ,
-			 map<string,int> &uniq_names ) {
-
-  // build a list of unique names for the features found, with a count of each
-  build_unique_names( feature_names , uniq_names );
-
-  // build the short names from the unique names for the feature types, using
-  // SuperFastHash, warning of any collisions. Only do it for this names that
-  // match the min_occur criterion, as they'll be the only ones we're using.
-  // The returned vector has the short name first in each pair, the long name
-  // second.
-  vector<pair<string,string> > short_names;
-  build_short_feature_names( uniq_names , min_occur , feat_label , short_names );
-
-  // write a file that decodes the bit headings, so as not to have the headings
-  // unfeasibly long. Do this by generating hash codes. This may not give
-  // unique names, so need to warn of collisions.
-  string decode_filename = output_filename + ".name_decode";
-  write_name_decode_file( decode_filename , feat_label , short_names );
-
-#ifdef NOTYET  
-  for( s = uniq_names.begin() , ss = uniq_names.end() ; s != ss ; ++s )
-    cout << s->first << " : " << s->second << endl;
-#endif
-
-  if( output_format == SMG_BITSTRINGS ) {
-    write_bits_file( output_filename , feat_label , short_names , feature_names );
-  } else if( output_format == SMG_LABELS ) {
-    write_labels_file( output_filename , feat_label , short_names ,
-		       feature_names );
-  }
-
-}
-      
-// ***************************************************************************
-void extract_feature_names( SpivMolecule &mol , SMG_OUTPUT_TYPE output_type ,
-			    int min_dist , int max_dist ,
-			    vector<string> &feat_names ) {
-
-  feat_names.push_back( mol.GetTitle() );
-  if( SMG_SITES == output_type ) {
-    feat_names.insert( feat_names.end() ,
-		       mol.pphore_site_labels().begin() ,
-		       mol.pphore_site_labels().end() );
-  } else if( SMG_PAIRS == output_type ) {
-    const vector<SPIV_PAIR> &pairs = mol.pphore_pairs();
-    for( int j = 0 , js = pairs.size() ; j < js ; ++j ) {
-      if( pairs[j].dist_ >= min_dist && pairs[j].dist_ <= max_dist ) {
-	feat_names.push_back( pairs[j].label_ );
-      }
-    }
-  } else if( SMG_TRIPLETS == output_type ) {
-    const vector<SPIV_TRIPLET> &trips = mol.pphore_triplets();
-    for( int j = 0 , js = trips.size() ; j < js ; ++j ) {
-      if( trips[j].dists_[0] >= min_dist && trips[j].dists_[0] <= max_dist &&
-	  trips[j].dists_[1] >= min_dist && trips[j].dists_[1] <= max_dist &&
-	  trips[j].dists_[2] >= min_dist && trips[j].dists_[2] <= max_dist ) {
-	feat_names.push_back( trips[j].label_ );
-      }
-    }
-  }
-
-  // first entry is the molecule name, which needs to stay put
-  sort( feat_names.begin() + 1 , feat_names.end() );
-  feat_names.erase( unique( feat_names.begin() + 1 , feat_names.end() ) ,
-		    feat_names.end() );
+// work out the columns of the output, the features that pass min_occur, and
+// write the file that decodes their headings, so as not to have the headings
+// unfeasibly long. Do this by generating hash codes. This may not give
+// unique names, so need to warn of collisions.
+void write_output_decode( SMG_OUTPUT_TYPE output_type ,
+			  const string &output_filename ,
+			  const FeatureDictionary &feat_dict , int min_occur ,
+			  vector<unsigned int> &col_ids ) {
+
+  char feat_label = feature_label( output_type );
+  feat_dict.column_ids( min_occur , col_ids );
+  feat_dict.report_collisions( col_ids , feat_label );
+
+  string decode_filename = CompressedStreamBuf::part_name( output_filename ,
+							       ".name_decode" );
+  write_name_decode_file( decode_filename , feat_label , feat_dict , col_ids );
 
 }
 
 // ***************************************************************************
-void write_output( SMG_OUTPUT_FORMAT output_format ,
-		   SMG_OUTPUT_TYPE output_type ,
-		   const string &output_filename ,
-		   const vector<vector<string> > &feature_names ,
-		   int min_occur ,
-		   map<string,int> &unique_names ) {
-
-  if( SMG_SITES == output_type ) {
-    write_feature_bits( 'S' , output_filename , feature_names , min_occur ,
-			output_format , unique_names );
-    
-  } else if( SMG_PAIRS == output_type ) {
-    write_feature_bits( 'P' , output_filename , feature_names , min_occur ,
-			output_format , unique_names );
-  } else if( SMG_TRIPLETS == output_type ) {
-    write_feature_bits( 'T' , output_filename , feature_names , min_occur ,
-			output_format , unique_names );
+// second pass for bitstrings, in any of the formats, or for labels if
+// min_occur means they can't be streamed, making them from the spill file
+// once all the features are known.
+void write_spilled_bits( SMG_OUTPUT_TYPE output_type ,
+			 SMG_OUTPUT_FORMAT output_format ,
+			 const string &output_filename ,
+			 const FeatureDictionary &feat_dict , int min_occur ,
+			 FeatureSpillFile &spill_file , int num_threads ) {
+
+  char feat_label = feature_label( output_type );
+  vector<unsigned int> col_ids;
+  write_output_decode( output_type , output_filename , feat_dict , min_occur ,
+		       col_ids );
+
+  if( SMG_LABELS == output_format ) {
+    write_labels_file( output_filename , feat_label , feat_dict , col_ids ,
+		       spill_file );
+  } else if( SMG_BINARY == output_format ) {
+    write_binary_bits_file( output_filename , feat_label , feat_dict , col_ids ,
+			    spill_file );
+  } else if( SMG_LIBSVM == output_format ) {
+    write_libsvm_file( output_filename , feat_dict , col_ids , spill_file );
+  } else if( SMG_CSR == output_format ) {
+    write_csr_npy_files( output_filename , feat_dict , col_ids , spill_file );
+  } else if( SMG_NPZ == output_format ) {
+    write_csr_npz_file( output_filename , feat_dict , col_ids , spill_file );
+  } else {
+    write_bits_file( output_filename , feat_label , feat_dict , col_ids ,
+		     spill_file , num_threads );
   }
 
 }
 
 // ***************************************************************************
-// final check of unique_names for the defitive collision check. We're not
-// interested in the final answer, just what appears along the way.
-void check_hash_collisions( const map<string,int> &unique_names ) {
-
-  vector<pair<string,string> > short_names;
-  cout << "Final check of collisions in all bit label names." << endl;
-  build_short_feature_names( unique_names , 0 , 'X' , short_names );
+// the columns when they're known before the molecules are processed, either
+// because the dictionary is fixed by a vocabulary or because the features
+// are being folded. id_cols gives the column for each feature id, which for
+// a fixed dictionary is the id itself, and for folding is the bit.
+void make_known_columns( const FeatureDictionary &feat_dict , char feat_label ,
+			 unsigned int fold_bits , vector<string> &col_names ,
+			 vector<string> &col_labels , vector<int> &id_cols ) {
+
+  if( fold_bits ) {
+    for( unsigned int i = 0 ; i < fold_bits ; ++i ) {
+      string bit_num = boost::lexical_cast<string>( i );
+      col_names.push_back( feat_label + string( "F" ) + bit_num );
+      col_labels.push_back( string( "fold" ) +
+			    boost::lexical_cast<string>( fold_bits ) + ":" +
+			    bit_num );
+    }
+  } else {
+    vector<unsigned int> col_ids;
+    feat_dict.column_ids( 0 , col_ids );
+    for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+      col_names.push_back( feat_label + feat_dict.short_name( col_ids[i] ) );
+      col_labels.push_back( feat_dict.label( col_ids[i] ) );
+    }
+  }
+  id_cols.clear();
+  for( int i = 0 , is = col_names.size() ; i < is ; ++i ) {
+    id_cols.push_back( i );
+  }
 
 }
 
@@ -337,6 +526,12 @@ int main( int argc , char **argv ) {
   int    min_occur; /* set by -awk or -orc, minimum number of instances of feature
 		       for it to be written */
   int    min_dist , max_dist; /* min and max bond distances for output */
+  int    num_threads;
+  string read_vocab_filename , write_vocab_filename;
+  unsigned int fold_bits; // if not 0, the size of the folded fingerprint
+  unsigned int num_hashes; // for minhash output
+  string serve_socket; // for -serve
+  string profile_filename; // for -profile
 
   cerr << "smg : "
        << BUILD_TIME << " using OEToolits version "
@@ -344,9 +539,12 @@ int main( int argc , char **argv ) {
 
   parse_args( argc , argv , mol_filename , smarts_filename , points_filename ,
 	      output_filename , output_type , output_format ,
-	      min_occur , min_dist , max_dist );
+	      min_occur , min_dist , max_dist , num_threads ,
+	      read_vocab_filename , write_vocab_filename , fold_bits ,
+	      num_hashes , serve_socket , profile_filename );
+  boost::uint64_t run_start = profile_nsecs();
 
-  vector<pair<string,string> > input_smarts , smarts_sub_defn , exp_smarts;
+  vector<pair<string,string> > input_smarts , smarts_sub_defn;
 
   try {
     DACLIB::read_smarts_file( smarts_filename , input_smarts , smarts_sub_defn );
@@ -361,8 +559,6 @@ int main( int argc , char **argv ) {
     cerr << e.what() << endl;
   }
 
-  expand_smarts_defs( input_smarts , smarts_sub_defn , exp_smarts );
-
   PharmPoint pharm_points;
   try {
     pharm_points.read_points_file( points_filename );
@@ -372,69 +568,213 @@ int main( int argc , char **argv ) {
     exit( 1 );
   }
 
-  map<string,OESubSearch *> subs;
-  build_oesubsearches( pharm_points , exp_smarts , subs );
-
-  vector<vector<string> > feature_names;
+  // each thread needs its own AtomTyper, as they hold OESubSearch objects
+  vector<AtomTyper *> thread_typers( num_threads );
+  try {
+    for( int i = 0 ; i < num_threads ; ++i ) {
+      thread_typers[i] = new AtomTyper( input_smarts , smarts_sub_defn );
+    }
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
 
-  oemolistream ims( mol_filename.c_str() );
-  if( !ims ) {
-    throw string( "File " + mol_filename + " could not be read." );
+  // the labels are made from the names of the point types, in type code
+  // order.
+  vector<string> type_names;
+  point_type_names( pharm_points , type_names );
+  FeatureDictionary feat_dict( boost::bind( &feature_key_label , _1 ,
+					    output_type , type_names ) );
+  SMG_FEATURE_OPTS feat_opts;
+  feat_opts.output_type_ = output_type;
+  feat_opts.min_dist_ = min_dist;
+  feat_opts.max_dist_ = max_dist;
+  feat_opts.fold_bits_ = fold_bits;
+  feat_opts.num_hashes_ = SMG_MINHASH == output_format ? num_hashes : 0;
+  feat_opts.type_names_ = type_names;
+  char feat_label = feature_label( output_type );
+  // a vocabulary from a previous run fixes the columns before we start
+  if( !read_vocab_filename.empty() ) {
+    try {
+      feat_dict.read_vocab( read_vocab_filename , feat_label );
+    } catch( DACLIB::FileReadOpenError &e ) {
+      cout << e.what() << endl;
+      cerr << e.what() << endl;
+      exit( 1 );
+    } catch( string msg ) {
+      cout << msg << endl;
+      cerr << msg << endl;
+      exit( 1 );
+    }
+    if( min_occur > 1 ) {
+      cout << "Warning : -awk/-orc doesn't apply when the vocabulary is read"
+	   << " from " << read_vocab_filename << "." << endl;
+    }
   }
 
-  OEMol oemol;
-  int mol_count = 0;
-  int file_num = 0;
-  map<string,int> unique_names; // count of all long bit labels found.
-  while( ims >> oemol ) {
-    DACLIB::apply_daylight_aromatic_model( oemol );
-    boost::scoped_ptr<SpivMolecule> spiv_mol( new SpivMolecule( oemol ) );
+  if( !serve_socket.empty() ) {
     try {
-      spiv_mol->make_pphore_sites( pharm_points , subs );
+      SmgServer server( serve_socket , num_threads , pharm_points ,
+			thread_typers , feat_opts , feat_dict );
+      server.run();
     } catch( string msg ) {
       cout << msg << endl;
+      cerr << msg << endl;
       exit( 1 );
     }
-    vector<string> feat_names;
-    if( SMG_PAIRS == output_type ) {
-      spiv_mol->make_pphore_pairs();
-    } else if( SMG_TRIPLETS == output_type ) {
-      spiv_mol->make_pphore_triplets();      
+    exit( 0 );
+  }
+
+  oemolistream ims( mol_filename.c_str() );
+  if( !ims ) {
+    throw string( "File " + mol_filename + " could not be read." );
+  }
+
+  // bitstrings can't be written until all the features are known, so each
+  // molecule's feature ids go to a temporary file, for a second pass at the
+  // end. That way, memory use doesn't grow with the number of molecules.
+  // Labels can be written as each molecule comes, into the one file, unless
+  // there's a min_occur to apply, in which case they're spilled as well.
+  // With a vocabulary read in, or folded fingerprints, the columns are known
+  // already, so text and binary bitstrings can be written as they come, too.
+  // MinHash signatures don't need the dictionary at all.
+  boost::scoped_ptr<FeatureSpillFile> spill_file;
+  boost::scoped_ptr<CompressedOFStream> stream_out;
+  boost::scoped_ptr<BinaryBitsWriter> binary_out;
+  boost::scoped_ptr<MinHashWriter> minhash_out;
+  bool cols_known = feat_dict.fixed() || fold_bits;
+  bool stream_labels = SMG_LABELS == output_format &&
+    ( feat_dict.fixed() || min_occur <= 1 );
+  bool stream_bits = SMG_BITSTRINGS == output_format && cols_known;
+  bool stream_binary = SMG_BINARY == output_format && cols_known;
+  vector<int> id_cols;
+  string row_template , row_buf;
+  try {
+    vector<string> col_names , col_labels;
+    if( cols_known ) {
+      make_known_columns( feat_dict , feat_label , fold_bits , col_names ,
+			  col_labels , id_cols );
+    }
+    if( stream_labels || stream_bits ) {
+      stream_out.reset( new CompressedOFStream( output_filename ) );
+    } else if( stream_binary ) {
+      binary_out.reset( new BinaryBitsWriter( output_filename , col_names ,
+					      col_labels ) );
+    } else if( SMG_MINHASH == output_format ) {
+      minhash_out.reset( new MinHashWriter( output_filename , num_hashes ) );
+    } else {
+      spill_file.reset( new FeatureSpillFile( output_filename ) );
     }
-    extract_feature_names( *spiv_mol , output_type , min_dist , max_dist ,
-			   feat_names );
-    feature_names.push_back( feat_names );
-    ++mol_count;
-    if( ( ( mol_count < 5000 && !( mol_count % 100 ) ) ||
-	  ( mol_count < 50000 && !( mol_count % 1000 ) ) ||
-	  ( mol_count > 50000 && !( mol_count % 10000 ) ) ) )
-      cerr << "Processed " << mol_count << " molecules." << endl;
-    // if doing labels output, dump the results out every 200000 molecules.
-    // Can't do same for bitstrings, so it will probably run out of memory at
-    // some point for large data sets.
-    if( !( mol_count % 200000 ) && SMG_LABELS == output_format ) {
-      string tmp_file_name = output_filename + string( "." ) +
-	boost::lexical_cast<string>( file_num );
-      write_output( output_format , output_type , tmp_file_name ,
-		    feature_names , min_occur , unique_names );
-      feature_names.clear();
-      ++file_num;
+    if( stream_bits ) {
+      write_bits_header( *stream_out , col_names );
+      make_bits_row_template( col_names.size() , row_template );
     }
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    exit( 1 );
   }
 
-  if( SMG_BITSTRINGS == output_format || !file_num ) {
-    write_output( output_format , output_type , output_filename ,
-		  feature_names , min_occur , unique_names );
-  } else if( SMG_LABELS == output_format && file_num ) {
-    // finish off last ones
-    string tmp_file_name = output_filename + string( "." ) +
-      boost::lexical_cast<string>( file_num );
-    cout << "Writing final part of output to " << tmp_file_name << endl;
-    write_output( output_format , output_type , tmp_file_name ,
-		  feature_names , min_occur , unique_names );
-    // final check of collisions for unique names. If the file is written
-    // out in bits, the interim reports may not be complete.
-    check_hash_collisions( unique_names );
+  // the workers use profile slots 0 to num_threads - 1, the pipeline's
+  // reader num_threads and the output here num_threads + 1.
+  boost::scoped_ptr<SmgProfile> profile;
+  if( !profile_filename.empty() ) {
+    profile.reset( new SmgProfile( num_threads + 2 ) );
+    for( int i = 0 ; i < num_threads ; ++i ) {
+      thread_typers[i]->set_profiling( true );
+    }
+  }
+  MoleculePipeline pipeline( ims , num_threads ,
+			     boost::bind( &process_molecule , _1 , _2 , _3 , _4 ,
+					  boost::ref( pharm_points ) ,
+					  boost::ref( thread_typers ) ,
+					  boost::cref( feat_opts ) ,
+					  profile.get() ) ,
+			     profile.get() );
+  int mol_count = 0;
+  string mol_name;
+  vector<boost::uint64_t> feat_keys;
+  vector<unsigned int> feat_ids;
+  vector<boost::uint32_t> signature;
+  try {
+    while( pipeline.next_result( mol_name , feat_keys ) ) {
+      boost::uint64_t output_start = profile ? profile_nsecs() : 0;
+      if( minhash_out ) {
+	// the keys are the signature
+	signature.assign( feat_keys.begin() , feat_keys.end() );
+	minhash_out->add_row( mol_name , signature );
+      } else if( fold_bits ) {
+	feat_ids.assign( feat_keys.begin() , feat_keys.end() );
+      } else {
+	feat_dict.add_molecule( feat_keys , feat_ids );
+      }
+      if( spill_file ) {
+	spill_file->write_molecule( mol_name , feat_ids );
+      } else if( binary_out ) {
+	// with the columns known, the ids are the column numbers
+	binary_out->add_row( mol_name , feat_ids );
+      } else if( stream_bits ) {
+	row_buf.clear();
+	format_bits_row( mol_name , feat_ids , id_cols , row_template , row_buf );
+	stream_out->write( row_buf.data() , row_buf.length() );
+      } else if( stream_labels ) {
+	write_labels_row( *stream_out , mol_name , feat_label , feat_dict ,
+			  feat_ids );
+      }
+      if( profile ) {
+	profile->time_stage( num_threads + 1 , PROF_OUTPUT , output_start );
+      }
+      ++mol_count;
+      if( ( ( mol_count < 5000 && !( mol_count % 100 ) ) ||
+	    ( mol_count < 50000 && !( mol_count % 1000 ) ) ||
+	    ( mol_count > 50000 && !( mol_count % 10000 ) ) ) )
+	cerr << "Processed " << mol_count << " molecules." << endl;
+    }
+
+    boost::uint64_t final_start = profile_nsecs();
+    if( spill_file ) {
+      write_spilled_bits( output_type , output_format , output_filename ,
+			  feat_dict , min_occur , *spill_file , num_threads );
+    } else {
+      if( stream_out ) {
+	stream_out->close();
+      } else if( binary_out ) {
+	binary_out->close();
+      } else {
+	minhash_out->close();
+      }
+      // folded bits and MinHash signatures don't have anything to decode
+      if( !fold_bits && !minhash_out ) {
+	vector<unsigned int> col_ids;
+	write_output_decode( output_type , output_filename , feat_dict ,
+			     min_occur , col_ids );
+      }
+    }
+
+    if( !write_vocab_filename.empty() ) {
+      vector<unsigned int> col_ids;
+      feat_dict.column_ids( min_occur , col_ids );
+      feat_dict.write_vocab( write_vocab_filename , feat_label , col_ids );
+    }
+    if( profile ) {
+      profile->set_final_write_time( profile_nsecs() - final_start );
+      for( int i = 0 ; i < num_threads ; ++i ) {
+	profile->add_smarts_stats( thread_typers[i]->match_stats() );
+      }
+      profile->write_json( profile_filename , num_threads ,
+			   1.0e-9 * ( profile_nsecs() - run_start ) );
+    }
+  } catch( string msg ) {
+    cout << msg << endl;
+    exit( 1 );
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
   }
 
 }
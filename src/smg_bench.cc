@@ -0,0 +1,469 @@
+//
+// file smg_bench.cc
+// agent
+// 17th October 2026
+//
+// smg_bench times the parts of smg that take the time, over the molecules
+// in a file (test_dir/chembl_20_first_10000.smi, say), and checks that
+// changes made to speed them up don't change the output. Each of
+// make_pphore_sites, make_site_site_dists_matrix, make_pphore_pairs,
+// make_pphore_triplets, hash_feature_name and write_bits_file is run over
+// all the molecules -repeats times and the best time reported, so they can
+// be compared before and after a change. The bitstrings files it writes to
+// time write_bits_file go in a temporary directory and are removed at the
+// end. Checking that the output hasn't changed is done on the smg program
+// itself, by test_smg_output.sh.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <oechem.h>
+
+#include "AtomTyper.H"
+#include "FeatureDictionary.H"
+#include "FeatureSpillFile.H"
+#include "FileExceptions.H"
+#include "PharmPoint.H"
+#include "SMARTSExceptions.H"
+#include "SpivMolecule.H"
+#include "smg_features.H"
+#include "spiv_nogr_bits.H"
+
+using namespace boost;
+using namespace std;
+using namespace OEChem;
+
+namespace DACLIB {
+  void read_smarts_file( const string &smarts_file ,
+			 vector<pair<string,string> > &input_smarts ,
+			 vector<pair<string,string> > &smarts_sub_defn );
+  void apply_daylight_aromatic_model( OEMolBase &mol );
+}
+
+extern string BUILD_TIME; // in build_time.cc
+
+// ***************************************************************************
+void print_usage( ostream &os ) {
+
+  os << "smg_bench -mo[lecule_file] <string>" << endl
+     << "    -sm[arts_file] <string>" << endl
+     << "    -po[ints_file] <string>" << endl
+     << "    [-max_m[ols] <int>]" << endl
+     << "    [-re[peats] <int>]" << endl
+     << "Times the core parts of smg over the molecules, taking the best of"
+     << " -repeats runs," << endl
+     << "default 3." << endl;
+
+}
+
+// ***************************************************************************
+void parse_args( int argc , char **argv , string &mol_filename ,
+		 string &smarts_filename , string &points_filename ,
+		 int &max_mols , int &num_repeats ) {
+
+  if( 1 == argc ) {
+    print_usage( cout );
+    exit( 0 );
+  }
+  max_mols = -1;
+  num_repeats = 3;
+
+  for( int i = 1 ; i < argc ; ++i ) {
+    if( !strncmp( argv[i] , "-molecule_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-molecule_file requires a second argument.";
+	exit( 1 );
+      }
+      mol_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-smarts_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-smarts_file requires a second argument.";
+	exit( 1 );
+      }
+      smarts_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-points_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-points_file requires a second argument.";
+	exit( 1 );
+      }
+      points_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-max_mols" , 6 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-max_mols requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	max_mols = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-max_mols requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( max_mols < 1 ) {
+	cerr << "-max_mols requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-repeats" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-repeats requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	num_repeats = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-repeats requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( num_repeats < 1 ) {
+	cerr << "-repeats requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-help" , 2 ) ) {
+      print_usage( cout );
+      exit( 0 );
+    } else {
+      cerr << "Unrecognised option " << argv[i] << "." << endl;
+      print_usage( cerr );
+      exit( 1 );
+    }
+  }
+
+  if( mol_filename.empty() ) {
+    cerr << "No molecule file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( smarts_filename.empty() ) {
+    cerr << "No SMARTS file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( points_filename.empty() ) {
+    cerr << "No points file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+}
+
+// ***************************************************************************
+double seconds_now() {
+
+  timespec ts;
+  clock_gettime( CLOCK_MONOTONIC , &ts );
+  return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+
+}
+
+// ***************************************************************************
+void report_time( const string &what , double best_secs , size_t num_items ,
+		  const string &item_name ) {
+
+  cout << setw( 28 ) << left << what << right << fixed << setprecision( 4 )
+       << setw( 10 ) << best_secs << " s";
+  if( num_items ) {
+    cout << setprecision( 3 ) << setw( 12 ) << 1.0e6 * best_secs / num_items
+	 << " us per " << item_name;
+  }
+  cout << endl;
+
+}
+
+// ***************************************************************************
+// the molecules are kept as OEMols with the aromaticity model smg uses, so
+// each benchmark starts from the same place.
+void read_molecules( const string &mol_filename , int max_mols ,
+		     vector<OEMol *> &mols ) {
+
+  oemolistream ims( mol_filename.c_str() );
+  if( !ims ) {
+    throw string( "File " + mol_filename + " could not be read." );
+  }
+  OEMol oemol;
+  while( ims >> oemol ) {
+    DACLIB::apply_daylight_aromatic_model( oemol );
+    mols.push_back( new OEMol( oemol ) );
+    oemol.Clear();
+    if( -1 != max_mols && int( mols.size() ) == max_mols ) {
+      break;
+    }
+  }
+
+}
+
+// ***************************************************************************
+// time the steps of making the features, in the order smg does them. The
+// site-site distances are made explicitly, so the pairs and triplets times
+// are just for making them from the distances.
+void time_feature_steps( vector<SpivMolecule *> &spiv_mols ,
+			 PharmPoint &pharm_points , AtomTyper &atom_typer ,
+			 int num_repeats ) {
+
+  double best_sites = -1.0 , best_dists = -1.0 , best_pairs = -1.0;
+  double best_trips = -1.0;
+  size_t num_sites = 0 , num_pairs = 0 , num_trips = 0;
+  for( int r = 0 ; r < num_repeats ; ++r ) {
+    double start = seconds_now();
+    for( int i = 0 , is = spiv_mols.size() ; i < is ; ++i ) {
+      spiv_mols[i]->make_pphore_sites( pharm_points , atom_typer );
+    }
+    double secs = seconds_now() - start;
+    if( best_sites < 0.0 || secs < best_sites ) {
+      best_sites = secs;
+    }
+
+    start = seconds_now();
+    for( int i = 0 , is = spiv_mols.size() ; i < is ; ++i ) {
+      spiv_mols[i]->make_site_site_dists_matrix();
+    }
+    secs = seconds_now() - start;
+    if( best_dists < 0.0 || secs < best_dists ) {
+      best_dists = secs;
+    }
+
+    start = seconds_now();
+    for( int i = 0 , is = spiv_mols.size() ; i < is ; ++i ) {
+      spiv_mols[i]->make_pphore_pairs();
+    }
+    secs = seconds_now() - start;
+    if( best_pairs < 0.0 || secs < best_pairs ) {
+      best_pairs = secs;
+    }
+
+    start = seconds_now();
+    for( int i = 0 , is = spiv_mols.size() ; i < is ; ++i ) {
+      spiv_mols[i]->make_pphore_triplets();
+    }
+    secs = seconds_now() - start;
+    if( best_trips < 0.0 || secs < best_trips ) {
+      best_trips = secs;
+    }
+  }
+
+  for( int i = 0 , is = spiv_mols.size() ; i < is ; ++i ) {
+    num_sites += spiv_mols[i]->pphore_site_types().size();
+    num_pairs += spiv_mols[i]->pphore_pairs().size();
+    num_trips += spiv_mols[i]->pphore_triplets().size();
+  }
+  cout << spiv_mols.size() << " molecules with " << num_sites << " sites, "
+       << num_pairs << " pairs and " << num_trips << " triplets." << endl;
+  report_time( "make_pphore_sites" , best_sites , spiv_mols.size() , "molecule" );
+  report_time( "make_site_site_dists_matrix" , best_dists , spiv_mols.size() ,
+	       "molecule" );
+  report_time( "make_pphore_pairs" , best_pairs , spiv_mols.size() , "molecule" );
+  report_time( "make_pphore_triplets" , best_trips , spiv_mols.size() ,
+	       "molecule" );
+
+}
+
+// ***************************************************************************
+void time_hash_feature_name( const vector<string> &labels , int num_repeats ) {
+
+  double best = -1.0;
+  size_t total_len = 0; // so the hashing can't be optimised away
+  for( int r = 0 ; r < num_repeats ; ++r ) {
+    double start = seconds_now();
+    for( int i = 0 , is = labels.size() ; i < is ; ++i ) {
+      total_len += hash_feature_name( labels[i] ).length();
+    }
+    double secs = seconds_now() - start;
+    if( best < 0.0 || secs < best ) {
+      best = secs;
+    }
+  }
+  if( !total_len && !labels.empty() ) {
+    cout << "Warning : hash_feature_name gave empty names." << endl;
+  }
+  report_time( "hash_feature_name" , best , labels.size() , "label" );
+
+}
+
+// ***************************************************************************
+string output_type_name( SMG_OUTPUT_TYPE output_type ) {
+
+  if( SMG_PAIRS == output_type ) {
+    return "pairs";
+  } else if( SMG_TRIPLETS == output_type ) {
+    return "triplets";
+  }
+  return "sites";
+
+}
+
+// ***************************************************************************
+// make the bitstrings and name decode files for the output type in dir, in
+// the same way as smg with its default options, returning the labels of the
+// features and the best time for write_bits_file.
+double write_bits_files( SMG_OUTPUT_TYPE output_type , vector<OEMol *> &mols ,
+			 PharmPoint &pharm_points ,
+			 vector<AtomTyper *> &typers , const string &dir ,
+			 int num_repeats , vector<string> &labels ) {
+
+  SMG_FEATURE_OPTS feat_opts;
+  feat_opts.output_type_ = output_type;
+  feat_opts.min_dist_ = 0;
+  feat_opts.max_dist_ = 100;
+  feat_opts.fold_bits_ = 0;
+  feat_opts.num_hashes_ = 0;
+  point_type_names( pharm_points , feat_opts.type_names_ );
+  FeatureDictionary feat_dict( boost::bind( &feature_key_label , _1 ,
+					    output_type ,
+					    feat_opts.type_names_ ) );
+
+  string output_filename = dir + "/" + output_type_name( output_type ) + ".bits";
+  FeatureSpillFile spill_file( output_filename );
+  string mol_name;
+  vector<boost::uint64_t> feat_keys;
+  vector<unsigned int> feat_ids;
+  for( int i = 0 , is = mols.size() ; i < is ; ++i ) {
+    OEGraphMol mol( *mols[i] );
+    feat_keys.clear();
+    process_molecule( mol , mol_name , feat_keys , 0 , pharm_points , typers ,
+		      feat_opts );
+    feat_dict.add_molecule( feat_keys , feat_ids );
+    spill_file.write_molecule( mol_name , feat_ids );
+  }
+
+  char feat_label = feature_label( output_type );
+  vector<unsigned int> col_ids;
+  feat_dict.column_ids( -1 , col_ids );
+  write_name_decode_file( output_filename + ".name_decode" , feat_label ,
+			  feat_dict , col_ids );
+  double best = -1.0;
+  for( int r = 0 ; r < num_repeats ; ++r ) {
+    double start = seconds_now();
+    write_bits_file( output_filename , feat_label , feat_dict , col_ids ,
+		     spill_file , 1 );
+    double secs = seconds_now() - start;
+    if( best < 0.0 || secs < best ) {
+      best = secs;
+    }
+  }
+
+  labels.clear();
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    labels.push_back( feat_dict.label( col_ids[i] ) );
+  }
+  return best;
+
+}
+
+// ***************************************************************************
+int main( int argc , char **argv ) {
+
+  string mol_filename , smarts_filename , points_filename;
+  int max_mols , num_repeats;
+
+  cerr << "smg_bench : " << BUILD_TIME << " using OEToolits version "
+       << OEChem::OEChemGetRelease() << "." << endl;
+
+  parse_args( argc , argv , mol_filename , smarts_filename , points_filename ,
+	      max_mols , num_repeats );
+
+  vector<pair<string,string> > input_smarts , smarts_sub_defn;
+  PharmPoint pharm_points;
+  vector<AtomTyper *> typers;
+  vector<OEMol *> mols;
+  try {
+    DACLIB::read_smarts_file( smarts_filename , input_smarts , smarts_sub_defn );
+    pharm_points.read_points_file( points_filename );
+    typers.push_back( new AtomTyper( input_smarts , smarts_sub_defn ) );
+    read_molecules( mol_filename , max_mols , mols );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( DACLIB::SMARTSSubDefnError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( DACLIB::SMARTSFileError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+  cout << "Read " << mols.size() << " molecules from " << mol_filename
+       << "." << endl;
+
+  vector<SpivMolecule *> spiv_mols;
+  for( int i = 0 , is = mols.size() ; i < is ; ++i ) {
+    spiv_mols.push_back( new SpivMolecule( *mols[i] ) );
+  }
+  try {
+    time_feature_steps( spiv_mols , pharm_points , *typers.front() ,
+			num_repeats );
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+  for( int i = 0 , is = spiv_mols.size() ; i < is ; ++i ) {
+    delete spiv_mols[i];
+  }
+
+  char tmp_dir[] = "/tmp/smg_bench_XXXXXX";
+  if( !mkdtemp( tmp_dir ) ) {
+    cout << "Couldn't make a temporary directory." << endl;
+    exit( 1 );
+  }
+  string bits_dir( tmp_dir );
+  SMG_OUTPUT_TYPE output_types[] = { SMG_SITES , SMG_PAIRS , SMG_TRIPLETS };
+  vector<string> bits_files;
+  try {
+    for( int i = 0 ; i < 3 ; ++i ) {
+      vector<string> labels;
+      double secs = write_bits_files( output_types[i] , mols , pharm_points ,
+				      typers , bits_dir , num_repeats , labels );
+      report_time( "write_bits_file " + output_type_name( output_types[i] ) ,
+		   secs , mols.size() , "molecule" );
+      if( SMG_PAIRS == output_types[i] ) {
+	time_hash_feature_name( labels , num_repeats );
+      }
+      string bits_file = output_type_name( output_types[i] ) + ".bits";
+      bits_files.push_back( bits_file );
+      bits_files.push_back( bits_file + ".name_decode" );
+    }
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+
+  for( int i = 0 , is = bits_files.size() ; i < is ; ++i ) {
+    remove( ( bits_dir + "/" + bits_files[i] ).c_str() );
+  }
+  remove( bits_dir.c_str() );
+
+  for( int i = 0 , is = mols.size() ; i < is ; ++i ) {
+    delete mols[i];
+  }
+  delete typers.front();
+
+  exit( 0 );
+
+}
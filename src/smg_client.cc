@@ -0,0 +1,334 @@
+//
+// file smg_client.cc
+// agent
+// 17th October 2026
+//
+// smg_client sends the molecules in a SMILES file to an smg -serve server,
+// in batches, and writes what comes back. Labels are written as they come,
+// a line of the name and feature labels for each molecule. Bits are
+// written in the same text form as smg -bitstrings, without the header
+// line, so the two can be compared. Molecules the server couldn't do are
+// reported on cout and left out of the output. With -shutdown, it asks the
+// server to stop, after sending any molecules.
+// The SMILES file is read as text, one molecule a line, the SMILES then
+// optionally the name, so smg_client doesn't need OEChem.
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "FileExceptions.H"
+#include "serve_frames.H"
+
+using namespace boost;
+using namespace std;
+
+extern string BUILD_TIME; // in build_time.cc
+
+// ***************************************************************************
+void print_usage( ostream &os ) {
+
+  os << "smg_client -so[cket] <string>" << endl
+     << "    [-mo[lecule_file] <string>]" << endl
+     << "    [-ou[tput_file] <string>]" << endl
+     << "    [-bi[ts]]" << endl
+     << "    [-ba[tch_size] <int>]" << endl
+     << "    [-sh[utdown]]" << endl
+     << "Sends the SMILES in -molecule_file to the smg -serve on -socket, in"
+     << " batches of" << endl
+     << "-batch_size, default 1000, asking for labels or, with -bits, bits,"
+     << " and writes" << endl
+     << "the answers to -output_file. With -shutdown, the server is then"
+     << " stopped." << endl;
+
+}
+
+// ***************************************************************************
+void parse_args( int argc , char **argv , string &socket_path ,
+		 string &mol_filename , string &output_filename ,
+		 bool &want_bits , unsigned int &batch_size , bool &shutdown ) {
+
+  if( 1 == argc ) {
+    print_usage( cout );
+    exit( 0 );
+  }
+  want_bits = shutdown = false;
+  batch_size = 1000;
+
+  for( int i = 1 ; i < argc ; ++i ) {
+    if( !strncmp( argv[i] , "-socket" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-socket requires a second argument.";
+	exit( 1 );
+      }
+      socket_path = argv[i];
+    } else if( !strncmp( argv[i] , "-molecule_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-molecule_file requires a second argument.";
+	exit( 1 );
+      }
+      mol_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-output_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-output_file requires a second argument.";
+	exit( 1 );
+      }
+      output_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-bits" , 3 ) ) {
+      want_bits = true;
+    } else if( !strncmp( argv[i] , "-batch_size" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-batch_size requires a second argument.";
+	exit( 1 );
+      }
+      int val;
+      try {
+	val = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-batch_size requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( val < 1 ) {
+	cerr << "-batch_size requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+      batch_size = val;
+    } else if( !strncmp( argv[i] , "-shutdown" , 3 ) ) {
+      shutdown = true;
+    } else if( !strncmp( argv[i] , "-help" , 2 ) ) {
+      print_usage( cout );
+      exit( 0 );
+    } else {
+      cerr << "Unrecognised option " << argv[i] << "." << endl;
+      print_usage( cerr );
+      exit( 1 );
+    }
+  }
+
+  if( socket_path.empty() ) {
+    cerr << "No socket specified." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( mol_filename.empty() && !shutdown ) {
+    cerr << "Nothing to do, as there's no molecule file and no -shutdown."
+	 << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( !mol_filename.empty() && output_filename.empty() ) {
+    cerr << "No output file specified." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+
+}
+
+// ***************************************************************************
+// Throws a string if the server isn't there.
+int connect_to_server( const string &socket_path ) {
+
+  sockaddr_un addr;
+  memset( &addr , 0 , sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if( socket_path.length() >= sizeof( addr.sun_path ) ) {
+    throw( string( "Socket path " ) + socket_path + string( " is too long." ) );
+  }
+  strcpy( addr.sun_path , socket_path.c_str() );
+
+  int fd = socket( AF_UNIX , SOCK_STREAM , 0 );
+  if( -1 == fd ) {
+    throw( string( "Couldn't make socket : " ) + strerror( errno ) );
+  }
+  if( connect( fd , reinterpret_cast<sockaddr *>( &addr ) , sizeof( addr ) ) ) {
+    string msg = string( "Couldn't connect to " ) + socket_path + " : " +
+      strerror( errno );
+    close( fd );
+    throw( msg );
+  }
+  return fd;
+
+}
+
+// ***************************************************************************
+// send the request and return the response, without its "OK" line, and
+// the number of columns it gave. Throws a string if the server gave an
+// error or went away.
+void send_request( int fd , const string &request , string &response ,
+		   unsigned int &num_cols ) {
+
+  if( !write_serve_frame( fd , request ) || !read_serve_frame( fd , response ) ) {
+    throw( string( "Lost the connection to the server." ) );
+  }
+  string::size_type eol = response.find( '\n' );
+  string status = response.substr( 0 , eol );
+  if( status.substr( 0 , 3 ) != "OK " ) {
+    throw( string( "Server said : " ) + status );
+  }
+  unsigned int num_mols;
+  istringstream( status.substr( 3 ) ) >> num_mols >> num_cols;
+  response.erase( 0 , string::npos == eol ? eol : eol + 1 );
+
+}
+
+// ***************************************************************************
+// write the molecules in a bits response in smg's text bitstrings form.
+// Returns the number of molecules the server couldn't do.
+int write_bits_response( const string &response , unsigned int num_cols ,
+			 ostream &os ) {
+
+  int num_errors = 0;
+  size_t row_bytes = ( num_cols + 63 ) / 64 * sizeof( boost::uint64_t );
+  vector<boost::uint64_t> row( ( num_cols + 63 ) / 64 );
+  string::size_type pos = 0;
+  while( pos < response.length() ) {
+    string::size_type eol = response.find( '\n' , pos );
+    if( string::npos == eol ) {
+      throw( string( "Bad response from server." ) );
+    }
+    string name = response.substr( pos , eol - pos );
+    pos = eol + 1;
+    if( string::npos != name.find( " ERROR " ) ) {
+      cout << "Server couldn't do " << name << endl;
+      ++num_errors;
+      continue;
+    }
+    if( pos + row_bytes > response.length() ) {
+      throw( string( "Bad response from server." ) );
+    }
+    if( row_bytes ) {
+      memcpy( &row[0] , response.data() + pos , row_bytes );
+    }
+    pos += row_bytes;
+    os << name;
+    for( unsigned int c = 0 ; c < num_cols ; ++c ) {
+      os << ( ( row[c / 64] >> ( c % 64 ) ) & 1 ? " 1" : " 0" );
+    }
+    os << "\n";
+  }
+  return num_errors;
+
+}
+
+// ***************************************************************************
+// Returns the number of molecules the server couldn't do.
+int write_labels_response( const string &response , ostream &os ) {
+
+  int num_errors = 0;
+  istringstream iss( response );
+  string line;
+  while( getline( iss , line ) ) {
+    if( string::npos != line.find( " ERROR " ) ) {
+      cout << "Server couldn't do " << line << endl;
+      ++num_errors;
+    } else {
+      os << line << "\n";
+    }
+  }
+  return num_errors;
+
+}
+
+// ***************************************************************************
+// Returns the number of molecules the server couldn't do.
+int send_molecules( int fd , const string &mol_filename , ostream &os ,
+		    bool want_bits , unsigned int batch_size ) {
+
+  ifstream ifs( mol_filename.c_str() );
+  if( !ifs ) {
+    throw DACLIB::FileReadOpenError( mol_filename.c_str() );
+  }
+
+  string header = want_bits ? "bits\n" : "labels\n";
+  string request = header , response , line;
+  unsigned int num_in_batch = 0 , num_cols;
+  int num_errors = 0;
+  while( 1 ) {
+    bool more = bool( getline( ifs , line ) );
+    if( more && !line.empty() ) {
+      request += line + "\n";
+      ++num_in_batch;
+    }
+    if( num_in_batch && ( !more || num_in_batch == batch_size ) ) {
+      send_request( fd , request , response , num_cols );
+      if( want_bits ) {
+	num_errors += write_bits_response( response , num_cols , os );
+      } else {
+	num_errors += write_labels_response( response , os );
+      }
+      request = header;
+      num_in_batch = 0;
+    }
+    if( !more ) {
+      break;
+    }
+  }
+  return num_errors;
+
+}
+
+// ***************************************************************************
+int main( int argc , char **argv ) {
+
+  string socket_path , mol_filename , output_filename;
+  bool want_bits , shutdown;
+  unsigned int batch_size;
+
+  cerr << "smg_client : " << BUILD_TIME << endl;
+
+  parse_args( argc , argv , socket_path , mol_filename , output_filename ,
+	      want_bits , batch_size , shutdown );
+
+  int num_errors = 0;
+  try {
+    int fd = connect_to_server( socket_path );
+    if( !mol_filename.empty() ) {
+      ofstream ofs( output_filename.c_str() );
+      if( !ofs ) {
+	throw DACLIB::FileWriteOpenError( output_filename.c_str() );
+      }
+      num_errors = send_molecules( fd , mol_filename , ofs , want_bits ,
+				   batch_size );
+      ofs.close();
+      if( !ofs ) {
+	throw( string( "Couldn't write " ) + output_filename + "." );
+      }
+    }
+    if( shutdown ) {
+      string response;
+      unsigned int num_cols;
+      send_request( fd , "shutdown\n" , response , num_cols );
+    }
+    close( fd );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+
+  exit( num_errors ? 1 : 0 );
+
+}
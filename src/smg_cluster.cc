@@ -0,0 +1,435 @@
+//
+// file smg_cluster.cc
+// agent
+// 17th October 2026
+//
+// smg_cluster does Taylor-Butina clustering of the fingerprints in a binary
+// fingerprint file written by smg -output_format binary, folded or not.
+// All the pairs of molecules with a Tanimoto of at least the threshold are
+// found, which gives each molecule's neighbour list. The molecule with the
+// most neighbours is then the first cluster centroid, and its cluster is it
+// and all its neighbours. The next centroid is the molecule not yet in a
+// cluster with the next most neighbours, counting all of them as they were
+// at the start rather than just the ones still left, and its cluster is it
+// and those of its neighbours not already taken, and so on until all
+// molecules are in a cluster, the last ones being singletons.
+//
+// The pairs are written to a temporary file as they're found, and the
+// neighbour lists are made from that in a second, memory-mapped, temporary
+// file, so the only things held in memory are a few numbers per molecule.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "BinaryBitsFile.H"
+#include "CompressedOFStream.H"
+#include "FileExceptions.H"
+#include "FingerprintStore.H"
+#include "popcount_kernels.H"
+
+using namespace boost;
+using namespace std;
+
+extern string BUILD_TIME; // in build_time.cc
+
+// ***************************************************************************
+void print_usage( ostream &os ) {
+
+  os << "smg_cluster -db <string>" << endl
+     << "    -ou[tput_file] <string>" << endl
+     << "    [-ne[ighbours_file] <string>]" << endl
+     << "    [-si[milarity] <float>]" << endl
+     << "    [-th[reads] <int>]" << endl
+     << "The database is a binary fingerprint file from smg. Molecules are"
+     << " neighbours" << endl
+     << "if their Tanimoto is at least -similarity, default 0.7. The output"
+     << " file has" << endl
+     << "a line for each molecule, in database order, of its name, cluster"
+     << " number," << endl
+     << "cluster centroid and cluster size. The neighbours file, if given, has"
+     << " a line" << endl
+     << "for each molecule of its name, number of neighbours and the"
+     << " neighbours as" << endl
+     << "name:Tanimoto, most similar first." << endl;
+
+}
+
+// ***************************************************************************
+void parse_args( int argc , char **argv , string &db_filename ,
+		 string &output_filename , string &neighbours_filename ,
+		 double &threshold , int &num_threads ) {
+
+  if( 1 == argc ) {
+    print_usage( cout );
+    exit( 0 );
+  }
+  threshold = 0.7;
+  num_threads = 1;
+
+  for( int i = 1 ; i < argc ; ++i ) {
+    if( !strcmp( argv[i] , "-db" ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-db requires a second argument.";
+	exit( 1 );
+      }
+      db_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-output_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-output_file requires a second argument.";
+	exit( 1 );
+      }
+      output_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-neighbours_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-neighbours_file requires a second argument.";
+	exit( 1 );
+      }
+      neighbours_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-similarity" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-similarity requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	threshold = lexical_cast<double>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-similarity requires a numerical argument." << endl;
+	exit( 1 );
+      }
+      if( threshold <= 0.0 || threshold > 1.0 ) {
+	cerr << "-similarity must be more than 0.0 and no more than 1.0."
+	     << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-threads" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-threads requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	num_threads = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-threads requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( num_threads < 1 ) {
+	cerr << "-threads requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-help" , 2 ) ) {
+      print_usage( cout );
+      exit( 0 );
+    } else {
+      cerr << "Unrecognised option " << argv[i] << "." << endl;
+      print_usage( cerr );
+      exit( 1 );
+    }
+  }
+
+  if( db_filename.empty() ) {
+    cerr << "No database file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( output_filename.empty() ) {
+    cerr << "No output file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+
+}
+
+// ***************************************************************************
+// one entry in a neighbour list
+typedef struct {
+  unsigned int nbr_;
+  float sim_;
+} NEIGHBOUR;
+
+// ***************************************************************************
+// most similar first, then in row order
+bool neighbour_is_better( const NEIGHBOUR &a , const NEIGHBOUR &b ) {
+
+  if( a.sim_ != b.sim_ ) {
+    return a.sim_ > b.sim_;
+  }
+  return a.nbr_ < b.nbr_;
+
+}
+
+// ***************************************************************************
+// the neighbour lists, in a temporary file mapped into memory. The
+// neighbours of row i are nbrs()[nbr_starts()[i]] to
+// nbrs()[nbr_starts()[i+1]-1], most similar first.
+class NeighbourLists {
+
+public :
+
+  // the file is made next to filename. Throws DACLIB::FileWriteOpenError
+  // if it can't be.
+  NeighbourLists( const string &filename ) :
+    tmp_( open_binary_tmp_file( filename , ".nbrs" ) ) , nbrs_( 0 ) ,
+    map_size_( 0 ) {}
+  ~NeighbourLists() {
+    if( nbrs_ ) {
+      munmap( nbrs_ , map_size_ );
+    }
+    fclose( tmp_ );
+  }
+
+  // make the lists from the pairs in pairs_tmp, where nbr_counts is the
+  // number of neighbours each row has. Throws a string if the files can't
+  // be read or written.
+  void make( FILE *pairs_tmp , const vector<size_t> &nbr_counts );
+
+  const vector<size_t> &nbr_starts() const { return nbr_starts_; }
+  const NEIGHBOUR *nbrs() const { return nbrs_; }
+
+private :
+
+  FILE *tmp_;
+  vector<size_t> nbr_starts_;
+  NEIGHBOUR *nbrs_;
+  size_t map_size_;
+
+  // not copyable
+  NeighbourLists( const NeighbourLists & );
+  NeighbourLists &operator=( const NeighbourLists & );
+
+};
+
+// ***************************************************************************
+// Each pair goes into both its rows' lists, which are then sorted in place.
+void NeighbourLists::make( FILE *pairs_tmp , const vector<size_t> &nbr_counts ) {
+
+  unsigned int num_rows = nbr_counts.size();
+  nbr_starts_.assign( num_rows + 1 , 0 );
+  for( unsigned int i = 0 ; i < num_rows ; ++i ) {
+    nbr_starts_[i + 1] = nbr_starts_[i] + nbr_counts[i];
+  }
+  if( !nbr_starts_[num_rows] ) {
+    return;
+  }
+
+  map_size_ = nbr_starts_[num_rows] * sizeof( NEIGHBOUR );
+  if( ftruncate( fileno( tmp_ ) , map_size_ ) ) {
+    throw( string( "Couldn't make the temporary file for the neighbour lists." ) );
+  }
+  void *map = mmap( 0 , map_size_ , PROT_READ | PROT_WRITE , MAP_SHARED ,
+		    fileno( tmp_ ) , 0 );
+  if( MAP_FAILED == map ) {
+    throw( string( "Couldn't map the temporary file for the neighbour lists." ) );
+  }
+  nbrs_ = static_cast<NEIGHBOUR *>( map );
+
+  if( fflush( pairs_tmp ) || fseek( pairs_tmp , 0 , SEEK_SET ) ) {
+    throw( string( "Couldn't read back the neighbour pairs." ) );
+  }
+  vector<size_t> next( nbr_starts_.begin() , nbr_starts_.end() - 1 );
+  vector<FP_NEIGHBOUR_PAIR> pairs( 65536 );
+  size_t num_read;
+  while( 0 != ( num_read = fread( &pairs[0] , sizeof( FP_NEIGHBOUR_PAIR ) ,
+				  pairs.size() , pairs_tmp ) ) ) {
+    for( size_t i = 0 ; i < num_read ; ++i ) {
+      NEIGHBOUR &n1 = nbrs_[next[pairs[i].row1_]++];
+      n1.nbr_ = pairs[i].row2_;
+      n1.sim_ = pairs[i].tanimoto_;
+      NEIGHBOUR &n2 = nbrs_[next[pairs[i].row2_]++];
+      n2.nbr_ = pairs[i].row1_;
+      n2.sim_ = pairs[i].tanimoto_;
+    }
+  }
+  if( ferror( pairs_tmp ) ) {
+    throw( string( "Couldn't read back the neighbour pairs." ) );
+  }
+
+  for( unsigned int i = 0 ; i < num_rows ; ++i ) {
+    sort( nbrs_ + nbr_starts_[i] , nbrs_ + nbr_starts_[i + 1] ,
+	  neighbour_is_better );
+  }
+
+}
+
+// ***************************************************************************
+// called by FingerprintStore::neighbour_pairs with each tile's pairs, which
+// are added to pairs_tmp and counted in nbr_counts. ok is set false if they
+// can't be written, as this mustn't throw.
+void spill_pairs( const vector<FP_NEIGHBOUR_PAIR> &pairs , FILE *pairs_tmp ,
+		  vector<size_t> *nbr_counts , size_t *num_pairs , bool *ok ) {
+
+  if( pairs.size() != fwrite( &pairs[0] , sizeof( FP_NEIGHBOUR_PAIR ) ,
+			      pairs.size() , pairs_tmp ) ) {
+    *ok = false;
+  }
+  for( size_t i = 0 , is = pairs.size() ; i < is ; ++i ) {
+    ++(*nbr_counts)[pairs[i].row1_];
+    ++(*nbr_counts)[pairs[i].row2_];
+  }
+  *num_pairs += pairs.size();
+
+}
+
+// ***************************************************************************
+// Taylor-Butina. clusters gets the cluster number of each row, from 0, and
+// centroids the centroid row of each cluster. Centroids are taken in order
+// of number of neighbours, ties going to the earlier row, and a molecule
+// goes in the first cluster whose centroid it's a neighbour of.
+void butina_clusters( const NeighbourLists &nbr_lists ,
+		      vector<int> &clusters , vector<unsigned int> &centroids ) {
+
+  const vector<size_t> &nbr_starts = nbr_lists.nbr_starts();
+  const NEIGHBOUR *nbrs = nbr_lists.nbrs();
+  unsigned int num_rows = nbr_starts.size() - 1;
+  vector<pair<size_t,unsigned int> > by_count;
+  by_count.reserve( num_rows );
+  for( unsigned int i = 0 ; i < num_rows ; ++i ) {
+    // the count negated, so a plain sort does most first, then row order
+    by_count.push_back( make_pair( ~( nbr_starts[i + 1] - nbr_starts[i] ) , i ) );
+  }
+  sort( by_count.begin() , by_count.end() );
+
+  clusters.assign( num_rows , -1 );
+  centroids.clear();
+  for( unsigned int i = 0 ; i < num_rows ; ++i ) {
+    unsigned int cent = by_count[i].second;
+    if( -1 != clusters[cent] ) {
+      continue;
+    }
+    int clus_num = centroids.size();
+    centroids.push_back( cent );
+    clusters[cent] = clus_num;
+    for( size_t j = nbr_starts[cent] ; j < nbr_starts[cent + 1] ; ++j ) {
+      if( -1 == clusters[nbrs[j].nbr_] ) {
+	clusters[nbrs[j].nbr_] = clus_num;
+      }
+    }
+  }
+
+}
+
+// ***************************************************************************
+void write_neighbours_file( const string &neighbours_filename ,
+			    const BinaryBitsFile &bits_file ,
+			    const NeighbourLists &nbr_lists ) {
+
+  const vector<size_t> &nbr_starts = nbr_lists.nbr_starts();
+  const NEIGHBOUR *nbrs = nbr_lists.nbrs();
+  CompressedOFStream os( neighbours_filename );
+  for( unsigned int i = 0 , is = bits_file.num_rows() ; i < is ; ++i ) {
+    os << bits_file.title( i ) << " " << nbr_starts[i + 1] - nbr_starts[i];
+    for( size_t j = nbr_starts[i] ; j < nbr_starts[i + 1] ; ++j ) {
+      os << " " << bits_file.title( nbrs[j].nbr_ ) << ":" << nbrs[j].sim_;
+    }
+    os << "\n";
+  }
+  os.close();
+
+}
+
+// ***************************************************************************
+void write_clusters_file( const string &output_filename ,
+			  const BinaryBitsFile &bits_file ,
+			  const vector<int> &clusters ,
+			  const vector<unsigned int> &centroids ) {
+
+  vector<unsigned int> clus_sizes( centroids.size() , 0 );
+  for( int i = 0 , is = clusters.size() ; i < is ; ++i ) {
+    ++clus_sizes[clusters[i]];
+  }
+
+  CompressedOFStream os( output_filename );
+  for( unsigned int i = 0 , is = bits_file.num_rows() ; i < is ; ++i ) {
+    os << bits_file.title( i ) << " " << clusters[i] + 1 << " "
+       << bits_file.title( centroids[clusters[i]] ) << " "
+       << clus_sizes[clusters[i]] << "\n";
+  }
+  os.close();
+
+}
+
+// ***************************************************************************
+int main( int argc , char **argv ) {
+
+  string db_filename , output_filename , neighbours_filename;
+  double threshold;
+  int num_threads;
+
+  cerr << "smg_cluster : " << BUILD_TIME << endl;
+
+  parse_args( argc , argv , db_filename , output_filename ,
+	      neighbours_filename , threshold , num_threads );
+
+  boost::scoped_ptr<BinaryBitsFile> bits_file;
+  boost::scoped_ptr<FingerprintStore> fp_store;
+  try {
+    bits_file.reset( new BinaryBitsFile( db_filename ) );
+    fp_store.reset( new FingerprintStore( *bits_file , num_threads ) );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+  cerr << "Loaded " << fp_store->num_rows() << " fingerprints of "
+       << fp_store->num_cols() << " bits from " << db_filename
+       << ", comparing with the " << and_popcount_kernel_name()
+       << " popcount." << endl;
+
+  boost::scoped_ptr<NeighbourLists> nbr_lists;
+  vector<int> clusters;
+  vector<unsigned int> centroids;
+  try {
+    FILE *pairs_tmp = open_binary_tmp_file( output_filename , ".pairs" );
+    vector<size_t> nbr_counts( fp_store->num_rows() , 0 );
+    size_t num_pairs = 0;
+    bool pairs_ok = true;
+    fp_store->neighbour_pairs( threshold ,
+			       boost::bind( &spill_pairs , _1 , pairs_tmp ,
+					    &nbr_counts , &num_pairs ,
+					    &pairs_ok ) );
+    // the fingerprints aren't needed now the neighbours are known
+    fp_store.reset();
+    if( !pairs_ok ) {
+      throw( string( "Couldn't write the neighbour pairs to a temporary file." ) );
+    }
+    cerr << "Found " << num_pairs << " pairs with Tanimoto at least "
+	 << threshold << "." << endl;
+    nbr_lists.reset( new NeighbourLists( output_filename ) );
+    nbr_lists->make( pairs_tmp , nbr_counts );
+    fclose( pairs_tmp );
+
+    butina_clusters( *nbr_lists , clusters , centroids );
+    cerr << "Made " << centroids.size() << " clusters." << endl;
+
+    write_clusters_file( output_filename , *bits_file , clusters , centroids );
+    if( !neighbours_filename.empty() ) {
+      write_neighbours_file( neighbours_filename , *bits_file , *nbr_lists );
+    }
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    exit( 1 );
+  }
+
+}
@@ -0,0 +1,188 @@
+//
+// file smg_features.cc
+// agent
+// 17th October 2026
+//
+// The functions that make a molecule's features, taken out of smg.cc so
+// that smg_search can use them too.
+
+#include "smg_features.H"
+
+#include <algorithm>
+#include <map>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "AtomTyper.H"
+#include "PharmPoint.H"
+#include "SmgProfile.H"
+#include "SpivMolecule.H"
+#include "minhash.H"
+#include "spiv_nogr_bits.H"
+
+using namespace OEChem;
+using namespace std;
+
+namespace DACLIB {
+  void apply_daylight_aromatic_model( OEMolBase &mol );
+}
+
+// ***************************************************************************
+char feature_label( SMG_OUTPUT_TYPE output_type ) {
+
+  if( SMG_PAIRS == output_type ) {
+    return 'P';
+  } else if( SMG_TRIPLETS == output_type ) {
+    return 'T';
+  }
+  return 'S';
+
+}
+
+// ***************************************************************************
+void point_type_names( PharmPoint &pharm_points , vector<string> &type_names ) {
+
+  type_names.clear();
+  map<string,vector<string> >::iterator p , ps;
+  for( p = pharm_points.points_defs().begin() ,
+	 ps = pharm_points.points_defs().end() ; p != ps ; ++p ) {
+    type_names.push_back( p->first );
+  }
+
+}
+
+// ***************************************************************************
+string feature_key_label( boost::uint64_t key , SMG_OUTPUT_TYPE output_type ,
+			  const vector<string> &type_names ) {
+
+  if( SMG_PAIRS == output_type ) {
+    return spiv_pair_key_label( key , type_names );
+  } else if( SMG_TRIPLETS == output_type ) {
+    return spiv_triplet_key_label( key , type_names );
+  }
+  return type_names[key];
+
+}
+
+// ***************************************************************************
+// the features are passed back as their keys, and only turned into labels
+// once per run, by the FeatureDictionary.
+void extract_feature_keys( SpivMolecule &mol , SMG_OUTPUT_TYPE output_type ,
+			   vector<boost::uint64_t> &feat_keys ) {
+
+  if( SMG_SITES == output_type ) {
+    feat_keys.insert( feat_keys.end() , mol.pphore_site_types().begin() ,
+		      mol.pphore_site_types().end() );
+  } else if( SMG_PAIRS == output_type ) {
+    // the distance limits were applied when the pairs and triplets were made
+    const vector<SPIV_PAIR> &pairs = mol.pphore_pairs();
+    for( int j = 0 , js = pairs.size() ; j < js ; ++j ) {
+      feat_keys.push_back( pairs[j].key_ );
+    }
+  } else if( SMG_TRIPLETS == output_type ) {
+    const vector<SPIV_TRIPLET> &trips = mol.pphore_triplets();
+    for( int j = 0 , js = trips.size() ; j < js ; ++j ) {
+      feat_keys.push_back( trips[j].key_ );
+    }
+  }
+
+  sort( feat_keys.begin() , feat_keys.end() );
+  feat_keys.erase( unique( feat_keys.begin() , feat_keys.end() ) ,
+		   feat_keys.end() );
+
+}
+
+// ***************************************************************************
+// The bit comes from the feature's label, not its key, so it doesn't depend
+// on the order of the point types in the points file.
+void fold_feature_keys( const SMG_FEATURE_OPTS &feat_opts ,
+			vector<boost::uint64_t> &feat_keys ) {
+
+  for( int i = 0 , is = feat_keys.size() ; i < is ; ++i ) {
+    feat_keys[i] = fold_feature_name( feature_key_label( feat_keys[i] ,
+							 feat_opts.output_type_ ,
+							 feat_opts.type_names_ ) ,
+				      feat_opts.fold_bits_ );
+  }
+  sort( feat_keys.begin() , feat_keys.end() );
+  feat_keys.erase( unique( feat_keys.begin() , feat_keys.end() ) ,
+		   feat_keys.end() );
+
+}
+
+// ***************************************************************************
+// Like the folded bits, the signature comes from the labels, so it's the same
+// whatever the order of the point types. It's small enough to hand back in
+// feat_keys, one value per key.
+void minhash_feature_keys( const SMG_FEATURE_OPTS &feat_opts ,
+			   vector<boost::uint64_t> &feat_keys ) {
+
+  vector<unsigned int> feat_hashes;
+  feat_hashes.reserve( feat_keys.size() );
+  for( int i = 0 , is = feat_keys.size() ; i < is ; ++i ) {
+    feat_hashes.push_back( feature_name_hash( feature_key_label( feat_keys[i] ,
+								 feat_opts.output_type_ ,
+								 feat_opts.type_names_ ) ) );
+  }
+  vector<boost::uint32_t> signature;
+  minhash_signature( feat_hashes , feat_opts.num_hashes_ , signature );
+  feat_keys.assign( signature.begin() , signature.end() );
+
+}
+
+// ***************************************************************************
+void process_molecule( OEMolBase &oemol , string &mol_name ,
+		       vector<boost::uint64_t> &feat_keys ,
+		       int thread_num , PharmPoint &pharm_points ,
+		       vector<AtomTyper *> &thread_typers ,
+		       const SMG_FEATURE_OPTS &feat_opts ,
+		       SmgProfile *profile ) {
+
+  boost::uint64_t start = profile ? profile_nsecs() : 0;
+  DACLIB::apply_daylight_aromatic_model( oemol );
+  if( profile ) {
+    start = profile->time_stage( thread_num , PROF_AROMATICITY , start );
+  }
+  boost::scoped_ptr<SpivMolecule> spiv_mol( new SpivMolecule( oemol ) );
+  if( profile ) {
+    start = profile->time_stage( thread_num , PROF_SETUP , start );
+  }
+  spiv_mol->make_pphore_sites( pharm_points , *thread_typers[thread_num] );
+  if( profile ) {
+    start = profile->time_stage( thread_num , PROF_SITES , start );
+  }
+  if( SMG_PAIRS == feat_opts.output_type_ ||
+      SMG_TRIPLETS == feat_opts.output_type_ ) {
+    // done here rather than left to the pairs and triplets, so it can be
+    // timed on its own. They only make it again if it's not far enough.
+    spiv_mol->make_site_site_dists_matrix( feat_opts.max_dist_ );
+    if( profile ) {
+      start = profile->time_stage( thread_num , PROF_DISTANCES , start );
+    }
+  }
+  if( SMG_PAIRS == feat_opts.output_type_ ) {
+    spiv_mol->make_pphore_pairs( feat_opts.min_dist_ , feat_opts.max_dist_ );
+    if( profile ) {
+      start = profile->time_stage( thread_num , PROF_PAIRS , start );
+    }
+  } else if( SMG_TRIPLETS == feat_opts.output_type_ ) {
+    spiv_mol->make_pphore_triplets( feat_opts.min_dist_ , feat_opts.max_dist_ );
+    if( profile ) {
+      start = profile->time_stage( thread_num , PROF_TRIPLETS , start );
+    }
+  }
+  mol_name = spiv_mol->GetTitle();
+  extract_feature_keys( *spiv_mol , feat_opts.output_type_ , feat_keys );
+  if( feat_opts.fold_bits_ ) {
+    fold_feature_keys( feat_opts , feat_keys );
+  } else if( feat_opts.num_hashes_ ) {
+    minhash_feature_keys( feat_opts , feat_keys );
+  }
+  if( profile ) {
+    profile->time_stage( thread_num , PROF_KEYS , start );
+    profile->add_counts( thread_num , spiv_mol->pphore_site_types().size() ,
+			 spiv_mol->pphore_pairs().size() ,
+			 spiv_mol->pphore_triplets().size() );
+  }
+
+}
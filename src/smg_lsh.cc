@@ -0,0 +1,355 @@
+//
+// file smg_lsh.cc
+// agent
+// 17th October 2026
+//
+// smg_lsh finds candidate near-duplicate pairs of molecules from the MinHash
+// signatures written by smg -output_format minhash, by banded
+// locality-sensitive hashing. The signatures are split into bands, and for
+// each band the molecules are sorted on a hash of their values in it. Any
+// two molecules with the same values in at least one band are a candidate
+// pair, and it's written out if the whole signatures give an estimated
+// similarity of at least the threshold. Each band is a sort, so the time
+// goes as n log n in the number of molecules, not n squared, unless lots
+// of molecules fall in the same bucket, which -max_bucket guards against.
+// Molecules with no features have empty signatures, which would all be in
+// the same buckets, so they're left out and just counted.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "CompressedOFStream.H"
+#include "FileExceptions.H"
+#include "MinHashFile.H"
+#include "minhash.H"
+
+using namespace boost;
+using namespace std;
+
+extern string BUILD_TIME; // in build_time.cc
+
+// ***************************************************************************
+void print_usage( ostream &os ) {
+
+  os << "smg_lsh -db <string>" << endl
+     << "    -ou[tput_file] <string>" << endl
+     << "    [-si[milarity] <float>]" << endl
+     << "    [-ba[nds] <int>]" << endl
+     << "    [-ro[ws] <int>]" << endl
+     << "    [-max_b[ucket] <int>]" << endl
+     << "The database is a MinHash signature file from smg -output_format"
+     << " minhash." << endl
+     << "Pairs are written as the two names and their estimated similarity"
+     << " if it's at" << endl
+     << "least -similarity, default 0.8. Unless -bands and -rows are given,"
+     << " the number" << endl
+     << "of bands and rows in each is chosen to suit -similarity. Buckets"
+     << " with more" << endl
+     << "than -max_bucket molecules are skipped, with a warning; the default,"
+     << " 0, is no" << endl
+     << "limit." << endl;
+
+}
+
+// ***************************************************************************
+void parse_args( int argc , char **argv , string &db_filename ,
+		 string &output_filename , double &threshold ,
+		 unsigned int &num_bands , unsigned int &rows_per_band ,
+		 unsigned int &max_bucket ) {
+
+  if( 1 == argc ) {
+    print_usage( cout );
+    exit( 0 );
+  }
+  threshold = 0.8;
+  num_bands = rows_per_band = 0;
+  max_bucket = 0;
+
+  for( int i = 1 ; i < argc ; ++i ) {
+    if( !strcmp( argv[i] , "-db" ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-db requires a second argument.";
+	exit( 1 );
+      }
+      db_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-output_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-output_file requires a second argument.";
+	exit( 1 );
+      }
+      output_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-similarity" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-similarity requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	threshold = lexical_cast<double>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-similarity requires a numerical argument." << endl;
+	exit( 1 );
+      }
+      if( threshold <= 0.0 || threshold > 1.0 ) {
+	cerr << "-similarity must be more than 0.0 and no more than 1.0."
+	     << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-bands" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-bands requires a second argument.";
+	exit( 1 );
+      }
+      int val = 0;
+      try {
+	val = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-bands requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( val < 1 ) {
+	cerr << "-bands requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+      num_bands = val;
+    } else if( !strncmp( argv[i] , "-rows" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-rows requires a second argument.";
+	exit( 1 );
+      }
+      int val = 0;
+      try {
+	val = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-rows requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( val < 1 ) {
+	cerr << "-rows requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+      rows_per_band = val;
+    } else if( !strncmp( argv[i] , "-max_bucket" , 6 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-max_bucket requires a second argument.";
+	exit( 1 );
+      }
+      int val = 0;
+      try {
+	val = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-max_bucket requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( val < 0 ) {
+	cerr << "-max_bucket requires a non-negative integer argument." << endl;
+	exit( 1 );
+      }
+      max_bucket = val;
+    } else if( !strncmp( argv[i] , "-help" , 2 ) ) {
+      print_usage( cout );
+      exit( 0 );
+    } else {
+      cerr << "Unrecognised option " << argv[i] << "." << endl;
+      print_usage( cerr );
+      exit( 1 );
+    }
+  }
+
+  if( db_filename.empty() ) {
+    cerr << "No database file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( output_filename.empty() ) {
+    cerr << "No output file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( ( num_bands && !rows_per_band ) || ( !num_bands && rows_per_band ) ) {
+    cerr << "-bands and -rows must be given together." << endl;
+    exit( 1 );
+  }
+
+}
+
+// ***************************************************************************
+// true if the two signatures have the same values in band band_num
+bool same_band( const boost::uint32_t *sig1 , const boost::uint32_t *sig2 ,
+		unsigned int band_num , unsigned int rows_per_band ) {
+
+  return !memcmp( sig1 + band_num * rows_per_band ,
+		  sig2 + band_num * rows_per_band ,
+		  rows_per_band * sizeof( boost::uint32_t ) );
+
+}
+
+// ***************************************************************************
+// true if the pair was written for an earlier band than band_num, which
+// it was if they share the band and its bucket wasn't skipped. The hashes of
+// the skipped buckets are in order for each band.
+bool pair_already_written( const boost::uint32_t *sig1 ,
+			   const boost::uint32_t *sig2 , unsigned int band_num ,
+			   unsigned int rows_per_band ,
+			   const vector<vector<boost::uint64_t> > &skipped_hashes ) {
+
+  for( unsigned int k = 0 ; k < band_num ; ++k ) {
+    if( same_band( sig1 , sig2 , k , rows_per_band ) &&
+	!binary_search( skipped_hashes[k].begin() , skipped_hashes[k].end() ,
+			minhash_band_hash( sig1 , k , rows_per_band ) ) ) {
+      return true;
+    }
+  }
+  return false;
+
+}
+
+// ***************************************************************************
+// write the pairs that share band band_num, apart from ones that were
+// written for an earlier band. buckets is just somewhere to work, kept
+// between calls to save reallocating it. Molecules with empty signatures
+// are left out. The hashes of buckets skipped for being bigger than
+// max_bucket are put in skipped_hashes[band_num], so the pairs in them can
+// still be written for a later band they share. Returns the number skipped.
+unsigned int write_band_pairs( const MinHashFile &mh_file ,
+			       unsigned int band_num ,
+			       unsigned int rows_per_band , double threshold ,
+			       unsigned int max_bucket ,
+			       vector<pair<boost::uint64_t,unsigned int> > &buckets ,
+			       vector<vector<boost::uint64_t> > &skipped_hashes ,
+			       ostream &os , size_t &num_pairs ) {
+
+  buckets.clear();
+  for( unsigned int i = 0 , is = mh_file.num_rows() ; i < is ; ++i ) {
+    if( !minhash_is_empty( mh_file.signature( i ) , mh_file.num_hashes() ) ) {
+      buckets.push_back( make_pair( minhash_band_hash( mh_file.signature( i ) ,
+						       band_num , rows_per_band ) ,
+				    i ) );
+    }
+  }
+  sort( buckets.begin() , buckets.end() );
+  unsigned int num_rows = buckets.size();
+
+  unsigned int num_skipped = 0;
+  for( unsigned int start = 0 , end = 0 ; start < num_rows ; start = end ) {
+    for( end = start + 1 ;
+	 end < num_rows && buckets[end].first == buckets[start].first ; ++end ) {}
+    if( max_bucket && end - start > max_bucket ) {
+      // the buckets are in hash order, so these are too
+      skipped_hashes[band_num].push_back( buckets[start].first );
+      ++num_skipped;
+      continue;
+    }
+    for( unsigned int i = start ; i < end ; ++i ) {
+      const boost::uint32_t *sig1 = mh_file.signature( buckets[i].second );
+      for( unsigned int j = i + 1 ; j < end ; ++j ) {
+	const boost::uint32_t *sig2 = mh_file.signature( buckets[j].second );
+	// the hashes could be the same by chance
+	if( !same_band( sig1 , sig2 , band_num , rows_per_band ) ) {
+	  continue;
+	}
+	if( pair_already_written( sig1 , sig2 , band_num , rows_per_band ,
+				  skipped_hashes ) ) {
+	  continue;
+	}
+	double sim = minhash_similarity( sig1 , sig2 , mh_file.num_hashes() );
+	if( sim >= threshold ) {
+	  os << mh_file.title( buckets[i].second ) << " "
+	     << mh_file.title( buckets[j].second ) << " " << sim << "\n";
+	  ++num_pairs;
+	}
+      }
+    }
+  }
+
+  return num_skipped;
+
+}
+
+// ***************************************************************************
+int main( int argc , char **argv ) {
+
+  string db_filename , output_filename;
+  double threshold;
+  unsigned int num_bands , rows_per_band , max_bucket;
+
+  cerr << "smg_lsh : " << BUILD_TIME << endl;
+
+  parse_args( argc , argv , db_filename , output_filename , threshold ,
+	      num_bands , rows_per_band , max_bucket );
+
+  boost::scoped_ptr<MinHashFile> mh_file;
+  try {
+    mh_file.reset( new MinHashFile( db_filename ) );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+
+  if( !num_bands ) {
+    minhash_choose_bands( mh_file->num_hashes() , threshold , num_bands ,
+			  rows_per_band );
+  } else if( num_bands * rows_per_band > mh_file->num_hashes() ) {
+    cerr << "-bands times -rows can't be more than the " << mh_file->num_hashes()
+	 << " values in the signatures." << endl;
+    exit( 1 );
+  }
+  cerr << "Read " << mh_file->num_rows() << " signatures of "
+       << mh_file->num_hashes() << " values from " << db_filename
+       << ", using " << num_bands << " bands of " << rows_per_band
+       << "." << endl;
+  unsigned int num_empty = 0;
+  for( unsigned int i = 0 , is = mh_file->num_rows() ; i < is ; ++i ) {
+    num_empty += minhash_is_empty( mh_file->signature( i ) ,
+				   mh_file->num_hashes() );
+  }
+  if( num_empty ) {
+    cout << "Warning : " << num_empty << " molecules have no features, so"
+	 << " won't be in any pairs." << endl;
+  }
+
+  try {
+    CompressedOFStream os( output_filename );
+    vector<pair<boost::uint64_t,unsigned int> > buckets;
+    vector<vector<boost::uint64_t> > skipped_hashes( num_bands );
+    size_t num_pairs = 0;
+    unsigned int num_skipped = 0;
+    for( unsigned int i = 0 ; i < num_bands ; ++i ) {
+      num_skipped += write_band_pairs( *mh_file , i , rows_per_band , threshold ,
+				       max_bucket , buckets , skipped_hashes , os ,
+				       num_pairs );
+      cerr << "Done band " << i + 1 << ", " << num_pairs << " pairs so far."
+	   << endl;
+    }
+    os.close();
+    if( num_skipped ) {
+      cout << "Warning : skipped " << num_skipped << " buckets with more than "
+	   << max_bucket << " molecules." << endl;
+    }
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    exit( 1 );
+  }
+
+}
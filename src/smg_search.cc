@@ -0,0 +1,449 @@
+//
+// file smg_search.cc
+// agent
+// 17th October 2026
+//
+// smg_search finds the molecules in a binary fingerprint file written by
+// smg -output_format binary, folded or not, that are most similar to each of
+// a file of query molecules, by Tanimoto. The queries' fingerprints are made
+// in the same way as smg makes them, so the SMARTS and points files, and
+// any distance limits, must be the same as the ones the database was made
+// with. Only the query features that are columns in the database count.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "AtomTyper.H"
+#include "BinaryBitsFile.H"
+#include "CompressedOFStream.H"
+#include "FileExceptions.H"
+#include "FingerprintStore.H"
+#include "MoleculePipeline.H"
+#include "PharmPoint.H"
+#include "SMARTSExceptions.H"
+#include "SpivMolecule.H"
+#include "popcount_kernels.H"
+#include "smg_features.H"
+
+using namespace boost;
+using namespace OEChem;
+using namespace std;
+
+namespace DACLIB {
+  void read_smarts_file( const string &smarts_file ,
+			 vector<pair<string,string> > &input_smarts ,
+			 vector<pair<string,string> > &smarts_sub_defn );
+}
+
+extern string BUILD_TIME; // in build_time.cc
+
+// ***************************************************************************
+void print_usage( ostream &os ) {
+
+  os << "smg_search -db <string>" << endl
+     << "    -mo[lecule_file] <string>" << endl
+     << "    -sm[arts_file] <string>" << endl
+     << "    -po[ints_file] <string>" << endl
+     << "    [-ou[tput_file] <string>]" << endl
+     << "    [-mi[n_dist] <int>]"
+     << "    [-ma[x_dist] <int>] (0 to " << SPIV_MAX_DIST - 1 << ", default 100)"
+     << endl
+     << "    [-th[reads] <int>]" << endl
+     << "    [-to[p_k] <int>]" << endl
+     << "    [-si[milarity] <float>]" << endl
+     << "The database is a binary fingerprint file from smg, and the query"
+     << " fingerprints" << endl
+     << "must be made with the same SMARTS and points files and distances."
+     << endl
+     << "The default is the best 10 hits. With -similarity and no -top_k,"
+     << " it's all" << endl
+     << "the hits at least that similar, and -top_k 0 is no limit." << endl
+     << "Output is lines of query name, hit name and Tanimoto, to standard"
+     << " output" << endl
+     << "if there's no -output_file." << endl;
+
+}
+
+// ***************************************************************************
+void parse_args( int argc , char **argv , string &db_filename ,
+		 string &mol_filename , string &smarts_filename ,
+		 string &points_filename , string &output_filename ,
+		 int &min_dist , int &max_dist , int &num_threads ,
+		 unsigned int &top_k , double &threshold ) {
+
+  if( 1 == argc ) {
+    print_usage( cout );
+    exit( 0 );
+  }
+  min_dist = 0;
+  max_dist = 100;
+  num_threads = 1;
+  top_k = 10;
+  threshold = 0.0;
+  bool top_k_set = false , threshold_set = false;
+
+  for( int i = 1 ; i < argc ; ++i ) {
+    if( !strcmp( argv[i] , "-db" ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-db requires a second argument.";
+	exit( 1 );
+      }
+      db_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-molecule_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-molecule_file requires a second argument.";
+	exit( 1 );
+      }
+      mol_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-points_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-points_file requires a second argument.";
+	exit( 1 );
+      }
+      points_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-smarts_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-smarts_file requires a second argument.";
+	exit( 1 );
+      }
+      smarts_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-output_file" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-output_file requires a second argument.";
+	exit( 1 );
+      }
+      output_filename = argv[i];
+    } else if( !strncmp( argv[i] , "-min_dist" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-min_dist requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	min_dist = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-min_dist requires an integer argument." << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-max_dist" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-max_dist requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	max_dist = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-max_dist requires an integer argument." << endl;
+	exit( 1 );
+      }
+      // the distances have SPIV_DIST_BITS in the feature keys, and there's no
+      // longer a way of asking for no distances at all with a -ve max_dist.
+      if( max_dist < 0 || max_dist >= SPIV_MAX_DIST ) {
+	cerr << "-max_dist must be from 0 to " << SPIV_MAX_DIST - 1 << "."
+	     << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-threads" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-threads requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	num_threads = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-threads requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( num_threads < 1 ) {
+	cerr << "-threads requires a positive integer argument." << endl;
+	exit( 1 );
+      }
+    } else if( !strncmp( argv[i] , "-top_k" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-top_k requires a second argument.";
+	exit( 1 );
+      }
+      int tk = 0;
+      try {
+	tk = lexical_cast<int>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-top_k requires an integer argument." << endl;
+	exit( 1 );
+      }
+      if( tk < 0 ) {
+	cerr << "-top_k can't be negative." << endl;
+	exit( 1 );
+      }
+      top_k = tk;
+      top_k_set = true;
+    } else if( !strncmp( argv[i] , "-similarity" , 3 ) ) {
+      ++i;
+      if( i == argc ) {
+	cerr << "-similarity requires a second argument.";
+	exit( 1 );
+      }
+      try {
+	threshold = lexical_cast<double>( argv[i] );
+      } catch( bad_lexical_cast &e ) {
+	cerr << "-similarity requires a numerical argument." << endl;
+	exit( 1 );
+      }
+      if( threshold < 0.0 || threshold > 1.0 ) {
+	cerr << "-similarity must be between 0.0 and 1.0." << endl;
+	exit( 1 );
+      }
+      threshold_set = true;
+    } else if( !strncmp( argv[i] , "-help" , 2 ) ) {
+      print_usage( cout );
+      exit( 0 );
+    } else {
+      cerr << "Unrecognised option " << argv[i] << "." << endl;
+      print_usage( cerr );
+      exit( 1 );
+    }
+  }
+
+  if( threshold_set && !top_k_set ) {
+    top_k = 0;
+  }
+
+  if( db_filename.empty() ) {
+    cerr << "No database file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( mol_filename.empty() ) {
+    cerr << "No molecule file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( smarts_filename.empty() ) {
+    cerr << "No SMARTS file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+  if( points_filename.empty() ) {
+    cerr << "No points file specfied." << endl;
+    print_usage( cerr );
+    exit( 1 );
+  }
+
+}
+
+// ***************************************************************************
+// work out from the column names and labels what sort of fingerprints are
+// in the database. Folded columns are labelled fold<bits>:<bit>.
+void database_fingerprint_type( const BinaryBitsFile &bits_file ,
+				SMG_OUTPUT_TYPE &output_type ,
+				unsigned int &fold_bits ) {
+
+  if( !bits_file.num_cols() ) {
+    throw( string( "The database has no columns." ) );
+  }
+  const string &col_name = bits_file.col_name( 0 );
+  if( !col_name.empty() && 'S' == col_name[0] ) {
+    output_type = SMG_SITES;
+  } else if( !col_name.empty() && 'P' == col_name[0] ) {
+    output_type = SMG_PAIRS;
+  } else if( !col_name.empty() && 'T' == col_name[0] ) {
+    output_type = SMG_TRIPLETS;
+  } else {
+    throw( string( "Can't tell the fingerprint type from column name " ) +
+	   col_name + "." );
+  }
+  fold_bits = 0;
+  if( !bits_file.col_label( 0 ).compare( 0 , 4 , "fold" ) ) {
+    fold_bits = bits_file.num_cols();
+  }
+
+}
+
+// ***************************************************************************
+// set the bits in query for the features in feat_keys, which are the bit
+// numbers if the database is folded, and otherwise looked up via their
+// labels in col_nums, with key_cols remembering the answers.
+void make_query_fingerprint( const vector<boost::uint64_t> &feat_keys ,
+			     const SMG_FEATURE_OPTS &feat_opts ,
+			     const boost::unordered_map<string,unsigned int> &col_nums ,
+			     boost::unordered_map<boost::uint64_t,int> &key_cols ,
+			     vector<boost::uint64_t> &query ) {
+
+  fill( query.begin() , query.end() , 0 );
+  for( int i = 0 , is = feat_keys.size() ; i < is ; ++i ) {
+    int col = -1;
+    if( feat_opts.fold_bits_ ) {
+      col = feat_keys[i];
+    } else {
+      boost::unordered_map<boost::uint64_t,int>::iterator p = key_cols.find( feat_keys[i] );
+      if( p == key_cols.end() ) {
+	boost::unordered_map<string,unsigned int>::const_iterator q =
+	  col_nums.find( feature_key_label( feat_keys[i] ,
+					    feat_opts.output_type_ ,
+					    feat_opts.type_names_ ) );
+	p = key_cols.insert( make_pair( feat_keys[i] ,
+					q == col_nums.end() ? -1 : int( q->second ) ) ).first;
+      }
+      col = p->second;
+    }
+    if( col >= 0 ) {
+      query[col / 64] |= boost::uint64_t( 1 ) << ( col % 64 );
+    }
+  }
+
+}
+
+// ***************************************************************************
+int main( int argc , char **argv ) {
+
+  string db_filename , mol_filename , smarts_filename , points_filename;
+  string output_filename;
+  int min_dist , max_dist , num_threads;
+  unsigned int top_k;
+  double threshold;
+
+  cerr << "smg_search : "
+       << BUILD_TIME << " using OEToolits version "
+       << OEChem::OEChemGetRelease() << "." << endl;
+
+  parse_args( argc , argv , db_filename , mol_filename , smarts_filename ,
+	      points_filename , output_filename , min_dist , max_dist ,
+	      num_threads , top_k , threshold );
+
+  SMG_FEATURE_OPTS feat_opts;
+  feat_opts.min_dist_ = min_dist;
+  feat_opts.max_dist_ = max_dist;
+  feat_opts.num_hashes_ = 0;
+  boost::scoped_ptr<BinaryBitsFile> bits_file;
+  boost::scoped_ptr<FingerprintStore> fp_store;
+  boost::unordered_map<string,unsigned int> col_nums;
+  try {
+    bits_file.reset( new BinaryBitsFile( db_filename ) );
+    database_fingerprint_type( *bits_file , feat_opts.output_type_ ,
+			       feat_opts.fold_bits_ );
+    fp_store.reset( new FingerprintStore( *bits_file , num_threads ) );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+  if( !feat_opts.fold_bits_ ) {
+    for( unsigned int i = 0 ; i < bits_file->num_cols() ; ++i ) {
+      col_nums.insert( make_pair( bits_file->col_label( i ) , i ) );
+    }
+  }
+  cerr << "Loaded " << fp_store->num_rows() << " fingerprints of "
+       << fp_store->num_cols() << " bits from " << db_filename
+       << ", searching with the " << and_popcount_kernel_name()
+       << " popcount." << endl;
+
+  vector<pair<string,string> > input_smarts , smarts_sub_defn;
+  try {
+    DACLIB::read_smarts_file( smarts_filename , input_smarts , smarts_sub_defn );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( DACLIB::SMARTSSubDefnError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( DACLIB::SMARTSFileError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  }
+
+  PharmPoint pharm_points;
+  try {
+    pharm_points.read_points_file( points_filename );
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  }
+  point_type_names( pharm_points , feat_opts.type_names_ );
+
+  // each thread needs its own AtomTyper, as they hold OESubSearch objects
+  vector<AtomTyper *> thread_typers( num_threads );
+  try {
+    for( int i = 0 ; i < num_threads ; ++i ) {
+      thread_typers[i] = new AtomTyper( input_smarts , smarts_sub_defn );
+    }
+  } catch( string msg ) {
+    cout << msg << endl;
+    cerr << msg << endl;
+    exit( 1 );
+  }
+
+  oemolistream ims( mol_filename.c_str() );
+  if( !ims ) {
+    cerr << "File " << mol_filename << " could not be read." << endl;
+    exit( 1 );
+  }
+
+  boost::scoped_ptr<CompressedOFStream> file_out;
+  try {
+    if( !output_filename.empty() ) {
+      file_out.reset( new CompressedOFStream( output_filename ) );
+    }
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    cerr << e.what() << endl;
+    exit( 1 );
+  } catch( string msg ) {
+    cout << msg << endl;
+    exit( 1 );
+  }
+  ostream &os = file_out ? *file_out : cout;
+
+  // the queries' fingerprints are made by the pipeline threads, and then
+  // each one searched for with all the threads.
+  MoleculePipeline pipeline( ims , num_threads ,
+			     boost::bind( &process_molecule , _1 , _2 , _3 , _4 ,
+					  boost::ref( pharm_points ) ,
+					  boost::ref( thread_typers ) ,
+					  boost::cref( feat_opts ) ,
+					  static_cast<SmgProfile *>( 0 ) ) );
+  string mol_name;
+  vector<boost::uint64_t> feat_keys , query;
+  boost::unordered_map<boost::uint64_t,int> key_cols;
+  vector<FP_SEARCH_HIT> hits;
+  fp_store->make_query( query );
+  try {
+    while( pipeline.next_result( mol_name , feat_keys ) ) {
+      make_query_fingerprint( feat_keys , feat_opts , col_nums , key_cols ,
+			      query );
+      fp_store->search( query , threshold , top_k , hits );
+      for( int i = 0 , is = hits.size() ; i < is ; ++i ) {
+	os << mol_name << " " << bits_file->title( hits[i].row_ ) << " "
+	   << hits[i].tanimoto_ << "\n";
+      }
+    }
+    if( file_out ) {
+      file_out->close();
+    }
+  } catch( string msg ) {
+    cout << msg << endl;
+    exit( 1 );
+  }
+
+}
@@ -0,0 +1,395 @@
+//
+// file sparse_bits_output.cc
+// agent
+// 17th October 2026
+//
+// Functions for writing the fingerprints in sparse formats - libsvm text and
+// CSR matrices as NumPy .npy and .npz files. The NumPy files are written
+// directly, following the format description in numpy/lib/format.py, and the
+// .npz is a zip file with the entries stored, not compressed.
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/crc.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "CompressedOFStream.H"
+#include "FeatureDictionary.H"
+#include "FeatureSpillFile.H"
+#include "FileExceptions.H"
+#include "sparse_bits_output.H"
+
+using namespace std;
+
+namespace {
+
+// ****************************************************************************
+// the next molecule from the spill file, with its columns in ascending order
+bool next_sparse_row( FeatureSpillFile &spill_file , const vector<int> &id_cols ,
+		      string &mol_name , vector<unsigned int> &feat_ids ,
+		      vector<boost::int32_t> &cols ) {
+
+  if( !spill_file.read_molecule( mol_name , feat_ids ) ) {
+    return false;
+  }
+  cols.clear();
+  for( int i = 0 , is = feat_ids.size() ; i < is ; ++i ) {
+    if( -1 != id_cols[feat_ids[i]] ) {
+      cols.push_back( id_cols[feat_ids[i]] );
+    }
+  }
+  sort( cols.begin() , cols.end() );
+  return true;
+
+}
+
+// ****************************************************************************
+void make_id_cols( const FeatureDictionary &feat_dict ,
+		   const vector<unsigned int> &col_ids ,
+		   vector<int> &id_cols ) {
+
+  id_cols = vector<int>( feat_dict.size() , -1 );
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    id_cols[col_ids[i]] = i;
+  }
+
+}
+
+// ****************************************************************************
+void open_output( const string &filename , ofstream &ofs ) {
+
+  ofs.open( filename.c_str() , ios::out | ios::binary );
+  if( !ofs ) {
+    throw DACLIB::FileWriteOpenError( filename.c_str() );
+  }
+
+}
+
+// ****************************************************************************
+void check_output( const string &filename , ofstream &ofs ) {
+
+  if( !ofs ) {
+    throw( string( "Error writing file " ) + filename +
+	   ", possibly out of disk space." );
+  }
+
+}
+
+// ****************************************************************************
+// first pass through the spill file, writing the titles file and making
+// the CSR row pointers.
+void make_indptr( const string &output_filename , const vector<int> &id_cols ,
+		  FeatureSpillFile &spill_file ,
+		  vector<boost::int64_t> &indptr ) {
+
+  string titles_filename = output_filename + ".titles";
+  ofstream ofs;
+  open_output( titles_filename , ofs );
+
+  indptr.clear();
+  indptr.reserve( spill_file.num_molecules() + 1 );
+  indptr.push_back( 0 );
+  string mol_name;
+  vector<unsigned int> feat_ids;
+  vector<boost::int32_t> cols;
+  spill_file.rewind();
+  while( next_sparse_row( spill_file , id_cols , mol_name , feat_ids , cols ) ) {
+    ofs << mol_name << '\n';
+    indptr.push_back( indptr.back() + cols.size() );
+  }
+  check_output( titles_filename , ofs );
+
+}
+
+// ****************************************************************************
+// the .npy type string for a type of the given size, '<' or '>' depending on
+// the byte order of this machine.
+string npy_descr( char kind , int num_bytes ) {
+
+  boost::uint16_t one = 1;
+  char order = 1 == num_bytes ? '|' :
+    ( *reinterpret_cast<char *>( &one ) ? '<' : '>' );
+  return string( 1 , order ) + kind + boost::lexical_cast<string>( num_bytes );
+
+}
+
+// ****************************************************************************
+// the .npy version 1.0 header for a C-ordered array. shape is "" for a
+// scalar, "n," for a 1D array.
+string npy_header( const string &descr , const string &shape ) {
+
+  string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': ("
+    + shape + "), }";
+  // magic, version, header length, dict and '\n' padded to a multiple of 64
+  int hdr_len = dict.length() + 1;
+  hdr_len += ( 64 - ( 10 + hdr_len ) % 64 ) % 64;
+  dict.resize( hdr_len - 1 , ' ' );
+  dict += '\n';
+
+  string hdr( "\x93NUMPY\x01\x00" , 8 );
+  hdr += char( hdr_len & 0xff );
+  hdr += char( ( hdr_len >> 8 ) & 0xff );
+  return hdr + dict;
+
+}
+
+// ****************************************************************************
+string npy_shape( boost::uint64_t len ) {
+
+  return boost::lexical_cast<string>( len ) + ",";
+
+}
+
+// ****************************************************************************
+// writes a zip file a stored entry at a time, filling in each entry's
+// local header once its size and CRC are known.
+class ZipStoreWriter {
+
+public :
+
+  explicit ZipStoreWriter( const string &filename ) : filename_( filename ) {
+    open_output( filename_ , ofs_ );
+  }
+
+  void begin_entry( const string &name ) {
+    ENTRY e;
+    e.name_ = name;
+    e.offset_ = ofs_.tellp();
+    e.crc_ = e.size_ = 0;
+    entries_.push_back( e );
+    crc_.reset();
+    write_local_header( e );
+  }
+  void write( const void *data , boost::uint64_t len ) {
+    ofs_.write( static_cast<const char *>( data ) , len );
+    crc_.process_bytes( data , len );
+    entries_.back().size_ += len;
+  }
+  void end_entry() {
+    ENTRY &e = entries_.back();
+    e.crc_ = crc_.checksum();
+    check_size( e.size_ );
+    boost::uint64_t end = ofs_.tellp();
+    ofs_.seekp( e.offset_ );
+    write_local_header( e );
+    ofs_.seekp( end );
+  }
+  // the central directory
+  void close() {
+    boost::uint64_t cd_start = ofs_.tellp();
+    for( int i = 0 , is = entries_.size() ; i < is ; ++i ) {
+      const ENTRY &e = entries_[i];
+      put32( 0x02014b50 );
+      put16( 20 ); // version made by
+      put_common( e );
+      put16( 0 ); // comment length
+      put16( 0 ); // disk number
+      put16( 0 ); // internal attributes
+      put32( 0 ); // external attributes
+      check_size( e.offset_ );
+      put32( e.offset_ );
+      ofs_.write( e.name_.data() , e.name_.length() );
+    }
+    boost::uint64_t cd_end = ofs_.tellp();
+    check_size( cd_end );
+    put32( 0x06054b50 );
+    put16( 0 );
+    put16( 0 );
+    put16( entries_.size() );
+    put16( entries_.size() );
+    put32( cd_end - cd_start );
+    put32( cd_start );
+    put16( 0 );
+    ofs_.close();
+    check_output( filename_ , ofs_ );
+  }
+
+private :
+
+  typedef struct {
+    string name_;
+    boost::uint64_t offset_;
+    boost::uint32_t crc_;
+    boost::uint64_t size_;
+  } ENTRY;
+
+  string filename_;
+  ofstream ofs_;
+  vector<ENTRY> entries_;
+  boost::crc_32_type crc_;
+
+  void put16( unsigned int val ) {
+    char buf[2] = { char( val & 0xff ) , char( ( val >> 8 ) & 0xff ) };
+    ofs_.write( buf , 2 );
+  }
+  void put32( boost::uint32_t val ) {
+    put16( val & 0xffff );
+    put16( val >> 16 );
+  }
+  // the part of the local and central headers from version needed to
+  // extra field length.
+  void put_common( const ENTRY &e ) {
+    put16( 20 ); // version needed
+    put16( 0 ); // flags
+    put16( 0 ); // stored
+    put16( 0 ); // time
+    put16( 0x21 ); // date, 1st Jan 1980
+    put32( e.crc_ );
+    put32( e.size_ ); // compressed
+    put32( e.size_ ); // uncompressed
+    put16( e.name_.length() );
+    put16( 0 ); // extra field length
+  }
+  void write_local_header( const ENTRY &e ) {
+    put32( 0x04034b50 );
+    put_common( e );
+    ofs_.write( e.name_.data() , e.name_.length() );
+  }
+  void check_size( boost::uint64_t size ) {
+    if( size > 0xffffffffULL ) {
+      throw( filename_ + string( " would be over 4GB, which is too big for" )
+	     + string( " npz output. Use csr output instead." ) );
+    }
+  }
+
+};
+
+} // end of anonymous namespace
+
+// ****************************************************************************
+void write_libsvm_file( const string &output_filename ,
+			const FeatureDictionary &feat_dict ,
+			const vector<unsigned int> &col_ids ,
+			FeatureSpillFile &spill_file ) {
+
+  vector<int> id_cols;
+  make_id_cols( feat_dict , col_ids , id_cols );
+
+  // the libsvm file is often the big one, so can be compressed
+  CompressedOFStream ofs( output_filename );
+  CompressedOFStream tofs( CompressedStreamBuf::part_name( output_filename ,
+							   ".titles" ) );
+
+  string mol_name;
+  vector<unsigned int> feat_ids;
+  vector<boost::int32_t> cols;
+  spill_file.rewind();
+  while( next_sparse_row( spill_file , id_cols , mol_name , feat_ids , cols ) ) {
+    tofs << mol_name << '\n';
+    ofs << '0';
+    for( int i = 0 , is = cols.size() ; i < is ; ++i ) {
+      ofs << ' ' << cols[i] + 1 << ":1";
+    }
+    ofs << '\n';
+  }
+  ofs.close();
+  tofs.close();
+
+}
+
+// ****************************************************************************
+void write_csr_npy_files( const string &output_filename ,
+			  const FeatureDictionary &feat_dict ,
+			  const vector<unsigned int> &col_ids ,
+			  FeatureSpillFile &spill_file ) {
+
+  vector<int> id_cols;
+  make_id_cols( feat_dict , col_ids , id_cols );
+  vector<boost::int64_t> indptr;
+  make_indptr( output_filename , id_cols , spill_file , indptr );
+
+  string indptr_filename = output_filename + ".indptr.npy";
+  ofstream ofs;
+  open_output( indptr_filename , ofs );
+  string hdr = npy_header( npy_descr( 'i' , 8 ) , npy_shape( indptr.size() ) );
+  ofs.write( hdr.data() , hdr.length() );
+  ofs.write( reinterpret_cast<const char *>( &indptr[0] ) ,
+	     indptr.size() * sizeof( boost::int64_t ) );
+  ofs.close();
+  check_output( indptr_filename , ofs );
+
+  string indices_filename = output_filename + ".indices.npy";
+  open_output( indices_filename , ofs );
+  hdr = npy_header( npy_descr( 'i' , 4 ) , npy_shape( indptr.back() ) );
+  ofs.write( hdr.data() , hdr.length() );
+  string mol_name;
+  vector<unsigned int> feat_ids;
+  vector<boost::int32_t> cols;
+  spill_file.rewind();
+  while( next_sparse_row( spill_file , id_cols , mol_name , feat_ids , cols ) ) {
+    if( !cols.empty() ) {
+      ofs.write( reinterpret_cast<const char *>( &cols[0] ) ,
+		 cols.size() * sizeof( boost::int32_t ) );
+    }
+  }
+  ofs.close();
+  check_output( indices_filename , ofs );
+
+}
+
+// ****************************************************************************
+void write_csr_npz_file( const string &output_filename ,
+			 const FeatureDictionary &feat_dict ,
+			 const vector<unsigned int> &col_ids ,
+			 FeatureSpillFile &spill_file ) {
+
+  vector<int> id_cols;
+  make_id_cols( feat_dict , col_ids , id_cols );
+  vector<boost::int64_t> indptr;
+  make_indptr( output_filename , id_cols , spill_file , indptr );
+  boost::int64_t nnz = indptr.back();
+
+  // these are the arrays that scipy.sparse.save_npz writes for a CSR matrix
+  ZipStoreWriter zip( output_filename );
+
+  zip.begin_entry( "indices.npy" );
+  string hdr = npy_header( npy_descr( 'i' , 4 ) , npy_shape( nnz ) );
+  zip.write( hdr.data() , hdr.length() );
+  string mol_name;
+  vector<unsigned int> feat_ids;
+  vector<boost::int32_t> cols;
+  spill_file.rewind();
+  while( next_sparse_row( spill_file , id_cols , mol_name , feat_ids , cols ) ) {
+    if( !cols.empty() ) {
+      zip.write( &cols[0] , cols.size() * sizeof( boost::int32_t ) );
+    }
+  }
+  zip.end_entry();
+
+  zip.begin_entry( "indptr.npy" );
+  hdr = npy_header( npy_descr( 'i' , 8 ) , npy_shape( indptr.size() ) );
+  zip.write( hdr.data() , hdr.length() );
+  zip.write( &indptr[0] , indptr.size() * sizeof( boost::int64_t ) );
+  zip.end_entry();
+
+  zip.begin_entry( "format.npy" );
+  hdr = npy_header( "|S3" , "" );
+  zip.write( hdr.data() , hdr.length() );
+  zip.write( "csr" , 3 );
+  zip.end_entry();
+
+  zip.begin_entry( "shape.npy" );
+  hdr = npy_header( npy_descr( 'i' , 8 ) , npy_shape( 2 ) );
+  zip.write( hdr.data() , hdr.length() );
+  boost::int64_t shape[2] = { boost::int64_t( indptr.size() - 1 ) ,
+			      boost::int64_t( col_ids.size() ) };
+  zip.write( shape , sizeof( shape ) );
+  zip.end_entry();
+
+  // all the values are 1, as booleans
+  zip.begin_entry( "data.npy" );
+  hdr = npy_header( "|b1" , npy_shape( nnz ) );
+  zip.write( hdr.data() , hdr.length() );
+  vector<char> ones( 65536 , 1 );
+  for( boost::int64_t done = 0 ; done < nnz ; done += ones.size() ) {
+    zip.write( &ones[0] , min( boost::int64_t( ones.size() ) , nnz - done ) );
+  }
+  zip.end_entry();
+
+  zip.close();
+
+}
@@ -11,11 +11,17 @@
 #include <vector>
 
 #include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread.hpp>
 
 #include <oechem.h>
 
-#include "crash.H"
 #include "stddefs.H"
+#include "BinaryBitsFile.H"
+#include "CompressedOFStream.H"
+#include "FeatureDictionary.H"
+#include "FeatureSpillFile.H"
+#include "FileExceptions.H"
 #include "PharmPoint.H"
 
 using namespace std;
@@ -51,37 +57,6 @@ void expand_smarts_defs( const vector<pair<string,string> > &input_smarts ,
 
 }
 
-// ****************************************************************************
-// build a list of unique names for the features found, with a count of each
-void build_unique_names( const vector<vector<string> > &feature_names ,
-			 map<string,int> &uniq_names ) {
-
-  vector<vector<string> >::const_iterator r , rs;
-  vector<string>::const_iterator q , qs;
-  map<string,int>::iterator p;
-  vector<string> mol_uniq_names;
-  vector<string>::iterator t , ts;
-
-  // build the list of all sites that appear in any molecule, counting how many
-  // each occurs, just counting 1 occurrence per mol.
-  for( r = feature_names.begin() , rs = feature_names.end() ; r != rs ; ++r ) {
-    q = r->begin() + 1; // first name in vector is molecule name
-
-    mol_uniq_names = vector<string>( r->begin() + 1 , r->end() );
-    sort( mol_uniq_names.begin() , mol_uniq_names.end() );
-    mol_uniq_names.erase( unique( mol_uniq_names.begin() , mol_uniq_names.end() ) ,
-			  mol_uniq_names.end() );
-    for( t = mol_uniq_names.begin() , ts = mol_uniq_names.end() ; t != ts ; ++t ) {
-      p = uniq_names.find( *t );      
-      if( p == uniq_names.end() )
-	uniq_names.insert( make_pair( *t , 1 ) );
-      else
-	p->second++;
-    }
-  }
-
-}
-
 // ****************************************************************************
 // convert a long feature name into a number, by hashing
 string hash_feature_name( const string &fn ) {
@@ -100,197 +75,244 @@ string hash_feature_name( const string &fn ) {
 }
 
 // ****************************************************************************
-// build the short names from the unique names for the feature types, using
-// SuperFastHash, warning of any collisions. Only do it for this names that
-// match the min_occur criterion, as they'll be the only ones we're using.
-// The returned vector has the short name first in each pair, the long name
-// second.
-void build_short_feature_names( const map<string,int> &uniq_names ,
-				int min_occur , char feat_label ,
-				vector<pair<string,string> > &short_names ) {
-
-  short_names.clear();
-  map<string,int>::const_iterator s , ss;
-  for( s = uniq_names.begin() , ss = uniq_names.end() ; s != ss ; ++s ) {
-    if( s->second >= min_occur ) {
-      short_names.push_back( make_pair( hash_feature_name( s->first ) ,
-					s->first ) );
-    }
+// which of fold_bits bits the feature goes into
+unsigned int fold_feature_name( const string &fn , unsigned int fold_bits ) {
+
+  return MurmurHash2( fn.c_str() , fn.length() , MAGIC_INT ) % fold_bits;
+
+}
+
+// ****************************************************************************
+unsigned int feature_name_hash( const string &fn ) {
+
+  return MurmurHash2( fn.c_str() , fn.length() , MAGIC_INT );
+
+}
+
+// ****************************************************************************
+void write_name_decode_file( const string &decode_filename , char feat_label ,
+			     const FeatureDictionary &feat_dict ,
+			     const vector<unsigned int> &col_ids ) {
+
+  CompressedOFStream ofs1( decode_filename );
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    ofs1 << feat_label << feat_dict.short_name( col_ids[i] ) << " "
+	 << feat_dict.label( col_ids[i] ) << endl;
   }
+  ofs1.close();
 
-  // now check for any collisions. Do it on a copy, we don't want to change the
-  // order of the output vector
-  vector<pair<string,string> > tmp_short_names( short_names );
-  sort( tmp_short_names.begin() , tmp_short_names.end() ,
-	boost::bind( less<string>() ,
-		     boost::bind( &pair<string,string>::first , _1 ) ,
-		     boost::bind( &pair<string,string>::first , _2 ) ) );
+}
 
-  vector<pair<string,string> >::iterator where = tmp_short_names.begin();
-  vector<pair<string,string> >::iterator stop = tmp_short_names.end();
+// ****************************************************************************
+void write_bits_header( ostream &os , const vector<string> &col_names ) {
 
-#ifdef NOTYET
-  vector<pair<string,string> >::iterator r , rs;
-  for( r = tmp_short_names.begin() , rs = tmp_short_names.end() ; r != rs ; ++r )
-    cout << r->first << " : " << r->second << endl;
-#endif
+  os << "Molecule";
+  for( int i = 0 , is = col_names.size() ; i < is ; ++i ) {
+    os << " " << col_names[i];
+  }
+  os << '\n';
+
+}
 
-  while( ( where = adjacent_find( where , stop ,
-				  boost::bind( equal_to<string>() ,
-					       boost::bind( &pair<string,string>::first , _1 ) ,
-					       boost::bind( &pair<string,string>::first , _2 ) ) ) ) != stop ) {
-    cout << "AWOOGA Collision : " << where->second << " and " << (where-1)->second
-	 << " have the same short name " << feat_label << where->first << endl;
-    ++where;
+// ****************************************************************************
+void make_bits_row_template( int num_cols , string &row_template ) {
+
+  row_template.clear();
+  row_template.reserve( 2 * num_cols );
+  for( int i = 0 ; i < num_cols ; ++i ) {
+    row_template += " 0";
   }
 
 }
 
 // ****************************************************************************
-// write a file that decodes the bit headings, so as not to have the headings
-// unfeasibly long
-void write_name_decode_file( const string &decode_filename , char feat_label ,
-			     const vector<pair<string,string> > &short_names ) {
+// The row is the name and a copy of row_template, with the '0' turned to a
+// '1' for each column the molecule has.
+void format_bits_row( const string &mol_name ,
+		      const vector<unsigned int> &feat_ids ,
+		      const vector<int> &id_cols , const string &row_template ,
+		      string &buf ) {
+
+  buf += mol_name;
+  string::size_type row_start = buf.length();
+  buf += row_template;
+  for( int j = 0 , js = feat_ids.size() ; j < js ; ++j ) {
+    int col = id_cols[feat_ids[j]];
+    if( -1 != col ) {
+      buf[row_start + 2 * col + 1] = '1';
+    }
+  }
+  buf += '\n';
+
+}
 
-  ofstream ofs1( decode_filename.c_str() );
-  vector<pair<string,string> >::const_iterator s , ss;
-  for( s = short_names.begin() , ss = short_names.end() ; s != ss ; ++s ) {
-    ofs1 << feat_label << s->first << " " << s->second << endl;
+// ****************************************************************************
+// format rows first to last-1 of the molecules into buf, as text bits.
+static void format_bits_rows( const vector<pair<string,vector<unsigned int> > > &mols ,
+			      int first , int last , const vector<int> &id_cols ,
+			      const string &row_template , string &buf ) {
+
+  buf.clear();
+  for( int i = first ; i < last ; ++i ) {
+    format_bits_row( mols[i].first , mols[i].second , id_cols , row_template ,
+		     buf );
   }
 
 }
 
 // ****************************************************************************
 void write_bits_file( const string &output_filename , char feat_label ,
-		      const vector<pair<string,string> > &short_names ,
-		      const vector<vector<string> > &feature_names ) {
+		      const FeatureDictionary &feat_dict ,
+		      const vector<unsigned int> &col_ids ,
+		      FeatureSpillFile &spill_file , int num_threads ) {
 
   // write the bit headings
-  ofstream ofs2( output_filename.c_str() );
-  ofs2 << "Molecule";
-  vector<pair<string,string> >::const_iterator s , ss;
-  for( s = short_names.begin() , ss = short_names.end() ; s != ss ; ++s ) {
-    ofs2 << " " << feat_label << s->first;
+  CompressedOFStream ofs2( output_filename );
+  vector<string> col_names;
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    col_names.push_back( feat_label + feat_dict.short_name( col_ids[i] ) );
   }
-  ofs2 << endl;
-
-  // and the bits
-  vector<vector<string> >::const_iterator r , rs;
-  vector<string>::const_iterator q , qs;
-  for( r = feature_names.begin() , rs = feature_names.end(); r != rs ; ++r ) {
-    ofs2 << r->front();
-    vector<string> sorted_feature_names( r->begin() + 1 , r->end() );
-    sort( sorted_feature_names.begin() , sorted_feature_names.end() );
-    for( s = short_names.begin() , ss = short_names.end() ; s != ss ; ++s ) {
-      if( std::binary_search( sorted_feature_names.begin() ,
-			      sorted_feature_names.end() , s->second ) ) {
-	ofs2 << " 1";
-      } else {
-	ofs2 << " 0";
+  write_bits_header( ofs2 , col_names );
+
+  vector<int> id_cols( feat_dict.size() , -1 );
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    id_cols[col_ids[i]] = i;
+  }
+
+  // with tens of thousands of columns, the formatting is most of the work,
+  // so the molecules are read from the file in batches of about 64MB of
+  // output, and the batch formatted in num_threads separate buffers which
+  // are then written in order. The buffers are kept between batches.
+  string row_template;
+  make_bits_row_template( col_ids.size() , row_template );
+  int batch_size = max( 1 , int( ( 64 << 20 ) / ( row_template.length() + 32 ) ) );
+  batch_size = max( batch_size , num_threads );
+  vector<pair<string,vector<unsigned int> > > mols( batch_size );
+  vector<string> bufs( max( 1 , num_threads ) );
+
+  spill_file.rewind();
+  while( 1 ) {
+    int num_mols = 0;
+    while( num_mols < batch_size &&
+	   spill_file.read_molecule( mols[num_mols].first , mols[num_mols].second ) ) {
+      ++num_mols;
+    }
+    if( !num_mols ) {
+      break;
+    }
+    int num_bufs = min( int( bufs.size() ) , num_mols );
+    int chunk = ( num_mols + num_bufs - 1 ) / num_bufs;
+    if( 1 == num_bufs ) {
+      format_bits_rows( mols , 0 , num_mols , id_cols , row_template , bufs[0] );
+    } else {
+      boost::thread_group formatters;
+      for( int i = 0 ; i < num_bufs ; ++i ) {
+	formatters.create_thread( boost::bind( &format_bits_rows , boost::cref( mols ) ,
+					       i * chunk ,
+					       min( num_mols , ( i + 1 ) * chunk ) ,
+					       boost::cref( id_cols ) ,
+					       boost::cref( row_template ) ,
+					       boost::ref( bufs[i] ) ) );
       }
+      formatters.join_all();
+    }
+    for( int i = 0 ; i < num_bufs ; ++i ) {
+      ofs2.write( bufs[i].data() , bufs[i].length() );
+    }
+    if( num_mols < batch_size ) {
+      break;
     }
-    ofs2 << endl;
   }
+  ofs2.close();
 
 }
 
 // ****************************************************************************
-void write_labels_file( const string &output_filename , char feat_label ,
-			const vector<pair<string,string> > &short_names ,
-			const vector<vector<string> > &feature_names ) {
-
-  ofstream ofs2( output_filename.c_str() );
-
-  vector<vector<string> >::const_iterator r , rs;
-  vector<string>::const_iterator q , qs;
-  vector<pair<string,string> >::const_iterator s , ss;
-  for( r = feature_names.begin() , rs = feature_names.end(); r != rs ; ++r ) {
-    cout << "Molecule name : " << r->front() << endl;
-    ofs2 << r->front();
-    vector<string> sorted_feature_names( r->begin() + 1 , r->end() );
-    sort( sorted_feature_names.begin() , sorted_feature_names.end() );
-    sorted_feature_names.erase( unique( sorted_feature_names.begin() ,
-					sorted_feature_names.end() ) ,
-				sorted_feature_names.end() );
-    typedef vector<pair<string,string> >::const_iterator SNIter;
-    typedef pair<SNIter,SNIter> SNIterPair;
-    for( q = sorted_feature_names.begin() , qs = sorted_feature_names.end() ;
-	 q != qs ; ++q ) {
-      pair<string,string> search_pair = make_pair( "GARBAGE" , *q );
-      SNIterPair snp = equal_range( short_names.begin() , short_names.end() ,
-				    search_pair ,
-				    boost::bind( less<string>() ,
-						 boost::bind( &pair<string,string>::second , _1 ) ,
-						 boost::bind( &pair<string,string>::second , _2 ) ) );
-      if( snp.first == snp.second ) {
-	cerr << "A major bad karma event - " << *q
-	     << " didn't have a corresponding short name. Early bath indicated."
-	     << endl;
-	cout << "A major bad karma event - " << *q
-	     << " didn't have a corresponding short name. Early bath indicated."
-	     << endl;
-	DACLIB::crash();
-      }
-      // probably if I had more faith in my understanding of the STL, I wouldn't
-      // bother with this - it seems to come out first every time.
-      if( snp.first->second == *q ) {
-	ofs2 << " " << feat_label << snp.first->first;
-      } else {
-	ofs2 << " " << feat_label << snp.second->first;
+void write_binary_bits_file( const string &output_filename , char feat_label ,
+			     const FeatureDictionary &feat_dict ,
+			     const vector<unsigned int> &col_ids ,
+			     FeatureSpillFile &spill_file ) {
+
+  vector<string> col_names , col_labels;
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    col_names.push_back( feat_label + feat_dict.short_name( col_ids[i] ) );
+    col_labels.push_back( feat_dict.label( col_ids[i] ) );
+  }
+  BinaryBitsWriter writer( output_filename , col_names , col_labels );
+
+  vector<int> id_cols( feat_dict.size() , -1 );
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    id_cols[col_ids[i]] = i;
+  }
+
+  // the rows, a molecule at a time from the file
+  string mol_name;
+  vector<unsigned int> feat_ids , cols;
+  spill_file.rewind();
+  while( spill_file.read_molecule( mol_name , feat_ids ) ) {
+    cols.clear();
+    for( int i = 0 , is = feat_ids.size() ; i < is ; ++i ) {
+      if( -1 != id_cols[feat_ids[i]] ) {
+	cols.push_back( id_cols[feat_ids[i]] );
       }
     }
-    ofs2 << endl;
+    writer.add_row( mol_name , cols );
   }
+  writer.close();
 
 }
 
 // ****************************************************************************
-void build_hash_codes( const vector<vector<string> > &all_names ,
-		       char hash_prepend ,
-		       vector<pair<string,string> > &names_to_hash ,
-		       vector<pair<string,string> > &hash_to_names ) {
-
-  set<string> uniq_names;
-  vector<vector<string> >::const_iterator p , ps;
-  vector<string>::const_iterator q , qs;
-  for( p = all_names.begin() , ps = all_names.end() ; p != ps ; ++p ) {
-    for( q = p->begin() , qs = p->end() ; q != qs ; ++q ) {
-      uniq_names.insert( *q );
-    }
-  }
- 
-  set<string>::iterator r , rs;
-  string shash_prepend;
-  shash_prepend += hash_prepend;
-  for( r = uniq_names.begin() , rs = uniq_names.end() ; r != rs ; ++r ) {
-    string hash_code = shash_prepend + hash_feature_name( *r );
-    names_to_hash.push_back( make_pair( *r , hash_code ) );
-    hash_to_names.push_back( make_pair( hash_code , *r ) );
-  }
+void write_labels_row( ostream &os , const string &mol_name , char feat_label ,
+		       const FeatureDictionary &feat_dict ,
+		       vector<unsigned int> &feat_ids ) {
 
-  // names_to_hash should be in the right order, hash_to_names needs sorting
-  std::sort( hash_to_names.begin() , hash_to_names.end() ,
-	     boost::bind( less<string>() ,
-			  boost::bind( &pair<string,string>::first , _1 ) ,
-			  boost::bind( &pair<string,string>::first , _2 ) ) );
+  sort( feat_ids.begin() , feat_ids.end() ,
+	boost::bind( less<string>() ,
+		     boost::bind( &FeatureDictionary::label , &feat_dict , _1 ) ,
+		     boost::bind( &FeatureDictionary::label , &feat_dict , _2 ) ) );
+  os << mol_name;
+  for( int i = 0 , is = feat_ids.size() ; i < is ; ++i ) {
+    os << " " << feat_label << feat_dict.short_name( feat_ids[i] );
+  }
+  os << '\n';
 
 }
 
 // ****************************************************************************
-string name_from_pair_lookup( const string &search_name ,
-			      const vector<pair<string,string> > &name_pairs ) {
-
-  pair<string,string> search_pair = make_pair( search_name , "GARBAGE" );
-  vector<pair<string,string> >::const_iterator lb =
-    lower_bound( name_pairs.begin() , name_pairs.end() , search_pair ,
-		 boost::bind( less<string>() ,
-			      boost::bind( &pair<string,string>::first , _1 ) ,
-			      boost::bind( &pair<string,string>::first , _2 ) ) );
-  if( lb != name_pairs.end() && lb->first == search_name ) {
-    return lb->second;
-  } else {
-    return "";
+void write_labels_file( const string &output_filename , char feat_label ,
+			const FeatureDictionary &feat_dict ,
+			const vector<unsigned int> &col_ids ,
+			FeatureSpillFile &spill_file ) {
+
+  CompressedOFStream ofs2( output_filename );
+
+  // each molecule's labels go out in label order, which is the column
+  // order. Features that aren't in a column didn't make min_occur, so are
+  // left out.
+  vector<int> id_cols( feat_dict.size() , -1 );
+  for( int i = 0 , is = col_ids.size() ; i < is ; ++i ) {
+    id_cols[col_ids[i]] = i;
   }
-			      
-}
 
+  string mol_name;
+  vector<unsigned int> feat_ids;
+  vector<int> mol_cols;
+  spill_file.rewind();
+  while( spill_file.read_molecule( mol_name , feat_ids ) ) {
+    mol_cols.clear();
+    for( int j = 0 , js = feat_ids.size() ; j < js ; ++j ) {
+      if( -1 != id_cols[feat_ids[j]] ) {
+	mol_cols.push_back( id_cols[feat_ids[j]] );
+      }
+    }
+    sort( mol_cols.begin() , mol_cols.end() );
+    ofs2 << mol_name;
+    for( int j = 0 , js = mol_cols.size() ; j < js ; ++j ) {
+      ofs2 << " " << feat_label << feat_dict.short_name( col_ids[mol_cols[j]] );
+    }
+    ofs2 << '\n';
+  }
+  ofs2.close();
+
+}
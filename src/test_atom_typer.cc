@@ -0,0 +1,177 @@
+//
+// file test_atom_typer.cc
+// agent
+// 17th October 2026
+//
+// Checks that AtomTyper gives the same matches as OESubSearch on the fully
+// expanded SMARTS, for patterns whose meaning depends on how the atom
+// expression is taken apart, particularly hydrogen atoms ([H], [2H], [H+])
+// against hydrogen counts ([C;H3]). The molecules are some with explicit
+// hydrogens, plus any in the SMILES file given on the command line. Exits
+// with status 1 if there are any differences.
+//
+// test_atom_typer [smiles_file [max_mols]]
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include <oechem.h>
+
+#include "AtomTyper.H"
+
+using namespace std;
+using namespace OEChem;
+
+namespace {
+
+// the name, the SMARTS for AtomTyper, and the same thing expanded by hand
+// for OESubSearch.
+const char *TEST_SMARTS[][3] = {
+  { "h_atom" , "[H]" , "[H]" } ,
+  { "proton" , "[H+]" , "[H+]" } ,
+  { "hydride" , "[H-]" , "[H-]" } ,
+  { "deuterium" , "[2H]" , "[2H]" } ,
+  { "methyl" , "[C;H3]" , "[C;H3]" } ,
+  { "ch" , "[#6;!H0]" , "[#6;!H0]" } ,
+  { "nh_oh" , "[N,O;H1]" , "[N,O;H1]" } ,
+  { "h_first" , "[H1;C]" , "[H1;C]" } ,
+  { "heavy_h1" , "[$heavy;H1]" , "[$([!#1]);H1]" } ,
+  { "hyd_or_heavy_h0" , "[$hyd,$heavy;H0]" , "[$([H]),$([!#1]);H0]" } ,
+  { "bound_hyd" , "[$hyd]" , "[$([H])]" } ,
+  { 0 , 0 , 0 }
+};
+
+const char *BINDINGS[][2] = {
+  { "heavy" , "[!#1]" } ,
+  { "hyd" , "[H]" } ,
+  { 0 , 0 }
+};
+
+const char *TEST_MOLS[] = {
+  "[H]OC([H])([H])[H] methanol_h" ,
+  "[H+] proton" ,
+  "[H-].[Na+] sodium_hydride" ,
+  "[2H]C([2H])([2H])O methanol_d3" ,
+  "[H][H] hydrogen" ,
+  "[H]N([H])C(=O)C[NH3+] glycinamide_h" ,
+  "[H]c1c([H])c([H])c(O[H])c([H])c1[H] phenol_h" ,
+  "CC(C)O isopropanol" ,
+  0
+};
+
+// ***************************************************************************
+void oe_matches( OESubSearch &subs , OEMolBase &mol ,
+		 vector<vector<unsigned int> > &matches ) {
+
+  matches.clear();
+  for( OEIter<OEMatchBase> match = subs.Match( mol , true ) ; match ; ++match ) {
+    matches.push_back( vector<unsigned int>() );
+    for( OEIter<OEMatchPair<OEAtomBase> > mp = match->GetAtoms() ; mp ; ++mp ) {
+      matches.back().push_back( mp->target->GetIdx() );
+    }
+  }
+
+}
+
+// ***************************************************************************
+// the matches in a standard order, as the 2 don't have to give them in the
+// same one.
+void sort_matches( vector<vector<unsigned int> > &matches ) {
+
+  for( int i = 0 , is = matches.size() ; i < is ; ++i ) {
+    sort( matches[i].begin() , matches[i].end() );
+  }
+  sort( matches.begin() , matches.end() );
+
+}
+
+// ***************************************************************************
+// returns the number of patterns that gave different matches
+int check_molecule( OEMolBase &mol , AtomTyper &atom_typer ,
+		    vector<OESubSearch *> &subs ) {
+
+  int num_diffs = 0;
+  atom_typer.set_molecule( mol );
+  vector<vector<unsigned int> > typer_matches , oe_match_atoms;
+  for( int i = 0 ; TEST_SMARTS[i][0] ; ++i ) {
+    atom_typer.match( TEST_SMARTS[i][0] , typer_matches );
+    oe_matches( *subs[i] , mol , oe_match_atoms );
+    sort_matches( typer_matches );
+    sort_matches( oe_match_atoms );
+    if( typer_matches != oe_match_atoms ) {
+      cout << "DIFFERS : " << TEST_SMARTS[i][1] << " on " << mol.GetTitle()
+	   << " : AtomTyper " << typer_matches.size() << " matches, OESubSearch "
+	   << oe_match_atoms.size() << "." << endl;
+      ++num_diffs;
+    }
+  }
+  return num_diffs;
+
+}
+
+} // end of anonymous namespace
+
+// ***************************************************************************
+int main( int argc , char **argv ) {
+
+  vector<pair<string,string> > input_smarts , smarts_sub_defn;
+  vector<OESubSearch *> subs;
+  for( int i = 0 ; TEST_SMARTS[i][0] ; ++i ) {
+    input_smarts.push_back( make_pair( string( TEST_SMARTS[i][0] ) ,
+				       string( TEST_SMARTS[i][1] ) ) );
+    subs.push_back( new OESubSearch( TEST_SMARTS[i][2] , true ) );
+  }
+  for( int i = 0 ; BINDINGS[i][0] ; ++i ) {
+    smarts_sub_defn.push_back( make_pair( string( BINDINGS[i][0] ) ,
+					  string( BINDINGS[i][1] ) ) );
+  }
+
+  int num_diffs = 0 , num_mols = 0;
+  try {
+    AtomTyper atom_typer( input_smarts , smarts_sub_defn );
+    for( int i = 0 ; TEST_MOLS[i] ; ++i ) {
+      OEGraphMol mol;
+      string smi( TEST_MOLS[i] );
+      if( !OEParseSmiles( mol , smi.substr( 0 , smi.find( ' ' ) ).c_str() ) ) {
+	cout << "Couldn't parse " << smi << "." << endl;
+	exit( 1 );
+      }
+      mol.SetTitle( smi.substr( smi.find( ' ' ) + 1 ).c_str() );
+      num_diffs += check_molecule( mol , atom_typer , subs );
+      ++num_mols;
+    }
+
+    if( argc > 1 ) {
+      int max_mols = argc > 2 ? boost::lexical_cast<int>( argv[2] ) : 1000;
+      oemolistream ims( argv[1] );
+      if( !ims ) {
+	cout << "Couldn't read " << argv[1] << "." << endl;
+	exit( 1 );
+      }
+      OEGraphMol mol;
+      for( int i = 0 ; i < max_mols && ims >> mol ; ++i ) {
+	num_diffs += check_molecule( mol , atom_typer , subs );
+	++num_mols;
+      }
+    }
+  } catch( string &msg ) {
+    cout << msg << endl;
+    exit( 1 );
+  } catch( boost::bad_lexical_cast &e ) {
+    cout << "max_mols must be an integer." << endl;
+    exit( 1 );
+  }
+
+  for( int i = 0 , is = subs.size() ; i < is ; ++i ) {
+    delete subs[i];
+  }
+  cout << "Checked " << input_smarts.size() << " patterns on " << num_mols
+       << " molecules, " << num_diffs << " differences." << endl;
+  exit( num_diffs ? 1 : 0 );
+
+}
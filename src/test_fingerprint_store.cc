@@ -0,0 +1,294 @@
+//
+// file test_fingerprint_store.cc
+// agent
+// 17th October 2026
+//
+// Checks FingerprintStore's search and neighbour_pairs against a brute force
+// calculation of every Tanimoto, on random fingerprints written to a binary
+// bits file, for each popcount kernel the machine can run and for 1 and 4
+// threads. Exits with status 1 if there are any differences.
+//
+// test_fingerprint_store [bits_file]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include "BinaryBitsFile.H"
+#include "FileExceptions.H"
+#include "FingerprintStore.H"
+#include "popcount_kernels.H"
+
+using namespace std;
+
+namespace {
+
+// not a multiple of 64 or 512, so the kernels have part-filled words and
+// vectors at the end of each row.
+const unsigned int NUM_COLS = 700;
+const unsigned int NUM_ROWS = 1500;
+const unsigned int NUM_QUERIES = 20;
+
+// ***************************************************************************
+// rows with between 0 and NUM_COLS / 4 bits set, and some duplicates so
+// there are ties in the Tanimotos.
+void make_fingerprints( vector<vector<unsigned int> > &fps ) {
+
+  boost::random::mt19937 rng( 1729 );
+  boost::random::uniform_int_distribution<unsigned int> col_dist( 0 , NUM_COLS - 1 );
+  boost::random::uniform_int_distribution<unsigned int> count_dist( 0 , NUM_COLS / 4 );
+  boost::random::uniform_int_distribution<unsigned int> row_dist( 0 , NUM_ROWS - 1 );
+
+  fps.resize( NUM_ROWS );
+  for( unsigned int i = 0 ; i < NUM_ROWS ; ++i ) {
+    if( i > 10 && 0 == i % 10 ) {
+      fps[i] = fps[row_dist( rng ) % i];
+      continue;
+    }
+    unsigned int num_bits = count_dist( rng );
+    for( unsigned int j = 0 ; j < num_bits ; ++j ) {
+      fps[i].push_back( col_dist( rng ) );
+    }
+    sort( fps[i].begin() , fps[i].end() );
+    fps[i].erase( unique( fps[i].begin() , fps[i].end() ) , fps[i].end() );
+  }
+
+}
+
+// ***************************************************************************
+void write_fingerprints( const string &filename ,
+			 const vector<vector<unsigned int> > &fps ) {
+
+  vector<string> col_names , col_labels;
+  for( unsigned int i = 0 ; i < NUM_COLS ; ++i ) {
+    col_names.push_back( string( "c" ) + boost::lexical_cast<string>( i ) );
+    col_labels.push_back( col_names.back() );
+  }
+  BinaryBitsWriter writer( filename , col_names , col_labels );
+  for( unsigned int i = 0 ; i < fps.size() ; ++i ) {
+    writer.add_row( string( "row" ) + boost::lexical_cast<string>( i ) , fps[i] );
+  }
+  writer.close();
+
+}
+
+// ***************************************************************************
+// the same sum FingerprintStore does, so the doubles compare exactly
+double tanimoto( const vector<unsigned int> &a , const vector<unsigned int> &b ) {
+
+  vector<unsigned int> common;
+  set_intersection( a.begin() , a.end() , b.begin() , b.end() ,
+		    back_inserter( common ) );
+  unsigned int either = a.size() + b.size() - common.size();
+  return either ? double( common.size() ) / double( either ) : 0.0;
+
+}
+
+// ***************************************************************************
+// the Tanimoto of every pair of rows, worked out once for all the checks
+void make_brute_tanimotos( const vector<vector<unsigned int> > &fps ,
+			   vector<double> &tanimotos ) {
+
+  tanimotos.resize( NUM_ROWS * NUM_ROWS );
+  for( unsigned int i = 0 ; i < NUM_ROWS ; ++i ) {
+    for( unsigned int j = i ; j < NUM_ROWS ; ++j ) {
+      tanimotos[i * NUM_ROWS + j] = tanimotos[j * NUM_ROWS + i] =
+	tanimoto( fps[i] , fps[j] );
+    }
+  }
+
+}
+
+// ***************************************************************************
+bool hit_is_better( const FP_SEARCH_HIT &a , const FP_SEARCH_HIT &b ) {
+
+  if( a.tanimoto_ != b.tanimoto_ ) {
+    return a.tanimoto_ > b.tanimoto_;
+  }
+  return a.row_ < b.row_;
+
+}
+
+// ***************************************************************************
+bool pair_is_less( const FP_NEIGHBOUR_PAIR &a , const FP_NEIGHBOUR_PAIR &b ) {
+
+  if( a.row1_ != b.row1_ ) {
+    return a.row1_ < b.row1_;
+  }
+  return a.row2_ < b.row2_;
+
+}
+
+// ***************************************************************************
+bool same_hits( const vector<FP_SEARCH_HIT> &a , const vector<FP_SEARCH_HIT> &b ) {
+
+  if( a.size() != b.size() ) {
+    return false;
+  }
+  for( unsigned int i = 0 ; i < a.size() ; ++i ) {
+    if( a[i].row_ != b[i].row_ || a[i].tanimoto_ != b[i].tanimoto_ ) {
+      return false;
+    }
+  }
+  return true;
+
+}
+
+// ***************************************************************************
+bool same_pairs( const vector<FP_NEIGHBOUR_PAIR> &a ,
+		 const vector<FP_NEIGHBOUR_PAIR> &b ) {
+
+  if( a.size() != b.size() ) {
+    return false;
+  }
+  for( unsigned int i = 0 ; i < a.size() ; ++i ) {
+    if( a[i].row1_ != b[i].row1_ || a[i].row2_ != b[i].row2_ ||
+	a[i].tanimoto_ != b[i].tanimoto_ ) {
+      return false;
+    }
+  }
+  return true;
+
+}
+
+// ***************************************************************************
+// returns the number of searches that gave different answers from brute force
+int check_search( FingerprintStore &fp_store ,
+		  const vector<vector<unsigned int> > &fps ,
+		  const vector<double> &tanimotos , const string &setup ) {
+
+  int num_diffs = 0;
+  double thresholds[] = { 0.0 , 0.3 , 0.7 , 1.0 };
+  unsigned int top_ks[] = { 0 , 1 , 10 , 200 };
+  vector<boost::uint64_t> query;
+  vector<FP_SEARCH_HIT> hits , brute_hits;
+  for( unsigned int q = 0 ; q < NUM_QUERIES ; ++q ) {
+    // rows from the file, so there's always at least 1 with a Tanimoto of 1
+    unsigned int q_row = ( q * 97 ) % NUM_ROWS;
+    const vector<unsigned int> &q_fp = fps[q_row];
+    fp_store.make_query( query );
+    for( unsigned int i = 0 ; i < q_fp.size() ; ++i ) {
+      query[q_fp[i] / 64] |= boost::uint64_t( 1 ) << ( q_fp[i] % 64 );
+    }
+    for( int t = 0 ; t < 4 ; ++t ) {
+      for( int k = 0 ; k < 4 ; ++k ) {
+	brute_hits.clear();
+	for( unsigned int i = 0 ; i < NUM_ROWS ; ++i ) {
+	  FP_SEARCH_HIT hit;
+	  hit.row_ = i;
+	  hit.tanimoto_ = tanimotos[q_row * NUM_ROWS + i];
+	  if( hit.tanimoto_ >= thresholds[t] ) {
+	    brute_hits.push_back( hit );
+	  }
+	}
+	sort( brute_hits.begin() , brute_hits.end() , hit_is_better );
+	if( top_ks[k] && brute_hits.size() > top_ks[k] ) {
+	  brute_hits.resize( top_ks[k] );
+	}
+	fp_store.search( query , thresholds[t] , top_ks[k] , hits );
+	if( !same_hits( hits , brute_hits ) ) {
+	  cout << "DIFFERS : search " << setup << " query " << q << " threshold "
+	       << thresholds[t] << " top_k " << top_ks[k] << " : "
+	       << hits.size() << " hits, brute force " << brute_hits.size()
+	       << "." << endl;
+	  ++num_diffs;
+	}
+      }
+    }
+  }
+  return num_diffs;
+
+}
+
+// ***************************************************************************
+// returns the number of thresholds where neighbour_pairs was different from
+// brute force
+int check_neighbour_pairs( const FingerprintStore &fp_store ,
+			   const vector<double> &tanimotos ,
+			   const string &setup ) {
+
+  int num_diffs = 0;
+  double thresholds[] = { 0.05 , 0.3 , 0.7 , 1.0 };
+  vector<FP_NEIGHBOUR_PAIR> pairs , brute_pairs;
+  for( int t = 0 ; t < 4 ; ++t ) {
+    brute_pairs.clear();
+    for( unsigned int i = 0 ; i < NUM_ROWS ; ++i ) {
+      for( unsigned int j = i + 1 ; j < NUM_ROWS ; ++j ) {
+	// the threshold applies to the double, before it's cut down to a float
+	double tanimoto = tanimotos[i * NUM_ROWS + j];
+	if( tanimoto >= thresholds[t] ) {
+	  FP_NEIGHBOUR_PAIR pair;
+	  pair.row1_ = i;
+	  pair.row2_ = j;
+	  pair.tanimoto_ = tanimoto;
+	  brute_pairs.push_back( pair );
+	}
+      }
+    }
+    fp_store.neighbour_pairs( thresholds[t] , pairs );
+    sort( pairs.begin() , pairs.end() , pair_is_less );
+    if( !same_pairs( pairs , brute_pairs ) ) {
+      cout << "DIFFERS : neighbour_pairs " << setup << " threshold "
+	   << thresholds[t] << " : " << pairs.size() << " pairs, brute force "
+	   << brute_pairs.size() << "." << endl;
+      ++num_diffs;
+    }
+  }
+  return num_diffs;
+
+}
+
+} // end of anonymous namespace
+
+// ***************************************************************************
+int main( int argc , char **argv ) {
+
+  string bits_filename = argc > 1 ? argv[1] : "test_fingerprint_store.bin";
+
+  vector<vector<unsigned int> > fps;
+  make_fingerprints( fps );
+  vector<double> tanimotos;
+  make_brute_tanimotos( fps , tanimotos );
+
+  vector<string> kernels;
+  available_and_popcount_kernels( kernels );
+  int num_diffs = 0 , num_checks = 0;
+  try {
+    write_fingerprints( bits_filename , fps );
+    BinaryBitsFile bits_file( bits_filename );
+    for( unsigned int k = 0 ; k < kernels.size() ; ++k ) {
+      select_and_popcount_kernel( kernels[k] );
+      int thread_counts[] = { 1 , 4 };
+      for( int t = 0 ; t < 2 ; ++t ) {
+	string setup = kernels[k] + " with " +
+	  boost::lexical_cast<string>( thread_counts[t] ) + " threads";
+	FingerprintStore fp_store( bits_file , thread_counts[t] );
+	num_diffs += check_search( fp_store , fps , tanimotos , setup );
+	num_diffs += check_neighbour_pairs( fp_store , tanimotos , setup );
+	++num_checks;
+      }
+    }
+  } catch( DACLIB::FileReadOpenError &e ) {
+    cout << e.what() << endl;
+    exit( 1 );
+  } catch( DACLIB::FileWriteOpenError &e ) {
+    cout << e.what() << endl;
+    exit( 1 );
+  } catch( string &msg ) {
+    cout << msg << endl;
+    exit( 1 );
+  }
+
+  remove( bits_filename.c_str() );
+  cout << "Checked " << num_checks << " kernel and thread combinations, "
+       << num_diffs << " differences." << endl;
+  exit( num_diffs ? 1 : 0 );
+
+}
@@ -0,0 +1,147 @@
+#
+# file test_pysmg.py
+# agent
+# 17th October 2026
+#
+# Checks the pysmg module on the first 200 molecules of the test SMILES.
+# csr must give a proper compressed sparse row matrix whose columns are the
+# features in label order, the same with 1 thread or 4, packed must have the
+# same bits as csr when folded, the arrays must be read-only with the right
+# types, and a Generator can't be initialised twice.
+#
+# test_pysmg.py <dir_with_pysmg.so> <test_dir>
+
+import os
+import sys
+
+sys.path.insert(0, sys.argv[1])
+import pysmg
+
+TEST_DIR = sys.argv[2]
+NUM_MOLS = 200
+FOLD_BITS = 1024
+
+failures = []
+
+
+def check(ok, msg):
+    if not ok:
+        failures.append(msg)
+
+
+def base_buffer(arr):
+    # the pysmg.Buffer under a NumPy array, or the Buffer itself
+    while not isinstance(arr, pysmg.Buffer):
+        arr = arr.base if hasattr(arr, 'base') else arr.obj
+    return arr
+
+
+def as_seq(arr):
+    # a NumPy array, or a Buffer if there's no NumPy
+    return arr if hasattr(arr, '__len__') else memoryview(arr)
+
+
+def make_generator(fold_bits=0):
+    return pysmg.Generator(os.path.join(TEST_DIR, 'test.smt'),
+                           os.path.join(TEST_DIR, 'test.points'),
+                           features='pairs', fold_bits=fold_bits)
+
+
+def check_csr(names, indptr, indices, columns, mol_names, what):
+    indptr, indices = as_seq(indptr), as_seq(indices)
+    check(list(names) == mol_names, what + ' : wrong names')
+    check(len(indptr) == len(mol_names) + 1, what + ' : wrong indptr length')
+    check(indptr[0] == 0 and indptr[len(indptr) - 1] == len(indices),
+          what + ' : indptr ends are wrong')
+    used = set()
+    for i in range(len(mol_names)):
+        row = [int(c) for c in indices[indptr[i]:indptr[i + 1]]]
+        check(row == sorted(set(row)), what + ' : row %d not sorted' % i)
+        check(all(0 <= c < len(columns) for c in row),
+              what + ' : row %d has a column out of range' % i)
+        used.update(row)
+    return used
+
+
+def check_buffer(arr, fmt, itemsize, what):
+    buf = base_buffer(arr)
+    view = memoryview(buf)
+    check(view.readonly, what + ' : buffer is writable')
+    check(view.format == fmt and view.itemsize == itemsize,
+          what + ' : buffer is %s of %d bytes' % (view.format, view.itemsize))
+    check(len(bytes(buf)) == view.nbytes, what + ' : plain bytes are wrong')
+    try:
+        import ctypes
+        (ctypes.c_char * max(1, view.nbytes)).from_buffer(buf)
+        check(False, what + ' : writable buffer was given')
+    except (TypeError, BufferError):
+        pass
+
+
+def main():
+    smiles = []
+    with open(os.path.join(TEST_DIR, 'chembl_20_first_10000_small.smi')) as f:
+        for line in f:
+            if line.strip():
+                smiles.append(line.strip())
+            if len(smiles) == NUM_MOLS:
+                break
+    mol_names = [s.split()[1] if len(s.split()) > 1 else str(i + 1)
+                 for i, s in enumerate(smiles)]
+
+    # unfolded, the columns are the features seen, in label order
+    gen = make_generator()
+    names, indptr, indices, columns = gen.csr(smiles, num_threads=1)
+    used = check_csr(names, indptr, indices, columns, mol_names, 'unfolded')
+    check(list(columns) == sorted(set(columns)),
+          'unfolded : columns not in label order')
+    check(used == set(range(len(columns))),
+          'unfolded : columns that are in no molecule')
+    check_buffer(indptr, 'q', 8, 'indptr')
+    check_buffer(indices, 'i', 4, 'indices')
+    names4, indptr4, indices4, columns4 = gen.csr(smiles, num_threads=4)
+    check(list(names4) == list(names)
+          and list(as_seq(indptr4)) == list(as_seq(indptr))
+          and list(as_seq(indices4)) == list(as_seq(indices))
+          and columns4 == columns,
+          'unfolded : 4 threads differ from 1')
+    try:
+        gen.packed(smiles)
+        check(False, 'packed without fold_bits worked')
+    except ValueError:
+        pass
+    try:
+        gen.__init__(os.path.join(TEST_DIR, 'test.smt'),
+                     os.path.join(TEST_DIR, 'test.points'))
+        check(False, 'Generator was initialised twice')
+    except RuntimeError:
+        pass
+
+    # folded, the columns are the bits, and packed has the same bits
+    gen = make_generator(FOLD_BITS)
+    names, indptr, indices, columns = gen.csr(smiles, num_threads=2)
+    check_csr(names, indptr, indices, columns, mol_names, 'folded')
+    check(len(columns) == FOLD_BITS, 'folded : wrong number of columns')
+    indptr, indices = as_seq(indptr), as_seq(indices)
+    names, bits = gen.packed(smiles, num_threads=2)
+    check(list(names) == mol_names, 'packed : wrong names')
+    check_buffer(bits, 'Q', 8, 'packed')
+    words = (FOLD_BITS + 63) // 64
+    flat = memoryview(base_buffer(bits)).cast('B').cast('Q')
+    for i in range(len(mol_names)):
+        row = set(int(c) for c in indices[indptr[i]:indptr[i + 1]])
+        packed_row = set(b for b in range(FOLD_BITS)
+                         if (flat[i * words + b // 64] >> (b % 64)) & 1)
+        check(row == packed_row, 'packed : row %d differs from csr' % i)
+
+    for f in failures:
+        print('FAILED : ' + f)
+    if failures:
+        return 1
+    print('pysmg passed, %d molecules with %d features.' %
+          (len(mol_names), int(as_seq(indptr4)[-1])))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
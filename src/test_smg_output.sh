@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# file test_smg_output.sh
+# agent
+# 17th October 2026
+#
+# Checks the output of the real smg program on the small test SMILES.
+# Without a golden directory, it checks that smg gives the same bitstrings
+# whichever way they're made: with 1 or 4 threads, spilled to disk then
+# written or, with a vocabulary from a previous run, written as they come,
+# and compressed. With a golden directory, from make_smg_golden.sh, it
+# checks that the sites, pairs and triplets bitstrings and the pairs labels,
+# made with several threads and by the vocabulary route, are byte for byte
+# the same as the original smg made. If the golden directory isn't there,
+# it exits with status 77, which ctest reports as skipped.
+#
+# test_smg_output.sh <smg> <test_dir> <work_dir> [<golden_dir>]
+
+SMG=$1
+TEST_DIR=$2
+GOLDEN=$4
+WORK=$3/test_smg_output${GOLDEN:+_golden}
+SMG_ARGS="-sm $TEST_DIR/test.smt -po $TEST_DIR/test.points -mo $TEST_DIR/chembl_20_first_10000_small.smi"
+
+fail() {
+    echo "FAILED : $1"
+    exit 1
+}
+
+# run smg with the arguments, writing its output to the first one
+run_smg() {
+    out=$1
+    shift
+    $SMG $SMG_ARGS -ou $WORK/$out "$@" > $WORK/smg.log 2>&1 ||
+        fail "smg -ou $out $*"
+}
+
+# both the file and its name decode file must be the same
+same_output() {
+    cmp -s $1 $2 || fail "$1 isn't the same as $2"
+    cmp -s $1.name_decode $2.name_decode ||
+        fail "$1.name_decode isn't the same as $2.name_decode"
+}
+
+if [ -n "$GOLDEN" ] && [ ! -f $GOLDEN/pairs.bits ]; then
+    echo "No golden files in $GOLDEN, so nothing to check. Make them with"
+    echo "make_smg_golden.sh."
+    exit 77
+fi
+
+rm -rf $WORK
+mkdir -p $WORK || exit 1
+
+if [ -z "$GOLDEN" ]; then
+    # spilled, with 1 thread, is the reference
+    run_smg ref.bits -pa -b -th 1
+    run_smg th4.bits -pa -b -th 4
+    same_output $WORK/ref.bits $WORK/th4.bits
+    run_smg vocab.bits -pa -b -th 2 -wr $WORK/pairs.vocab
+    same_output $WORK/ref.bits $WORK/vocab.bits
+    # the columns are known, so the bits are written as they come
+    run_smg stream.bits -pa -b -th 4 -re $WORK/pairs.vocab
+    same_output $WORK/ref.bits $WORK/stream.bits
+    run_smg gz.bits.gz -pa -b -th 4
+    gunzip -c $WORK/gz.bits.gz | cmp -s - $WORK/ref.bits ||
+        fail "compressed bits aren't the same as uncompressed"
+    run_smg fold1.bits -pa -b -th 1 -fo 1024
+    run_smg fold4.bits -pa -b -th 4 -fo 1024
+    cmp -s $WORK/fold1.bits $WORK/fold4.bits ||
+        fail "folded bits differ between 1 and 4 threads"
+    echo "smg output passed."
+else
+    for feat in sites pairs triplets; do
+        run_smg $feat.bits -$feat -b -th 4
+        same_output $GOLDEN/$feat.bits $WORK/$feat.bits
+    done
+    run_smg pairs.labels -pa -l -th 4
+    same_output $GOLDEN/pairs.labels $WORK/pairs.labels
+    run_smg vocab.bits -pa -b -th 3 -wr $WORK/pairs.vocab
+    run_smg stream.bits -pa -b -th 3 -re $WORK/pairs.vocab
+    same_output $GOLDEN/pairs.bits $WORK/stream.bits
+    echo "smg output matches the golden files in $GOLDEN."
+fi
+
+rm -rf $WORK
+exit 0
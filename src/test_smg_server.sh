@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# file test_smg_server.sh
+# agent
+# 17th October 2026
+#
+# Checks the smg -serve protocol with smg_client. The first 200 molecules of
+# the test SMILES go to a server for labels and, with -fold 1024, for bits,
+# in batches of 37 so requests end part way through, and the answers must
+# be the same as smg writes for the same molecules to a file. Also checks
+# that bits are refused when the columns aren't fixed, and that shutdown
+# stops the server.
+#
+# test_smg_server.sh <smg> <smg_client> <test_dir> <work_dir>
+
+SMG=$1
+CLIENT=$2
+TEST_DIR=$3
+WORK=$4/test_smg_server
+SMG_ARGS="-sm $TEST_DIR/test.smt -po $TEST_DIR/test.points -pa -th 2"
+
+rm -rf $WORK
+mkdir -p $WORK || exit 1
+head -200 $TEST_DIR/chembl_20_first_10000_small.smi > $WORK/mols.smi
+
+fail() {
+    echo "FAILED : $1"
+    [ -n "$SERVER_PID" ] && kill $SERVER_PID 2> /dev/null
+    exit 1
+}
+
+# the labels on each line in order, as the server gives them in feature
+# order and smg in label order.
+sort_labels() {
+    awk '{ printf "%s" , $1 ; n = split( $0 , a , " " ) ;
+           for( i = 2 ; i <= n ; ++i ) { l[i - 1] = a[i] } ;
+           m = n - 1 ;
+           for( i = 1 ; i <= m ; ++i ) for( j = i + 1 ; j <= m ; ++j )
+             if( l[j] < l[i] ) { t = l[i] ; l[i] = l[j] ; l[j] = t } ;
+           for( i = 1 ; i <= m ; ++i ) printf " %s" , l[i] ;
+           printf "\n" }' $1
+}
+
+# start a server with the extra arguments, and wait for its socket
+start_server() {
+    SOCKET=$WORK/smg.sock
+    $SMG $SMG_ARGS -serve $SOCKET "$@" 2> $WORK/server.log &
+    SERVER_PID=$!
+    for i in $(seq 1 600); do
+        [ -S $SOCKET ] && return 0
+        kill -0 $SERVER_PID 2> /dev/null || fail "server didn't start"
+        sleep 0.1
+    done
+    fail "server's socket didn't appear"
+}
+
+stop_server() {
+    $CLIENT -so $SOCKET -sh > /dev/null 2>&1 || fail "shutdown refused"
+    wait $SERVER_PID || fail "server exited with an error"
+    [ -e $SOCKET ] && fail "server left its socket behind"
+    SERVER_PID=
+}
+
+# labels
+$SMG $SMG_ARGS -mo $WORK/mols.smi -ou $WORK/file_labels.txt -labels \
+    > /dev/null 2>&1 || fail "smg -labels"
+start_server
+$CLIENT -so $SOCKET -mo $WORK/mols.smi -ou $WORK/serve_labels.txt -ba 37 \
+    > /dev/null 2>&1 || fail "smg_client labels"
+sort_labels $WORK/file_labels.txt > $WORK/file_labels.sorted
+sort_labels $WORK/serve_labels.txt > $WORK/serve_labels.sorted
+cmp -s $WORK/file_labels.sorted $WORK/serve_labels.sorted ||
+    fail "labels from the server aren't the same as from the file"
+# no fixed columns, so bits must be refused
+$CLIENT -so $SOCKET -mo $WORK/mols.smi -ou $WORK/no_bits.txt -bi \
+    > $WORK/no_bits.log 2>&1 && fail "bits weren't refused without fixed columns"
+grep -q "ERROR" $WORK/no_bits.log || fail "no error for bits without fixed columns"
+stop_server
+
+# folded bits
+$SMG $SMG_ARGS -mo $WORK/mols.smi -ou $WORK/file_bits.txt -b -fo 1024 \
+    > /dev/null 2>&1 || fail "smg -fold"
+start_server -fo 1024
+$CLIENT -so $SOCKET -mo $WORK/mols.smi -ou $WORK/serve_bits.txt -bi -ba 37 \
+    > /dev/null 2>&1 || fail "smg_client bits"
+tail -n +2 $WORK/file_bits.txt | cmp -s - $WORK/serve_bits.txt ||
+    fail "bits from the server aren't the same as from the file"
+stop_server
+
+echo "smg -serve passed."
+rm -rf $WORK
+exit 0